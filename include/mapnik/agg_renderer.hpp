@@ -74,7 +74,19 @@ public:
                  double scale_factor=1.0, unsigned offset_x=0, unsigned offset_y=0);
     // pass in mapnik::request object to provide the mutable things per render
     agg_renderer(Map const& m, request const& req, attributes const& vars, buffer_type & pixmap, double scale_factor=1.0, unsigned offset_x=0, unsigned offset_y=0);
+    // request with external placement detector, possibly non-empty
+    agg_renderer(Map const& m, request const& req, attributes const& vars, buffer_type & pixmap,
+                 std::shared_ptr<detector_type> detector,
+                 double scale_factor=1.0, unsigned offset_x=0, unsigned offset_y=0);
     ~agg_renderer();
+    // prepare for rendering `req` into the same pixmap again, keeping the
+    // rasterizer, style buffers, font caches and placement detector
+    // allocated by earlier renders. The pixmap is cleared to the map
+    // background; throws std::runtime_error if `req` does not fit it.
+    // A detector passed to the constructor is not cleared or replaced,
+    // unless it shares labels through a label_placement_store.
+    void reset(request const& req, attributes const& vars = attributes(),
+               unsigned offset_x = 0, unsigned offset_y = 0);
     void start_map_processing(Map const& map);
     void end_map_processing(Map const& map);
     void start_layer_processing(layer const& lay, box2d<double> const& query_extent);
@@ -162,6 +174,8 @@ protected:
 private:
     buffer_type & pixmap_;
     std::shared_ptr<buffer_type> internal_buffer_;
+    // part of internal_buffer_ that may hold pixels from the last style
+    box2d<int> internal_dirty_;
     mutable buffer_type * current_buffer_;
     mutable bool style_level_compositing_;
     const std::unique_ptr<rasterizer> ras_ptr;
@@ -0,0 +1,79 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef MAPNIK_BAND_RENDERER_HPP
+#define MAPNIK_BAND_RENDERER_HPP
+
+// mapnik
+#include <mapnik/config.hpp>
+#include <mapnik/attribute.hpp>
+#include <mapnik/image.hpp>
+
+// stl
+#include <functional>
+#include <iosfwd>
+#include <string>
+
+namespace mapnik
+{
+
+class Map;
+
+// Called with each band and the image row it starts at.
+using band_handler = std::function<void(image_rgba8 const& band, unsigned y)>;
+
+// Renders `m` at its own size and extent in horizontal bands of at most
+// `band_height` rows, top to bottom, so that only a single band (and the
+// style buffers sized to it) is held in memory at a time.
+//
+// Each band queries its own slice of the extent, grown by the map's buffer
+// size. Labels are placed against the labels of the band above, carried
+// over into the band's coordinates, so placements stay consistent across
+// seams and a label that straddles a seam is drawn by both bands. Labels
+// whose placement depends on the band (e.g. along lines clipped differently)
+// can still be cut at a seam, and background images restart at the top of
+// each band.
+MAPNIK_DECL void render_bands(Map const& m,
+                              unsigned band_height,
+                              band_handler const& handler,
+                              double scale_factor = 1.0,
+                              attributes const& vars = attributes());
+
+// render_bands into a band_writer for `format`, see create_band_writer
+MAPNIK_DECL void render_to_stream(Map const& m,
+                                  std::ostream & stream,
+                                  std::string const& format,
+                                  unsigned band_height,
+                                  double scale_factor = 1.0,
+                                  attributes const& vars = attributes());
+
+MAPNIK_DECL void render_to_file(Map const& m,
+                                std::string const& filename,
+                                std::string const& format,
+                                unsigned band_height,
+                                double scale_factor = 1.0,
+                                attributes const& vars = attributes());
+
+}
+
+#endif // MAPNIK_BAND_RENDERER_HPP
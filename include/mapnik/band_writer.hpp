@@ -0,0 +1,62 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef MAPNIK_BAND_WRITER_HPP
+#define MAPNIK_BAND_WRITER_HPP
+
+// mapnik
+#include <mapnik/config.hpp>
+#include <mapnik/image.hpp>
+#include <mapnik/util/noncopyable.hpp>
+
+// stl
+#include <iosfwd>
+#include <memory>
+#include <string>
+
+namespace mapnik
+{
+
+// Encodes an image handed over as horizontal bands, top to bottom, so the
+// whole image never has to be held in memory. Bands are straight (not
+// premultiplied) rgba8 of the full image width.
+class MAPNIK_DECL band_writer : private util::noncopyable
+{
+public:
+    virtual ~band_writer() {}
+    // append the rows of `band` below the rows written so far
+    virtual void write(image_rgba8 const& band) = 0;
+    // finish the image; throws if fewer rows than the image height were written
+    virtual void close() = 0;
+};
+
+// Truecolor png ("png", "png32", "png24" and their options) and tiff
+// (compression, zlevel and rows_per_strip options, always stripped) formats
+// are supported. Paletted png needs the whole image and is rejected.
+MAPNIK_DECL std::unique_ptr<band_writer> create_band_writer(std::ostream & stream,
+                                                            std::string const& format,
+                                                            unsigned width,
+                                                            unsigned height);
+
+}
+
+#endif // MAPNIK_BAND_WRITER_HPP
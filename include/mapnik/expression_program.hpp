@@ -0,0 +1,135 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef MAPNIK_EXPRESSION_PROGRAM_HPP
+#define MAPNIK_EXPRESSION_PROGRAM_HPP
+
+// mapnik
+#include <mapnik/config.hpp>
+#include <mapnik/attribute.hpp>
+#include <mapnik/expression_node.hpp>
+#include <mapnik/feature.hpp>
+
+// stl
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mapnik
+{
+
+// An expression flattened into postfix code for a small stack machine.
+//
+// Attribute and global attribute names are collected at compile time and
+// resolved to feature data indices / variable values once per binding, so
+// evaluation neither recurses through visitors nor performs string lookups.
+// Programs are immutable and can be shared between threads, while each
+// thread evaluates through its own binding.
+class MAPNIK_DECL expression_program
+{
+public:
+    enum opcode : std::uint8_t
+    {
+        op_constant,
+        op_attribute,
+        op_global_attribute,
+        op_geometry_type,
+        op_negate,
+        op_logical_not,
+        op_plus,
+        op_minus,
+        op_mult,
+        op_div,
+        op_mod,
+        op_less,
+        op_less_equal,
+        op_greater,
+        op_greater_equal,
+        op_equal_to,
+        op_not_equal_to,
+        op_and_jump,   // short circuit to arg if top is false
+        op_or_jump,    // short circuit to arg if top is true
+        op_to_bool,
+        op_regex_match,
+        op_regex_replace,
+        op_unary_call,
+        op_binary_call
+    };
+
+    struct instruction
+    {
+        opcode op;
+        std::uint32_t arg;
+    };
+
+    // Attribute slots and scratch space for evaluating a program
+    // against features sharing one context. The binding keeps that
+    // context alive, so a new context can never reuse its address.
+    class binding
+    {
+        friend class expression_program;
+    public:
+        binding()
+            : ctx_(),
+              ctx_size_(0),
+              vars_(nullptr) {}
+    private:
+        context_ptr ctx_;
+        std::size_t ctx_size_;
+        attributes const* vars_;
+        std::vector<std::size_t> slots_;
+        std::vector<value_type const*> globals_;
+        std::vector<value_type> temps_;
+        std::vector<value_type const*> stack_;
+    };
+
+    explicit expression_program(expr_node const& expr);
+
+    value_type evaluate(feature_impl const& feature,
+                        attributes const& vars,
+                        binding & b) const;
+
+    // feature attributes referenced by the program
+    std::vector<std::string> const& attribute_names() const { return attribute_names_; }
+    std::vector<instruction> const& code() const { return code_; }
+
+private:
+    friend struct expression_compiler;
+    void bind(feature_impl const& feature, attributes const& vars, binding & b) const;
+
+    std::vector<instruction> code_;
+    std::vector<value_type> constants_;
+    std::vector<std::string> attribute_names_;
+    std::vector<std::string> global_names_;
+    std::vector<regex_match_node> regex_matches_;
+    std::vector<regex_replace_node> regex_replaces_;
+    std::vector<unary_function_impl> unary_calls_;
+    std::vector<binary_function_impl> binary_calls_;
+    std::size_t max_depth_;
+};
+
+using expression_program_ptr = std::shared_ptr<expression_program const>;
+
+}
+
+#endif // MAPNIK_EXPRESSION_PROGRAM_HPP
@@ -33,11 +33,12 @@
 //
 #include <mapnik/feature_kv_iterator.hpp>
 #include <mapnik/util/noncopyable.hpp>
+#include <mapnik/util/flat_map.hpp>
 
 // stl
 #include <memory>
 #include <vector>
-#include <map>
+#include <limits>
 #include <ostream>                      // for basic_ostream, operator<<, etc
 #include <sstream>                      // for basic_stringstream
 #include <stdexcept>                    // for out_of_range
@@ -82,16 +83,63 @@ public:
     inline size_type size() const { return mapping_.size(); }
     inline const_iterator begin() const { return mapping_.begin();}
     inline const_iterator end() const { return mapping_.end();}
+    inline const_iterator find(key_type const& name) const { return mapping_.find(name);}
 
 private:
     map_type mapping_;
 };
 
-using context_type = context<std::map<std::string,std::size_t> >;
+using context_type = context<util::flat_map<std::string,std::size_t> >;
 using context_ptr = std::shared_ptr<context_type>;
 
 static const value default_feature_value{};
 
+// Attribute key resolved against a context once, so that features sharing
+// the context can return its value by index instead of looking up the key.
+// Features with any other context fall back to the lookup by key.
+class resolved_attribute
+{
+    friend class feature_impl;
+public:
+    explicit resolved_attribute(std::string const& key)
+        : key_(key),
+          ctx_(),
+          ctx_size_(0),
+          index_(npos) {}
+
+    resolved_attribute(context_ptr const& ctx, std::string const& key)
+        : resolved_attribute(key)
+    {
+        resolve(ctx);
+    }
+
+    void resolve(context_ptr const& ctx)
+    {
+        ctx_ = ctx;
+        ctx_size_ = ctx_ ? ctx_->size() : 0;
+        index_ = npos;
+        if (ctx_)
+        {
+            auto itr = ctx_->find(key_);
+            if (itr != ctx_->end()) index_ = itr->second;
+        }
+    }
+
+    bool resolved_for(context_type const& ctx) const
+    {
+        return ctx_.get() == &ctx;
+    }
+
+    std::string const& key() const { return key_; }
+
+private:
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+    std::string key_;
+    context_ptr ctx_;
+    std::size_t ctx_size_;
+    std::size_t index_;
+};
+
 class MAPNIK_DECL feature_impl : private util::noncopyable
 {
     friend class feature_kv_iterator;
@@ -173,6 +221,17 @@ public:
         return default_feature_value;
     }
 
+    inline value_type const& get(resolved_attribute const& attr) const
+    {
+        // a key missing at resolution time may have been added to the context since
+        if (attr.ctx_ == ctx_ &&
+            (attr.index_ != resolved_attribute::npos || attr.ctx_size_ == ctx_->size()))
+        {
+            return get(attr.index_);
+        }
+        return get(attr.key_);
+    }
+
     inline std::size_t size() const
     {
         return data_.size();
@@ -193,6 +252,11 @@ public:
         return ctx_;
     }
 
+    inline context_type const& get_context() const
+    {
+        return *ctx_;
+    }
+
     inline void set_geometry(geometry::geometry<double> && geom)
     {
         geom_ = std::move(geom);
@@ -27,6 +27,7 @@
 #include <mapnik/config.hpp>
 #include <mapnik/value.hpp>
 #include <mapnik/util/variant.hpp>
+#include <mapnik/util/flat_map.hpp>
 
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
@@ -37,7 +38,6 @@
 #pragma GCC diagnostic pop
 
 // stl
-#include <map>
 #include <tuple>
 
 namespace mapnik {
@@ -62,7 +62,7 @@ private:
     value_type const& dereference() const;
 
     feature_impl const& f_;
-    std::map<std::string,std::size_t>::const_iterator itr_;
+    util::flat_map<std::string,std::size_t>::const_iterator itr_;
     mutable value_type kv_;
 
 };
@@ -32,6 +32,7 @@
 // stl
 #include <set>
 #include <string>
+#include <vector>
 
 namespace mapnik
 {
@@ -43,6 +44,7 @@ class proj_transform;
 class feature_type_style;
 class rule_cache;
 struct layer_rendering_material;
+namespace detail { class matched_features; }
 
 enum eAttributeCollectionPolicy
 {
@@ -69,6 +71,17 @@ public:
                std::set<std::string>& names,
                double scale_denom_override=0.0);
 
+    /*!
+     * \brief set the number of threads used to prepare and query layers in apply().
+     *
+     * With a value greater than 1 the datasource queries of all visible layers are
+     * issued concurrently before the layers are rendered in order. Datasources that
+     * implement asynchronous queries through a processor context are always prepared
+     * on the calling thread. Defaults to 1 (serial).
+     */
+    void set_query_concurrency(unsigned threads) { query_concurrency_ = threads; }
+    unsigned query_concurrency() const { return query_concurrency_; }
+
     /*!
      * \brief render a layer given a projection and scale.
      */
@@ -83,6 +96,12 @@ public:
                         int buffer_size,
                         std::set<std::string>& names);
 
+protected:
+    /*!
+     * \brief the map being rendered.
+     */
+    Map const& map() const { return m_; }
+
 private:
     /*!
      * \brief renders a featureset with the given styles.
@@ -93,6 +112,14 @@ private:
                       featureset_ptr features,
                       proj_transform const& prj_trans);
 
+    /*!
+     * \brief renders features of a streamed featureset matched by the given style.
+     */
+    void render_matched(Processor & p,
+                        feature_type_style const* style,
+                        detail::matched_features const& matches,
+                        proj_transform const& prj_trans);
+
     /*!
      * \brief prepare features for rendering asynchronously.
      */
@@ -112,7 +139,16 @@ private:
      */
     void render_material(layer_rendering_material const & mat, Processor & p );
 
+    /*!
+     * \brief prepare a list of layers on a pool of worker threads.
+     */
+    void prepare_layers_concurrently(std::vector<layer_rendering_material> & mat_list,
+                                     feature_style_context_map & ctx_map,
+                                     Processor & p,
+                                     double scale_denom);
+
     Map const& m_;
+    unsigned query_concurrency_;
 };
 }
 
@@ -39,16 +39,22 @@
 #include <mapnik/rule_cache.hpp>
 #include <mapnik/attribute_collector.hpp>
 #include <mapnik/expression_evaluator.hpp>
+#include <mapnik/expression_program.hpp>
 #include <mapnik/scale_denominator.hpp>
 #include <mapnik/projection.hpp>
 #include <mapnik/proj_transform.hpp>
 #include <mapnik/util/featureset_buffer.hpp>
+#include <mapnik/util/parallel_for.hpp>
 #include <mapnik/util/variant.hpp>
 #include <mapnik/symbolizer_dispatch.hpp>
 
 // stl
+#include <deque>
 #include <vector>
 #include <stdexcept>
+#ifdef MAPNIK_THREADSAFE
+#include <algorithm>
+#endif
 
 namespace mapnik
 {
@@ -73,9 +79,153 @@ struct layer_rendering_material
     layer_rendering_material(layer_rendering_material && rhs) = default;
 };
 
+namespace detail {
+
+// Evaluation state of the if-rule filters of a rule_cache
+struct filter_state
+{
+    explicit filter_state(rule_cache const& rc)
+        : bindings(rc.get_if_rules().size()),
+          index_attribute(rc.filter_index_attribute()) {}
+
+    std::vector<expression_program::binding> bindings;
+    resolved_attribute index_attribute;
+};
+
+// Calls f(rule) for every rule of the style applying to the feature
+template <typename F>
+void match_rules(feature_type_style const* style,
+                 rule_cache const& rc,
+                 filter_state & state,
+                 feature_impl const& feature,
+                 attributes const& vars,
+                 F && f)
+{
+    bool do_else = true;
+    bool do_also = false;
+    // returns true when no further if-rules need to be tested
+    auto test = [&](rule const* r, std::size_t index, bool matched)
+    {
+        if (matched || r->get_compiled_filter().evaluate(feature, vars, state.bindings[index]).to_bool())
+        {
+            do_else=false;
+            do_also=true;
+            f(*r);
+            if (style->get_filter_mode() == FILTER_FIRST)
+            {
+                // Stop iterating over rules and proceed with next feature.
+                do_also=false;
+                return true;
+            }
+        }
+        return false;
+    };
+    if (rc.has_filter_index())
+    {
+        if (!state.index_attribute.resolved_for(feature.get_context()))
+        {
+            state.index_attribute.resolve(feature.context());
+        }
+        for (auto const& candidate : rc.get_filter_candidates(feature.get(state.index_attribute)))
+        {
+            if (test(candidate.rule_, candidate.index, candidate.matched)) break;
+        }
+    }
+    else
+    {
+        std::size_t index = 0;
+        for (rule const* r : rc.get_if_rules() )
+        {
+            if (test(r, index++, false)) break;
+        }
+    }
+    if (do_else)
+    {
+        for( rule const* r : rc.get_else_rules() )
+        {
+            f(*r);
+        }
+    }
+    if (do_also)
+    {
+        for( rule const* r : rc.get_also_rules() )
+        {
+            f(*r);
+        }
+    }
+}
+
+// Features of a layer matched by one style together with the rules
+// to apply to them, filled while streaming a shared featureset. Every
+// matched feature is held until the style is rendered.
+class matched_features
+{
+public:
+    explicit matched_features(rule_cache const& rc)
+        : state_(rc) {}
+
+    void add(feature_type_style const* style,
+             rule_cache const& rc,
+             feature_ptr const& feature,
+             attributes const& vars)
+    {
+        std::size_t first = rules_.size();
+        match_rules(style, rc, state_, *feature, vars,
+                    [this](rule const& r) { rules_.push_back(&r); });
+        if (rules_.size() > first)
+        {
+            features_.push_back(feature);
+            offsets_.push_back(first);
+        }
+    }
+
+    std::size_t size() const { return features_.size(); }
+
+    feature_impl & feature(std::size_t i) const { return *features_[i]; }
+
+    // rules matched by feature i as a [begin, end) range
+    rule const* const* rules_begin(std::size_t i) const { return rules_.data() + offsets_[i]; }
+    rule const* const* rules_end(std::size_t i) const
+    {
+        return rules_.data() + ((i + 1 < offsets_.size()) ? offsets_[i + 1] : rules_.size());
+    }
+
+    void clear()
+    {
+        std::vector<feature_ptr>().swap(features_);
+        std::vector<std::size_t>().swap(offsets_);
+        std::vector<rule const*>().swap(rules_);
+    }
+
+private:
+    filter_state state_;
+    std::vector<feature_ptr> features_;
+    std::vector<std::size_t> offsets_;
+    std::vector<rule const*> rules_;
+};
+
+template <typename Processor>
+void process_rule(Processor & p,
+                  rule const& r,
+                  feature_impl & feature,
+                  proj_transform const& prj_trans)
+{
+    rule::symbolizers const& symbols = r.get_symbolizers();
+    if(!p.process(symbols,feature,prj_trans))
+    {
+        for (symbolizer const& sym : symbols)
+        {
+            util::apply_visitor(symbolizer_dispatch<Processor>(p,feature,prj_trans),sym);
+        }
+    }
+}
+
+} // namespace detail
+
 template <typename Processor>
 feature_style_processor<Processor>::feature_style_processor(Map const& m, double scale_factor)
-    : m_(m)
+    : m_(m),
+      query_concurrency_(1)
 {
     // https://github.com/mapnik/mapnik/issues/1100
     if (scale_factor <= 0)
@@ -107,28 +257,48 @@ void feature_style_processor<Processor>::apply(double scale_denom)
     // implementing asynchronous queries
     feature_style_context_map ctx_map;
 
-    for ( layer const& lyr : m_.layers() )
+    // projections lazily initialize proj4 state which must not be shared
+    // between threads, so every layer prepared concurrently gets its own copy
+    std::deque<projection> layer_projs;
+
+    if (query_concurrency_ > 1)
     {
-        if (lyr.visible(scale_denom))
+        for ( layer const& lyr : m_.layers() )
         {
-            std::set<std::string> names;
-            layer_rendering_material mat(lyr, proj);
-
-            prepare_layer(mat,
-                          ctx_map,
-                          p,
-                          m_.scale(),
-                          scale_denom,
-                          m_.width(),
-                          m_.height(),
-                          m_.get_current_extent(),
-                          m_.buffer_size(),
-                          names);
-
-            // Store active material
-            if (!mat.active_styles_.empty())
+            if (lyr.visible(scale_denom))
+            {
+                layer_projs.push_back(proj);
+                mat_list.emplace_back(lyr, layer_projs.back());
+            }
+        }
+        // layers without active styles are skipped when rendering below
+        prepare_layers_concurrently(mat_list, ctx_map, p, scale_denom);
+    }
+    else
+    {
+        for ( layer const& lyr : m_.layers() )
+        {
+            if (lyr.visible(scale_denom))
             {
-                mat_list.emplace_back(std::move(mat));
+                std::set<std::string> names;
+                layer_rendering_material mat(lyr, proj);
+
+                prepare_layer(mat,
+                              ctx_map,
+                              p,
+                              m_.scale(),
+                              scale_denom,
+                              m_.width(),
+                              m_.height(),
+                              m_.get_current_extent(),
+                              m_.buffer_size(),
+                              names);
+
+                // Store active material
+                if (!mat.active_styles_.empty())
+                {
+                    mat_list.emplace_back(std::move(mat));
+                }
             }
         }
     }
@@ -172,6 +342,84 @@ void feature_style_processor<Processor>::apply(mapnik::layer const& lyr,
     p.end_map_processing(m_);
 }
 
+template <typename Processor>
+void feature_style_processor<Processor>::prepare_layers_concurrently(std::vector<layer_rendering_material> & mat_list,
+                                                                     feature_style_context_map & ctx_map,
+                                                                     Processor & p,
+                                                                     double scale_denom)
+{
+#ifdef MAPNIK_THREADSAFE
+    // Datasources returning a processor context already issue their queries
+    // asynchronously and share state through ctx_map, so they are prepared
+    // on one thread in order. Everything else is handed out to the workers.
+    std::vector<layer_rendering_material*> serial;
+    std::vector<layer_rendering_material*> concurrent;
+    for (layer_rendering_material & mat : mat_list)
+    {
+        datasource_ptr ds = mat.lay_.datasource();
+        if (ds && ds->get_context(ctx_map))
+        {
+            serial.push_back(&mat);
+        }
+        else
+        {
+            concurrent.push_back(&mat);
+        }
+    }
+
+    auto prepare = [&](layer_rendering_material & mat, feature_style_context_map & layer_ctx_map)
+    {
+        std::set<std::string> names;
+        prepare_layer(mat,
+                      layer_ctx_map,
+                      p,
+                      m_.scale(),
+                      scale_denom,
+                      m_.width(),
+                      m_.height(),
+                      m_.get_current_extent(),
+                      m_.buffer_size(),
+                      names);
+    };
+
+    // item 0 prepares the serial layers in order, every other item one of
+    // the concurrent layers
+    std::size_t first = serial.empty() ? 1 : 0;
+    util::parallel_for(concurrent.size() + 1 - first, query_concurrency_, [&](std::size_t item)
+    {
+        item += first;
+        if (item == 0)
+        {
+            for (layer_rendering_material * mat : serial)
+            {
+                prepare(*mat, ctx_map);
+            }
+        }
+        else
+        {
+            // never used by datasources without a processor context
+            feature_style_context_map local_ctx_map;
+            prepare(*concurrent[item - 1], local_ctx_map);
+        }
+    });
+#else
+    for (layer_rendering_material & mat : mat_list)
+    {
+        std::set<std::string> names;
+        prepare_layer(mat,
+                      ctx_map,
+                      p,
+                      m_.scale(),
+                      scale_denom,
+                      m_.width(),
+                      m_.height(),
+                      m_.get_current_extent(),
+                      m_.buffer_size(),
+                      names);
+    }
+#endif
+}
+
 /*!
  * \brief render a layer given a projection and scale.
  */
@@ -382,6 +630,7 @@ void feature_style_processor<Processor>::prepare_layer(layer_rendering_material
         }
         if (active_rules)
         {
+            rc.build_filter_index();
             rule_caches.push_back(std::move(rc));
             active_styles.push_back(&(*style));
         }
@@ -426,9 +675,10 @@ void feature_style_processor<Processor>::prepare_layer(layer_rendering_material
     }
 
     bool cache_features = lay.cache_features() && active_styles.size() > 1;
+    bool stream_features = lay.stream_features() && active_styles.size() > 1;
 
     std::vector<featureset_ptr> & featureset_ptr_list = mat.featureset_ptr_list_;
-    if (!group_by.empty() || cache_features)
+    if (!group_by.empty() || cache_features || stream_features)
     {
         featureset_ptr_list.push_back(ds->features_with_context(q,current_ctx));
     }
@@ -469,6 +719,7 @@ void feature_style_processor<Processor>::render_material(layer_rendering_materia
     proj_transform prj_trans(mat.proj0_,mat.proj1_);
 
     bool cache_features = lay.cache_features() && active_styles.size() > 1;
+    bool stream_features = lay.stream_features() && active_styles.size() > 1;
 
     datasource_ptr ds = lay.datasource();
     std::string group_by = lay.group_by();
@@ -482,10 +733,15 @@ void feature_style_processor<Processor>::render_material(layer_rendering_materia
             // Cache all features into the memory_datasource before rendering.
             std::shared_ptr<featureset_buffer> cache = std::make_shared<featureset_buffer>();
             feature_ptr feature, prev;
+            resolved_attribute group_attr(group_by);
 
             while ((feature = features->next()))
             {
-                if (prev && prev->get(group_by) != feature->get(group_by))
+                if (!group_attr.resolved_for(feature->get_context()))
+                {
+                    group_attr.resolve(feature->context());
+                }
+                if (prev && prev->get(group_attr) != feature->get(group_attr))
                 {
                     // We're at a value boundary, so render what we have
                     // up to this point.
@@ -540,6 +796,51 @@ void feature_style_processor<Processor>::render_material(layer_rendering_materia
             ++i;
         }
     }
+    else if (stream_features)
+    {
+        // Read every feature once. The first style draws the features as
+        // they are read; each later style keeps the features it draws,
+        // together with the matching rules, until its turn comes. This
+        // buffers only what the later styles match, which is the whole
+        // layer when one of them matches every feature.
+        std::vector<detail::matched_features> matches;
+        matches.reserve(active_styles.size() - 1);
+        for (std::size_t i = 1; i < rule_caches.size(); ++i)
+        {
+            matches.emplace_back(rule_caches[i]);
+        }
+        feature_type_style const* first_style = active_styles.front();
+        rule_cache const& first_rc = rule_caches.front();
+        p.start_style_processing(*first_style);
+        featureset_ptr features = *featureset_ptr_list.begin();
+        if (features)
+        {
+            mapnik::attributes vars = p.variables();
+            detail::filter_state state(first_rc);
+            bool was_painted = false;
+            feature_ptr feature;
+            while ((feature = features->next()))
+            {
+                detail::match_rules(first_style, first_rc, state, *feature, vars,
+                                    [&](rule const& r)
+                                    {
+                                        was_painted = true;
+                                        detail::process_rule(p, r, *feature, prj_trans);
+                                    });
+                for (std::size_t i = 1; i < active_styles.size(); ++i)
+                {
+                    matches[i - 1].add(active_styles[i], rule_caches[i], feature, vars);
+                }
+            }
+            p.painted(p.painted() | was_painted);
+        }
+        p.end_style_processing(*first_style);
+        for (std::size_t i = 1; i < active_styles.size(); ++i)
+        {
+            render_matched(p, active_styles[i], matches[i - 1], prj_trans);
+            matches[i - 1].clear();
+        }
+    }
     // We only have a single style and no grouping.
     else
     {
@@ -573,69 +874,40 @@ void feature_style_processor<Processor>::render_style(
         return;
     }
     mapnik::attributes vars = p.variables();
+    detail::filter_state state(rc);
     feature_ptr feature;
     bool was_painted = false;
     while ((feature = features->next()))
     {
-        bool do_else = true;
-        bool do_also = false;
-        for (rule const* r : rc.get_if_rules() )
-        {
-            expression_ptr const& expr = r->get_filter();
-            value_type result = util::apply_visitor(evaluate<feature_impl,value_type,attributes>(*feature,vars),*expr);
-            if (result.to_bool())
-            {
-                was_painted = true;
-                do_else=false;
-                do_also=true;
-                rule::symbolizers const& symbols = r->get_symbolizers();
-                if(!p.process(symbols,*feature,prj_trans))
-                {
-                    for (symbolizer const& sym : symbols)
-                    {
-                        util::apply_visitor(symbolizer_dispatch<Processor>(p,*feature,prj_trans),sym);
-                    }
-                }
-                if (style->get_filter_mode() == FILTER_FIRST)
-                {
-                    // Stop iterating over rules and proceed with next feature.
-                    do_also=false;
-                    break;
-                }
-            }
-        }
-        if (do_else)
-        {
-            for( rule const* r : rc.get_else_rules() )
-            {
-                was_painted = true;
-                rule::symbolizers const& symbols = r->get_symbolizers();
-                if(!p.process(symbols,*feature,prj_trans))
-                {
-                    for (symbolizer const& sym : symbols)
-                    {
-                        util::apply_visitor(symbolizer_dispatch<Processor>(p,*feature,prj_trans),sym);
-                    }
-                }
-            }
-        }
-        if (do_also)
+        detail::match_rules(style, rc, state, *feature, vars,
+                            [&](rule const& r)
+                            {
+                                was_painted = true;
+                                detail::process_rule(p, r, *feature, prj_trans);
+                            });
+    }
+    p.painted(p.painted() | was_painted);
+    p.end_style_processing(*style);
+}
+
+template <typename Processor>
+void feature_style_processor<Processor>::render_matched(
+    Processor & p,
+    feature_type_style const* style,
+    detail::matched_features const& matches,
+    proj_transform const& prj_trans)
+{
+    p.start_style_processing(*style);
+    std::size_t size = matches.size();
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        feature_impl & feature = matches.feature(i);
+        for (auto itr = matches.rules_begin(i), end = matches.rules_end(i); itr != end; ++itr)
         {
-            for( rule const* r : rc.get_also_rules() )
-            {
-                was_painted = true;
-                rule::symbolizers const& symbols = r->get_symbolizers();
-                if(!p.process(symbols,*feature,prj_trans))
-                {
-                    for (symbolizer const& sym : symbols)
-                    {
-                        util::apply_visitor(symbolizer_dispatch<Processor>(p,*feature,prj_trans),sym);
-                    }
-                }
-            }
+            detail::process_rule(p, **itr, feature, prj_trans);
         }
     }
-    p.painted(p.painted() | was_painted);
+    p.painted(p.painted() | (size > 0));
     p.end_style_processing(*style);
 }
 
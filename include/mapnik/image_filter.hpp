@@ -25,6 +25,7 @@
 #define MAPNIK_IMAGE_FILTER_HPP
 
 //mapnik
+#include <mapnik/config.hpp>
 #include <mapnik/image_filter_types.hpp>
 #include <mapnik/image_util.hpp>
 #include <mapnik/util/hsl.hpp>
@@ -47,6 +48,8 @@
 
 // stl
 #include <cmath>
+#include <cstdint>
+#include <vector>
 
 // 8-bit YUV
 //Y = ( (  66 * R + 129 * G +  25 * B + 128) >> 8) +  16
@@ -123,12 +126,46 @@
 //convolve_rows_fixed<rgba32f_pixel_t>(src_view,kernel,src_view);
 // convolve_cols_fixed<rgba32f_pixel_t>(src_view,kernel,dst_view);
 
-namespace mapnik {  namespace filter { namespace detail {
+namespace mapnik {  namespace filter {
 
-static const float blur_matrix[] = {0.1111f,0.1111f,0.1111f,0.1111f,0.1111f,0.1111f,0.1111f,0.1111f,0.1111f};
-static const float emboss_matrix[] = {-2,-1,0,-1,1,1,0,1,2};
-static const float sharpen_matrix[] = {0,-1,0,-1,5,-1,0,-1,0 };
-static const float edge_detect_matrix[] = {0,1,0,1,-4,1,0,1,0 };
+// Number of threads the convolution and stack blur filters split images of
+// a megapixel or more across. 1, the default, filters on the calling
+// thread, which is what renders that already run in parallel want; 0 uses
+// every core.
+MAPNIK_DECL void set_filter_threads(unsigned threads);
+MAPNIK_DECL unsigned get_filter_threads();
+
+namespace detail {
+
+enum class kernel_3x3
+{
+    blur,
+    emboss,
+    sharpen,
+    edge_detect,
+    sobel
+};
+
+// Applies `kernel` to the colour channels of the rgba8 pixels in `src`,
+// writing them to `dst` of the same layout, and copies alpha. Columns are
+// clamped at the left and right edges, rows are mirrored at the top and
+// bottom. Large images are split into bands of rows, filtered on
+// get_filter_threads() threads.
+MAPNIK_DECL void convolve_3x3(std::uint8_t const* src, std::uint8_t * dst,
+                              std::size_t width, std::size_t height, std::size_t row_size,
+                              kernel_3x3 kernel);
+
+// Same result as agg::stack_blur_rgba32, with the vertical pass run over
+// blocks of columns and both passes split across get_filter_threads()
+// threads for large images.
+MAPNIK_DECL void stack_blur_rgba8(std::uint8_t * data, std::size_t width, std::size_t height,
+                                  std::size_t row_size, unsigned rx, unsigned ry);
+
+inline kernel_3x3 kernel_of(blur const&) { return kernel_3x3::blur; }
+inline kernel_3x3 kernel_of(emboss const&) { return kernel_3x3::emboss; }
+inline kernel_3x3 kernel_of(sharpen const&) { return kernel_3x3::sharpen; }
+inline kernel_3x3 kernel_of(edge_detect const&) { return kernel_3x3::edge_detect; }
+inline kernel_3x3 kernel_of(sobel const&) { return kernel_3x3::sobel; }
 
 }
 
@@ -163,247 +200,22 @@ struct double_buffer
     }
 };
 
-template <typename Src, typename Dst, typename Conv>
-void process_channel_impl (Src const& src, Dst & dst, Conv const& k)
-{
-    using boost::gil::bits32f;
-
-    bits32f out_value =
-        k[0]*src[0] + k[1]*src[1] + k[2]*src[2] +
-        k[3]*src[3] + k[4]*src[4] + k[5]*src[5] +
-        k[6]*src[6] + k[7]*src[7] + k[8]*src[8]
-        ;
-    if (out_value < 0) out_value = 0;
-    if (out_value > 255) out_value = 255;
-    dst = out_value;
-}
-
-template <typename Src, typename Dst, typename Conv>
-void process_channel (Src const&, Dst &, Conv const&)
-{
-}
-
-template <typename Src, typename Dst>
-void process_channel (Src const& src, Dst & dst, mapnik::filter::blur)
-{
-    process_channel_impl(src,dst,mapnik::filter::detail::blur_matrix);
-}
-
-template <typename Src, typename Dst>
-void process_channel (Src const& src, Dst & dst, mapnik::filter::emboss)
-{
-    process_channel_impl(src,dst,mapnik::filter::detail::emboss_matrix);
-}
-
-template <typename Src, typename Dst>
-void process_channel (Src const& src, Dst & dst, mapnik::filter::sharpen)
-{
-    process_channel_impl(src,dst,mapnik::filter::detail::sharpen_matrix);
-}
-
-template <typename Src, typename Dst>
-void process_channel (Src const& src, Dst & dst, mapnik::filter::edge_detect)
-{
-    process_channel_impl(src,dst,mapnik::filter::detail::edge_detect_matrix);
-}
-
-
-template <typename Src, typename Dst>
-void process_channel (Src const& src, Dst & dst, mapnik::filter::sobel)
-{
-    using boost::gil::bits32f;
-
-    bits32f x_gradient = (src[2] + 2*src[5] + src[8])
-        - (src[0] + 2*src[3] + src[6]);
-
-    bits32f y_gradient = (src[0] + 2*src[1] + src[2])
-        - (src[6] + 2*src[7] + src[8]);
-
-    bits32f  out_value  = std::sqrt(std::pow(x_gradient,2) + std::pow(y_gradient,2));
-    //bts32f theta = std::atan2(x_gradient,y_gradient);
-    if (out_value < 0) out_value = 0;
-    if (out_value > 255) out_value = 255;
-    dst = out_value;
-}
-
-
-
-template <typename Src, typename Dst, typename Filter>
-void apply_convolution_3x3(Src const& src_view, Dst & dst_view, Filter const& filter)
-{
-    using boost::gil::bits32f;
-    using boost::gil::point2;
-
-    // p0 p1 p2
-    // p3 p4 p5
-    // p6 p7 p8
-
-    typename Src::xy_locator src_loc = src_view.xy_at(0,0);
-    typename Src::xy_locator::cached_location_t loc00 = src_loc.cache_location(-1,-1);
-    typename Src::xy_locator::cached_location_t loc10 = src_loc.cache_location( 0,-1);
-    typename Src::xy_locator::cached_location_t loc20 = src_loc.cache_location( 1,-1);
-    typename Src::xy_locator::cached_location_t loc01 = src_loc.cache_location(-1, 0);
-    typename Src::xy_locator::cached_location_t loc11 = src_loc.cache_location( 0, 0);
-    typename Src::xy_locator::cached_location_t loc21 = src_loc.cache_location( 1, 0);
-    typename Src::xy_locator::cached_location_t loc02 = src_loc.cache_location(-1, 1);
-    typename Src::xy_locator::cached_location_t loc12 = src_loc.cache_location( 0, 1);
-    typename Src::xy_locator::cached_location_t loc22 = src_loc.cache_location( 1, 1);
-
-    typename Src::x_iterator dst_it = dst_view.row_begin(0);
-
-    // top row
-    for (std::ptrdiff_t x = 0 ; x < src_view.width(); ++x)
-    {
-        (*dst_it)[3] = src_loc[loc11][3]; // Dst.a = Src.a
-        for (std::ptrdiff_t i = 0; i < 3; ++i)
-        {
-            bits32f p[9];
-
-            p[4] = src_loc[loc11][i];
-            p[7] = src_loc[loc12][i];
-
-            if (x == 0)
-            {
-                p[3] = p[4];
-                p[6] = p[7];
-            }
-            else
-            {
-                p[3] = src_loc[loc01][i];
-                p[6] = src_loc[loc02][i];
-            }
-
-            if ( x == (src_view.width())-1)
-            {
-                p[5] = p[4];
-                p[8] = p[7];
-            }
-            else
-            {
-                p[5] = src_loc[loc21][i];
-                p[8] = src_loc[loc22][i];
-            }
-
-            p[0] = p[6];
-            p[1] = p[7];
-            p[2] = p[8];
-
-            process_channel(p, (*dst_it)[i], filter);
-        }
-        ++src_loc.x();
-        ++dst_it;
-    }
-    // carrige-return
-    src_loc += point2<std::ptrdiff_t>(-src_view.width(),1);
-
-    // 1... height-1 rows
-    for (std::ptrdiff_t y = 1; y < src_view.height()-1; ++y)
-    {
-        for (std::ptrdiff_t x = 0; x < src_view.width(); ++x)
-        {
-            (*dst_it)[3] = src_loc[loc11][3]; // Dst.a = Src.a
-            for (std::ptrdiff_t i = 0; i < 3; ++i)
-            {
-                bits32f p[9];
-
-                p[1] = src_loc[loc10][i];
-                p[4] = src_loc[loc11][i];
-                p[7] = src_loc[loc12][i];
-
-                if (x == 0)
-                {
-                    p[0] = p[1];
-                    p[3] = p[4];
-                    p[6] = p[7];
-                }
-                else
-                {
-                    p[0] = src_loc[loc00][i];
-                    p[3] = src_loc[loc01][i];
-                    p[6] = src_loc[loc02][i];
-                }
-
-                if ( x == (src_view.width()) - 1)
-                {
-                    p[2] = p[1];
-                    p[5] = p[4];
-                    p[8] = p[7];
-                }
-                else
-                {
-                    p[2] = src_loc[loc20][i];
-                    p[5] = src_loc[loc21][i];
-                    p[8] = src_loc[loc22][i];
-                }
-                process_channel(p, (*dst_it)[i], filter);
-            }
-            ++dst_it;
-            ++src_loc.x();
-        }
-        // carrige-return
-        src_loc += point2<std::ptrdiff_t>(-src_view.width(),1);
-    }
-
-    // bottom row
-    //src_loc = src_view.xy_at(0,src_view.height()-1);
-    for (std::ptrdiff_t x = 0 ; x < src_view.width(); ++x)
-    {
-        (*dst_it)[3] = src_loc[loc11][3]; // Dst.a = Src.a
-        for (std::ptrdiff_t i = 0; i < 3; ++i)
-        {
-            bits32f p[9];
-
-            p[1] = src_loc[loc10][i];
-            p[4] = src_loc[loc11][i];
-
-            if (x == 0)
-            {
-                p[0] = p[1];
-                p[3] = p[4];
-            }
-            else
-            {
-                p[0] = src_loc[loc00][i];
-                p[3] = src_loc[loc01][i];
-            }
-
-            if ( x == (src_view.width())-1)
-            {
-                p[2] = p[1];
-                p[5] = p[4];
-
-            }
-            else
-            {
-                p[2] = src_loc[loc20][i];
-                p[5] = src_loc[loc21][i];
-            }
-
-            p[6] = p[0];
-            p[7] = p[1];
-            p[8] = p[2];
-            process_channel(p, (*dst_it)[i], filter);
-        }
-        ++src_loc.x();
-        ++dst_it;
-    }
-}
-
+// blur, emboss, sharpen, edge_detect and sobel
 template <typename Src, typename Filter>
 void apply_filter(Src & src, Filter const& filter, double /*scale_factor*/)
 {
     demultiply_alpha(src);
-    double_buffer<Src> tb(src);
-    apply_convolution_3x3(tb.src_view, tb.dst_view, filter);
+    std::vector<std::uint8_t> copy(src.bytes(), src.bytes() + src.row_size() * src.height());
+    detail::convolve_3x3(copy.data(), src.bytes(), src.width(), src.height(), src.row_size(),
+                         detail::kernel_of(filter));
 }
 
 template <typename Src>
 void apply_filter(Src & src, agg_stack_blur const& op, double scale_factor)
 {
     premultiply_alpha(src);
-    agg::rendering_buffer buf(src.bytes(),src.width(),src.height(), src.row_size());
-    agg::pixfmt_rgba32_pre pixf(buf);
-    agg::stack_blur_rgba32(pixf, op.rx * scale_factor, op.ry * scale_factor);
+    detail::stack_blur_rgba8(src.bytes(), src.width(), src.height(), src.row_size(),
+                             op.rx * scale_factor, op.ry * scale_factor);
 }
 
 inline double channel_delta(double source, double match)
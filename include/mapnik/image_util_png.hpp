@@ -23,11 +23,13 @@
 #ifndef MAPNIK_IMAGE_UTIL_PNG_HPP
 #define MAPNIK_IMAGE_UTIL_PNG_HPP
 
+#include <mapnik/config.hpp>
 #include <mapnik/palette.hpp>
 
 // stl
 #include <string>
 #include <iostream>
+#include <memory>
 
 namespace mapnik {
 
@@ -52,6 +54,18 @@ struct png_saver
     std::string const& t_;
 };
 
+class band_writer;
+struct png_options;
+
+// parses a png format string such as "png8:m=o:fast" into opts
+MAPNIK_DECL void handle_png_options(std::string const& type,
+                                    png_options & opts);
+
+std::unique_ptr<band_writer> create_png_band_writer(std::ostream & stream,
+                                                    std::string const& t,
+                                                    unsigned width,
+                                                    unsigned height);
+
 } // end ns
 
 #endif // MAPNIK_IMAGE_UTIL_PNG_HPP
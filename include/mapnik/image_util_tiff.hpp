@@ -26,6 +26,7 @@
 // stl
 #include <string>
 #include <iostream>
+#include <memory>
 
 namespace mapnik {
 
@@ -39,6 +40,13 @@ struct tiff_saver
     std::string const& t_;
 };
 
+class band_writer;
+
+std::unique_ptr<band_writer> create_tiff_band_writer(std::ostream & stream,
+                                                     std::string const& t,
+                                                     unsigned width,
+                                                     unsigned height);
+
 } // end ns
 
 #endif // MAPNIK_IMAGE_UTIL_TIFF_HPP
@@ -24,16 +24,25 @@
 #define MAPNIK_LABEL_COLLISION_DETECTOR_HPP
 
 // mapnik
+#include <mapnik/label_placement_store.hpp>
 #include <mapnik/quad_tree.hpp>
+#include <mapnik/view_transform.hpp>
 #include <mapnik/util/noncopyable.hpp>
 #include <mapnik/value/types.hpp>
 
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
 #include <unicode/unistr.h>
+#include <boost/optional.hpp>
 #pragma GCC diagnostic pop
 
 // stl
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace mapnik
@@ -127,40 +136,85 @@ public:
 };
 
 
-//quad tree based label collision detector so labels dont appear within a given distance
+// label collision detector so labels dont appear within a given distance.
+// Labels are kept in one vector and indexed by a uniform grid over the
+// extent, and their texts are interned so repeat checks compare ids.
+// Iterating yields the labels the way the former quad tree based detector
+// did, so label.get().box keeps working next to label.box.
 class label_collision_detector4 : util::noncopyable
 {
 public:
     struct label
     {
-        label(box2d<double> const& b) : box(b), text() {}
-        label(box2d<double> const& b, mapnik::value_unicode_string const& t) : box(b), text(t) {}
+        label(box2d<double> const& b) : box(b), text(), text_id(0), carried(false) {}
+        label(box2d<double> const& b, mapnik::value_unicode_string const& t) : box(b), text(t), text_id(0), carried(false) {}
+        label(box2d<double> const& b, mapnik::value_unicode_string const& t, bool c) : box(b), text(t), text_id(0), carried(c) {}
+
+        // iterators used to hold std::reference_wrapper<label>
+        label const& get() const { return *this; }
 
         box2d<double> box;
         mapnik::value_unicode_string text;
+        // set by the detector, repeat checks compare it instead of text
+        std::uint32_t text_id;
+        // placed by a neighbouring render, see insert_carried()
+        bool carried;
     };
 
-private:
-    using tree_t = quad_tree< label >;
-    tree_t tree_;
-
-public:
-    using query_iterator = tree_t::query_iterator;
+    using const_iterator = std::vector<label>::const_iterator;
+    using query_iterator = const_iterator;
 
     explicit label_collision_detector4(box2d<double> const& _extent)
-        : tree_(_extent) {}
-
-    bool has_placement(box2d<double> const& box)
+        : extent_(_extent),
+          cols_(1),
+          rows_(1),
+          cell_width_(1.0),
+          cell_height_(1.0),
+          labels_(),
+          stamps_(),
+          stamp_(0),
+          cells_(),
+          used_cells_(),
+          oversized_(),
+          text_ids_(),
+          candidates_(),
+          store_(),
+          tr_(),
+          seeded_()
     {
-        tree_t::query_iterator tree_itr = tree_.query_in_box(box);
-        tree_t::query_iterator tree_end = tree_.query_end();
-
-        for ( ;tree_itr != tree_end; ++tree_itr)
+        // cells of at least 64px, at most 256 of them each way
+        double width = extent_.width();
+        double height = extent_.height();
+        if (width > 0 && height > 0)
         {
-            if (tree_itr->get().box.intersects(box)) return false;
+            cell_width_ = std::max(64.0, width / 256);
+            cell_height_ = std::max(64.0, height / 256);
+            cols_ = static_cast<int>(std::ceil(width / cell_width_));
+            rows_ = static_cast<int>(std::ceil(height / cell_height_));
         }
+        cells_.resize(cols_ * rows_);
+        // id 0 is the empty text
+        text_ids_.emplace(mapnik::value_unicode_string(), 0);
+    }
 
-        return true;
+    // Starts out with the labels of `store` around the render at `tr` as
+    // carried labels, and adds the labels it places to `store`.
+    label_collision_detector4(box2d<double> const& _extent,
+                              std::shared_ptr<label_placement_store> store,
+                              view_transform const& tr)
+        : label_collision_detector4(_extent)
+    {
+        store_ = std::move(store);
+        tr_ = tr;
+        load_seeded();
+        seed();
+    }
+
+    bool has_placement(box2d<double> const& box)
+    {
+        return !any_of(box, [&](label const& lbl) {
+                return lbl.box.intersects(box) && !continues(lbl, box);
+            });
     }
 
     bool has_placement(box2d<double> const& box, double margin)
@@ -170,17 +224,9 @@ public:
                                                                box.maxx() + margin, box.maxy() + margin)
                                                : box);
 
-        tree_t::query_iterator tree_itr = tree_.query_in_box(margin_box);
-        tree_t::query_iterator tree_end = tree_.query_end();
-
-        for (;tree_itr != tree_end; ++tree_itr)
-        {
-            if (tree_itr->get().box.intersects(margin_box))
-            {
-                return false;
-            }
-        }
-        return true;
+        return !any_of(margin_box, [&](label const& lbl) {
+                return lbl.box.intersects(margin_box) && !continues(lbl, box);
+            });
     }
 
     bool has_placement(box2d<double> const& box, double margin, mapnik::value_unicode_string const& text, double repeat_distance)
@@ -189,57 +235,334 @@ public:
         if (repeat_distance <= margin) {
             return has_placement(box, margin);
         }
+        return repeat_free(box, margin, find_text(text), repeat_distance);
+    }
 
-        box2d<double> repeat_box(box.minx() - repeat_distance, box.miny() - repeat_distance,
-                                 box.maxx() + repeat_distance, box.maxy() + repeat_distance);
+    // has_placement(box, margin) for all boxes of a placement at once
+    bool has_placements(std::vector<box2d<double>> const& boxes, double margin)
+    {
+        return all_free(boxes, margin, 0, margin);
+    }
 
-        box2d<double> const& margin_box = (margin > 0
-                                               ? box2d<double>(box.minx() - margin, box.miny() - margin,
-                                                               box.maxx() + margin, box.maxy() + margin)
-                                               : box);
+    // has_placement(box, margin, text, repeat_distance) for all boxes of a
+    // placement at once; the labels around them are gathered in one pass
+    bool has_placements(std::vector<box2d<double>> const& boxes, double margin,
+                        mapnik::value_unicode_string const& text, double repeat_distance)
+    {
+        return all_free(boxes, margin, find_text(text), repeat_distance);
+    }
+
+    void insert(box2d<double> const& box)
+    {
+        if (extent_.intersects(box))
+        {
+            publish(box, mapnik::value_unicode_string());
+            add(label(box));
+        }
+    }
 
-        tree_t::query_iterator tree_itr = tree_.query_in_box(repeat_box);
-        tree_t::query_iterator tree_end = tree_.query_end();
+    void insert(box2d<double> const& box, mapnik::value_unicode_string const& text)
+    {
+        if (extent_.intersects(box))
+        {
+            publish(box, text);
+            add(label(box, text));
+        }
+    }
 
-        for ( ;tree_itr != tree_end; ++tree_itr)
+    // Inserts a label placed by a neighbouring render, e.g. the band above
+    // when rendering in bands, shifted into this detector's coordinates.
+    // It blocks other placements as usual, but an identical placement is
+    // the same label continuing across the seam and is let through.
+    void insert_carried(box2d<double> const& box, mapnik::value_unicode_string const& text)
+    {
+        if (extent_.intersects(box))
         {
-            if (tree_itr->get().box.intersects(margin_box) || (text == tree_itr->get().text && tree_itr->get().box.intersects(repeat_box)))
-            {
-                return false;
-            }
+            add(label(box, text, true));
+        }
+    }
+
+    void clear()
+    {
+        labels_.clear();
+        stamps_.clear();
+        stamp_ = 0;
+        for (int cell : used_cells_)
+        {
+            cells_[cell].clear();
+        }
+        used_cells_.clear();
+        oversized_.clear();
+        text_ids_.clear();
+        text_ids_.emplace(mapnik::value_unicode_string(), 0);
+        seed();
+    }
+
+    // Clears the detector for the render at `tr`. A detector with a store
+    // is seeded again with the stored labels around that render, and the
+    // labels it places from now on are stored at their new map coordinates.
+    void reset(view_transform const& tr)
+    {
+        tr_ = tr;
+        if (store_) load_seeded();
+        clear();
+    }
+
+    box2d<double> const& extent() const
+    {
+        return extent_;
+    }
+
+    // store shared with neighbouring renders, null if there is none
+    std::shared_ptr<label_placement_store> const& store() const
+    {
+        return store_;
+    }
+
+    const_iterator begin() const { return labels_.begin(); }
+    const_iterator end() const { return labels_.end(); }
+
+private:
+    struct text_hash
+    {
+        std::size_t operator()(mapnik::value_unicode_string const& text) const
+        {
+            return static_cast<std::size_t>(text.hashCode());
         }
+    };
+
+    // labels spanning more cells are checked by every query
+    static constexpr int max_label_cells = 64;
+    static constexpr std::uint32_t no_text = std::numeric_limits<std::uint32_t>::max();
+
+    static bool continues(label const& lbl, box2d<double> const& box)
+    {
+        // placements are recomputed from the same geometry, allow for
+        // rounding in the band transforms
+        constexpr double eps = 1e-3;
+        return lbl.carried
+            && std::abs(lbl.box.minx() - box.minx()) < eps
+            && std::abs(lbl.box.miny() - box.miny()) < eps
+            && std::abs(lbl.box.maxx() - box.maxx()) < eps
+            && std::abs(lbl.box.maxy() - box.maxy()) < eps;
+    }
+
+    std::uint32_t intern(mapnik::value_unicode_string const& text)
+    {
+        return text_ids_.emplace(text, static_cast<std::uint32_t>(text_ids_.size())).first->second;
+    }
+
+    std::uint32_t find_text(mapnik::value_unicode_string const& text) const
+    {
+        auto itr = text_ids_.find(text);
+        return (itr != text_ids_.end()) ? itr->second : no_text;
+    }
 
+    // cells covered by a box, clamped to the grid; false for boxes with
+    // NaNs or inverted corners
+    bool cell_range(box2d<double> const& box, int & c0, int & r0, int & c1, int & r1) const
+    {
+        if (!(box.minx() <= box.maxx() && box.miny() <= box.maxy())) return false;
+        auto clamp = [](double v, int n) {
+            return static_cast<int>(std::min(std::max(v, 0.0), static_cast<double>(n - 1)));
+        };
+        c0 = clamp(std::floor((box.minx() - extent_.minx()) / cell_width_), cols_);
+        c1 = clamp(std::floor((box.maxx() - extent_.minx()) / cell_width_), cols_);
+        r0 = clamp(std::floor((box.miny() - extent_.miny()) / cell_height_), rows_);
+        r1 = clamp(std::floor((box.maxy() - extent_.miny()) / cell_height_), rows_);
         return true;
     }
 
-    void insert(box2d<double> const& box)
+    void load_seeded()
     {
-        if (tree_.extent().intersects(box))
+        seeded_.clear();
+        for (placed_label & lbl : store_->query(tr_->backward(extent_)))
         {
-            tree_.insert(label(box), box);
+            lbl.box = tr_->forward(lbl.box);
+            seeded_.push_back(std::move(lbl));
         }
     }
 
-    void insert(box2d<double> const& box, mapnik::value_unicode_string const& text)
+    void seed()
     {
-        if (tree_.extent().intersects(box))
+        for (placed_label const& lbl : seeded_)
         {
-            tree_.insert(label(box, text), box);
+            insert_carried(lbl.box, lbl.text);
         }
     }
 
-    void clear()
+    void publish(box2d<double> const& box, mapnik::value_unicode_string const& text)
     {
-        tree_.clear();
+        if (store_)
+        {
+            store_->insert(tr_->backward(box), text);
+        }
     }
 
-    box2d<double> const& extent() const
+    void add(label && lbl)
+    {
+        if (!extent_.intersects(lbl.box)) return;
+        lbl.text_id = intern(lbl.text);
+        std::uint32_t index = static_cast<std::uint32_t>(labels_.size());
+        int c0, r0, c1, r1;
+        if (cell_range(lbl.box, c0, r0, c1, r1) && (c1 - c0 + 1) * (r1 - r0 + 1) <= max_label_cells)
+        {
+            for (int r = r0; r <= r1; ++r)
+            {
+                for (int c = c0; c <= c1; ++c)
+                {
+                    int cell = r * cols_ + c;
+                    if (cells_[cell].empty()) used_cells_.push_back(cell);
+                    cells_[cell].push_back(index);
+                }
+            }
+        }
+        else
+        {
+            oversized_.push_back(index);
+        }
+        labels_.push_back(std::move(lbl));
+        stamps_.push_back(0);
+    }
+
+    // Calls visit once for every label that may intersect query, until it
+    // returns true. Like the quad tree this replaces, nothing is found for
+    // queries outside the extent.
+    template <typename F>
+    bool any_of(box2d<double> const& query, F && visit)
+    {
+        if (!extent_.intersects(query)) return false;
+        int c0, r0, c1, r1;
+        if (!cell_range(query, c0, r0, c1, r1))
+        {
+            for (label const& lbl : labels_)
+            {
+                if (visit(lbl)) return true;
+            }
+            return false;
+        }
+        if (++stamp_ == 0)
+        {
+            std::fill(stamps_.begin(), stamps_.end(), 0);
+            stamp_ = 1;
+        }
+        for (std::uint32_t index : oversized_)
+        {
+            if (visit(labels_[index])) return true;
+        }
+        for (int r = r0; r <= r1; ++r)
+        {
+            for (int c = c0; c <= c1; ++c)
+            {
+                for (std::uint32_t index : cells_[r * cols_ + c])
+                {
+                    if (stamps_[index] == stamp_) continue;
+                    stamps_[index] = stamp_;
+                    if (visit(labels_[index])) return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool repeat_free(box2d<double> const& box, double margin, std::uint32_t text_id, double repeat_distance)
+    {
+        box2d<double> repeat_box(box.minx() - repeat_distance, box.miny() - repeat_distance,
+                                 box.maxx() + repeat_distance, box.maxy() + repeat_distance);
+
+        box2d<double> const& margin_box = (margin > 0
+                                               ? box2d<double>(box.minx() - margin, box.miny() - margin,
+                                                               box.maxx() + margin, box.maxy() + margin)
+                                               : box);
+
+        return !any_of(repeat_box, [&](label const& lbl) {
+                return (lbl.box.intersects(margin_box) || (text_id == lbl.text_id && lbl.box.intersects(repeat_box)))
+                    && !continues(lbl, box);
+            });
+    }
+
+    bool all_free(std::vector<box2d<double>> const& boxes, double margin,
+                  std::uint32_t text_id, double repeat_distance)
     {
-        return tree_.extent();
+        bool repeat = repeat_distance > margin;
+        double grow = repeat ? repeat_distance : std::max(margin, 0.0);
+        box2d<double> envelope;
+        bool first = true;
+        for (box2d<double> const& box : boxes)
+        {
+            box2d<double> query(box.minx() - grow, box.miny() - grow,
+                                box.maxx() + grow, box.maxy() + grow);
+            if (!(query.minx() <= query.maxx() && query.miny() <= query.maxy()))
+            {
+                envelope = box2d<double>();
+                break;
+            }
+            if (first)
+            {
+                envelope = query;
+                first = false;
+            }
+            else
+            {
+                envelope.expand_to_include(query);
+            }
+        }
+        if (first) return true;
+        if (!envelope.valid())
+        {
+            // odd boxes go one by one
+            for (box2d<double> const& box : boxes)
+            {
+                if (repeat ? !repeat_free(box, margin, text_id, repeat_distance) : !has_placement(box, margin)) return false;
+            }
+            return true;
+        }
+        candidates_.clear();
+        any_of(envelope, [&](label const& lbl) {
+                candidates_.push_back(&lbl);
+                return false;
+            });
+        for (box2d<double> const& box : boxes)
+        {
+            box2d<double> margin_box = (margin > 0
+                                        ? box2d<double>(box.minx() - margin, box.miny() - margin,
+                                                        box.maxx() + margin, box.maxy() + margin)
+                                        : box);
+            box2d<double> repeat_box(box.minx() - repeat_distance, box.miny() - repeat_distance,
+                                     box.maxx() + repeat_distance, box.maxy() + repeat_distance);
+            box2d<double> const& query = repeat ? repeat_box : margin_box;
+            if (!extent_.intersects(query)) continue;
+            for (label const* lbl : candidates_)
+            {
+                if ((lbl->box.intersects(margin_box) ||
+                     (repeat && text_id == lbl->text_id && lbl->box.intersects(repeat_box)))
+                    && !continues(*lbl, box))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
     }
 
-    query_iterator begin() { return tree_.query_in_box(extent()); }
-    query_iterator end() { return tree_.query_end(); }
+    box2d<double> extent_;
+    int cols_;
+    int rows_;
+    double cell_width_;
+    double cell_height_;
+    std::vector<label> labels_;
+    // last query that visited each label
+    std::vector<std::uint32_t> stamps_;
+    std::uint32_t stamp_;
+    std::vector<std::vector<std::uint32_t>> cells_;
+    std::vector<int> used_cells_;
+    std::vector<std::uint32_t> oversized_;
+    std::unordered_map<mapnik::value_unicode_string, std::uint32_t, text_hash> text_ids_;
+    std::vector<label const*> candidates_;
+    std::shared_ptr<label_placement_store> store_;
+    boost::optional<view_transform> tr_;
+    // labels of store_ around this detector, in its coordinates
+    std::vector<placed_label> seeded_;
 };
 }
 
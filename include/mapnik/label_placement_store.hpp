@@ -0,0 +1,113 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef MAPNIK_LABEL_PLACEMENT_STORE_HPP
+#define MAPNIK_LABEL_PLACEMENT_STORE_HPP
+
+// mapnik
+#include <mapnik/config.hpp>
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/util/noncopyable.hpp>
+#include <mapnik/value/types.hpp>
+
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <unicode/unistr.h>
+#pragma GCC diagnostic pop
+
+// stl
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#ifdef MAPNIK_THREADSAFE
+#include <mutex>
+#endif
+
+namespace mapnik
+{
+
+struct placed_label
+{
+    box2d<double> box;
+    value_unicode_string text;
+};
+
+// Labels placed by earlier renders, in map coordinates, for sharing
+// placement decisions between neighbouring tiles. A label_collision_detector4
+// constructed with a store starts out with the stored labels around its
+// render as carried labels, and adds every label it places to the store.
+// A tile rendered after its neighbours then draws the labels they placed
+// across their common edge, and avoids placing others over them.
+//
+// Boxes are only comparable between renders at the same scale, so keep one
+// store per zoom level. Renders running at the same time only see what
+// the other has placed so far. Once the store holds more than max_labels
+// labels the oldest quarter of them is dropped, so a long running tile
+// server forgets the labels of tiles rendered long ago.
+class MAPNIK_DECL label_placement_store : private util::noncopyable
+{
+public:
+    // cell_size is the size of the grid cells labels are indexed by, in
+    // map units; the size of a tile is a good choice. A max_labels of 0
+    // lets the store grow until cleared.
+    explicit label_placement_store(double cell_size,
+                                   std::size_t max_labels = 1 << 18);
+
+    // Stored labels intersecting `box`, in insertion order.
+    std::vector<placed_label> query(box2d<double> const& box) const;
+    // Adds a label unless the same label is already stored. Returns
+    // whether it was added.
+    bool insert(box2d<double> const& box, value_unicode_string const& text);
+    std::size_t size() const;
+    std::size_t max_labels() const;
+    // number of labels dropped to stay within max_labels
+    std::size_t evicted() const;
+    void clear();
+
+private:
+    // labels spanning more cells are checked by every query
+    static constexpr std::size_t max_label_cells = 64;
+
+    bool cell_range(box2d<double> const& box, std::int64_t & c0, std::int64_t & r0,
+                    std::int64_t & c1, std::int64_t & r1) const;
+    template <typename F>
+    void visit(box2d<double> const& box, F && func) const;
+    static std::uint64_t cell_key(std::int64_t col, std::int64_t row);
+    void index_label(std::uint32_t index);
+    void evict();
+
+    double cell_size_;
+    std::size_t max_labels_;
+    std::size_t evicted_;
+    std::vector<placed_label> labels_;
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> cells_;
+    std::vector<std::uint32_t> oversized_;
+#ifdef MAPNIK_THREADSAFE
+    mutable std::mutex mutex_;
+#endif
+};
+
+}
+
+#endif // MAPNIK_LABEL_PLACEMENT_STORE_HPP
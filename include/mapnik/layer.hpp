@@ -170,6 +170,19 @@ public:
      */
     bool cache_features() const;
 
+    /*!
+     * @param stream_features Set whether this layer's features should be read once and
+     *        dispatched to all styles using them instead of querying the datasource per style.
+     *        The first style draws features as they are read, the features matched by the
+     *        other styles are buffered until they are drawn.
+     */
+    void set_stream_features(bool stream_features);
+
+    /*!
+     * @return whether this layer's features will be read once if used by multiple styles
+     */
+    bool stream_features() const;
+
     /*!
      * @param column Set the field rendering of this layer is grouped by.
      */
@@ -213,6 +226,7 @@ private:
     bool queryable_;
     bool clear_label_cache_;
     bool cache_features_;
+    bool stream_features_;
     std::string group_by_;
     std::vector<std::string> styles_;
     datasource_ptr ds_;
@@ -28,6 +28,8 @@
 #include <mapnik/util/singleton.hpp>
 #include <mapnik/util/noncopyable.hpp>
 
+#include <cstddef>
+#include <list>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -45,16 +47,63 @@ namespace mapnik
 
 using mapped_region_ptr = std::shared_ptr<boost::interprocess::mapped_region>;
 
+struct mapped_memory_cache_stats
+{
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t evictions = 0;
+    std::size_t mappings = 0;
+    std::size_t bytes = 0;
+};
+
+// Cache of memory mapped files shared by the datasource plugins.
+//
+// With a mapping or byte budget set, least recently used regions are
+// unmapped once the budget is exceeded. Regions still referenced outside
+// the cache are skipped, so unmapping never pulls data from under a reader
+// and the budget may be exceeded while many files are in use.
 class MAPNIK_DECL mapped_memory_cache :
         public singleton<mapped_memory_cache, CreateStatic>,
         private util::noncopyable
 {
     friend class CreateStatic<mapped_memory_cache>;
-    std::unordered_map<std::string,mapped_region_ptr> cache_;
+public:
+    // access pattern passed to the kernel (madvise) for new mappings
+    enum access_hint
+    {
+        ACCESS_NORMAL,
+        ACCESS_SEQUENTIAL,
+        ACCESS_RANDOM,
+        ACCESS_WILLNEED
+    };
+private:
+    struct entry
+    {
+        mapped_region_ptr region;
+        std::size_t bytes;
+        std::list<std::string>::iterator lru_pos;
+    };
+    mapped_memory_cache();
+    void insert_impl(std::string const& key, mapped_region_ptr const& mem);
+    void evict();
+    std::unordered_map<std::string, entry> cache_;
+    std::list<std::string> lru_; // most recently used first
+    std::size_t max_mappings_;
+    std::size_t max_bytes_;
+    access_hint hint_;
+    mapped_memory_cache_stats stats_;
 public:
     bool insert(std::string const& key, mapped_region_ptr);
     boost::optional<mapped_region_ptr> find(std::string const& key, bool update_cache = false);
     void clear();
+    // 0 (the default) means no limit
+    void set_max_mappings(std::size_t max_mappings);
+    std::size_t max_mappings() const;
+    void set_max_bytes(std::size_t max_bytes);
+    std::size_t max_bytes() const;
+    void set_access_hint(access_hint hint);
+    access_hint get_access_hint() const;
+    mapped_memory_cache_stats stats();
 };
 
 extern template class MAPNIK_DECL singleton<mapped_memory_cache, CreateStatic>;
@@ -28,35 +28,86 @@
 #include <mapnik/config.hpp>
 #include <mapnik/util/noncopyable.hpp>
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <list>
 #include <unordered_map>
 #include <memory>
 #include <string>
+#ifdef MAPNIK_THREADSAFE
+#include <mutex>
+#endif
 
 namespace mapnik
 {
 
 struct marker;
 
+struct marker_cache_stats
+{
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t evictions = 0;
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+};
+
+// Markers loaded from files are kept in a number of independently locked
+// shards, each evicting its least recently used entries once the shard's
+// part of the byte budget is exceeded. Built-in markers (shape:// and
+// image:// uris) are never evicted.
 class MAPNIK_DECL marker_cache :
         public singleton <marker_cache, CreateUsingNew>,
         private util::noncopyable
 {
     friend class CreateUsingNew<marker_cache>;
+public:
+    static constexpr std::size_t num_shards = 16;
 private:
+    struct entry
+    {
+        std::shared_ptr<mapnik::marker const> marker;
+        std::size_t bytes;
+        bool pinned;
+        std::list<std::string>::iterator lru_pos;
+    };
+    struct shard
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::mutex mutex;
+#endif
+        std::unordered_map<std::string, entry> entries;
+        std::list<std::string> lru; // most recently used first, pinned entries excluded
+        std::size_t bytes = 0;
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+    };
+
     marker_cache();
     ~marker_cache();
-    bool insert_marker(std::string const& key, marker && path);
-    std::unordered_map<std::string, std::shared_ptr<mapnik::marker const> > marker_cache_;
+    shard & shard_for(std::string const& key);
+    std::shared_ptr<mapnik::marker const> insert_marker(std::string const& key,
+                                                        std::shared_ptr<mapnik::marker const> const& mark);
+    void evict(shard & s, std::size_t max_bytes);
+    std::shared_ptr<mapnik::marker const> load(std::string const& uri) const;
+    mutable std::array<shard, num_shards> shards_;
+    std::atomic<std::size_t> max_bytes_;
     bool insert_svg(std::string const& name, std::string const& svg_string);
     std::unordered_map<std::string,std::string> svg_cache_;
 public:
     std::string known_svg_prefix_;
     std::string known_image_prefix_;
-    inline bool is_uri(std::string const& path) { return is_svg_uri(path) || is_image_uri(path); }
-    bool is_svg_uri(std::string const& path);
-    bool is_image_uri(std::string const& path);
+    inline bool is_uri(std::string const& path) const { return is_svg_uri(path) || is_image_uri(path); }
+    bool is_svg_uri(std::string const& path) const;
+    bool is_image_uri(std::string const& path) const;
     std::shared_ptr<marker const> find(std::string const& key, bool update_cache = false);
     void clear();
+    // approximate memory budget of cached markers, 0 (the default) for no limit
+    void set_max_bytes(std::size_t max_bytes);
+    std::size_t max_bytes() const;
+    marker_cache_stats stats() const;
 };
 
 }
@@ -0,0 +1,97 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef MAPNIK_METATILE_HPP
+#define MAPNIK_METATILE_HPP
+
+// mapnik
+#include <mapnik/config.hpp>
+#include <mapnik/attribute.hpp>
+#include <mapnik/request.hpp>
+#include <mapnik/image.hpp>
+#include <mapnik/image_view.hpp>
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/util/noncopyable.hpp>
+
+// stl
+#include <string>
+#include <vector>
+
+namespace mapnik
+{
+
+class Map;
+
+// A block of cols x rows tiles rendered in a single pass.
+//
+// All layers are queried and prepared once for the whole extent and labels
+// are placed once, so placements stay consistent across the seams between
+// the tiles of a metatile. Tiles are handed out as views into the shared
+// image and can be encoded concurrently.
+class MAPNIK_DECL metatile : private util::noncopyable
+{
+public:
+    // `extent` is the extent of the whole metatile in map coordinates. It
+    // is used as is, so it should have the aspect ratio of cols x rows.
+    // Throws std::runtime_error if cols, rows or tile_size is zero, or if
+    // the metatile is too large.
+    metatile(box2d<double> const& extent,
+             unsigned cols,
+             unsigned rows,
+             unsigned tile_size = 256);
+
+    // pixels of data and labels rendered around the metatile
+    void set_buffer_size(int buffer_size);
+    int buffer_size() const;
+
+    unsigned cols() const;
+    unsigned rows() const;
+    unsigned tile_size() const;
+    request const& get_request() const;
+
+    // render `m` (styles, layers, srs) into the metatile; the map's own
+    // size, extent and buffer size are ignored and `m` is not copied
+    void render(Map const& m,
+                double scale_factor = 1.0,
+                attributes const& vars = attributes());
+
+    image_rgba8 const& image() const;
+
+    // zero-copy view of the tile at column x, row y
+    image_view_rgba8 tile(unsigned x, unsigned y) const;
+
+    // encode every tile, row by row, using up to `threads` threads
+    std::vector<std::string> encode(std::string const& format,
+                                    unsigned threads = 1) const;
+
+private:
+    request req_;
+    unsigned cols_;
+    unsigned rows_;
+    unsigned tile_size_;
+    image_rgba8 image_;
+};
+
+}
+
+#endif // MAPNIK_METATILE_HPP
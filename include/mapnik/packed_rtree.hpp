@@ -0,0 +1,255 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef MAPNIK_PACKED_RTREE_HPP
+#define MAPNIK_PACKED_RTREE_HPP
+
+// mapnik
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/util/noncopyable.hpp>
+
+// stl
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace detail {
+
+// Hilbert curve index of a point on a 2^16 x 2^16 grid
+// (after "Fast Hilbert curve generation" by rawrunprotected)
+inline std::uint32_t hilbert(std::uint32_t x, std::uint32_t y)
+{
+    std::uint32_t a = x ^ y;
+    std::uint32_t b = 0xFFFF ^ a;
+    std::uint32_t c = 0xFFFF ^ (x | y);
+    std::uint32_t d = x & (y ^ 0xFFFF);
+
+    std::uint32_t A = a | (b >> 1);
+    std::uint32_t B = (a >> 1) ^ a;
+    std::uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+    std::uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+    a = A; b = B; c = C; d = D;
+    A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+    B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+    C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+    D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+    a = A; b = B; c = C; d = D;
+    A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+    B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+    C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+    D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+    a = A; b = B; c = C; d = D;
+    C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+    D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+    a = C ^ (C >> 1);
+    b = D ^ (D >> 1);
+
+    std::uint32_t i0 = x ^ y;
+    std::uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+
+    i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+    i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+    i0 = (i0 | (i0 << 2)) & 0x33333333;
+    i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+    i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+    i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+    i1 = (i1 | (i1 << 2)) & 0x33333333;
+    i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+    return (i1 << 1) | i0;
+}
+
+// End offsets of the levels of a packed tree, leaves first. The root is
+// always a level of its own.
+inline std::vector<std::size_t> packed_rtree_levels(std::size_t num_items, std::size_t node_size)
+{
+    std::vector<std::size_t> levels;
+    std::size_t n = num_items;
+    std::size_t num_nodes = n;
+    levels.push_back(num_nodes);
+    if (n == 0) return levels;
+    do
+    {
+        n = (n + node_size - 1) / node_size;
+        num_nodes += n;
+        levels.push_back(num_nodes);
+    }
+    while (n != 1);
+    return levels;
+}
+
+}
+
+// Static R-tree packed along a Hilbert curve, in the style of flatbush.
+//
+// Items are sorted by the Hilbert index of their centers and grouped into
+// nodes of a fixed size, level by level up to a single root. The tree is
+// fully implicit: the boxes of all levels are stored in one contiguous
+// array and children are found by position, so the index holds no
+// pointers or offsets and is read by mapnik::util::spatial_index_view.
+//
+// Layout: "mapnik-rtree" header (16 bytes), node size and item count
+// (little endian uint32), extent, boxes of all levels (leaves first), items.
+template <typename T0, typename T1 = box2d<double>>
+class packed_rtree : util::noncopyable
+{
+    using value_type = T0;
+    using bbox_type = T1;
+public:
+    explicit packed_rtree(std::uint32_t node_size = 16)
+        : node_size_(std::max<std::uint32_t>(node_size, 2)),
+          values_(),
+          boxes_(),
+          extent_() {}
+
+    void insert(value_type data, bbox_type const& box)
+    {
+        if (boxes_.empty()) extent_ = box;
+        else extent_.expand_to_include(box);
+        values_.push_back(data);
+        boxes_.push_back(box);
+    }
+
+    std::size_t count_items() const
+    {
+        return values_.size();
+    }
+
+    // total number of boxes, including the leaves
+    std::size_t count() const
+    {
+        return detail::packed_rtree_levels(values_.size(), node_size_).back();
+    }
+
+    std::uint32_t node_size() const
+    {
+        return node_size_;
+    }
+
+    bbox_type const& extent() const
+    {
+        return extent_;
+    }
+
+    template <typename OutputStream>
+    void write(OutputStream & out) const
+    {
+        static_assert(std::is_standard_layout<value_type>::value, "Values stored in packed R-tree must be standard layout type");
+        std::size_t num_items = values_.size();
+        if (num_items > std::numeric_limits<std::uint32_t>::max())
+        {
+            throw std::runtime_error("packed_rtree: too many items");
+        }
+        std::vector<std::size_t> order(num_items);
+        std::iota(order.begin(), order.end(), 0);
+        if (num_items > 1)
+        {
+            std::vector<std::uint32_t> hilbert_values(num_items);
+            double width = extent_.width() > 0 ? extent_.width() : 1.0;
+            double height = extent_.height() > 0 ? extent_.height() : 1.0;
+            for (std::size_t i = 0; i < num_items; ++i)
+            {
+                bbox_type const& box = boxes_[i];
+                double cx = (box.minx() + box.maxx()) / 2.0;
+                double cy = (box.miny() + box.maxy()) / 2.0;
+                auto x = static_cast<std::uint32_t>(0xFFFF * ((cx - extent_.minx()) / width));
+                auto y = static_cast<std::uint32_t>(0xFFFF * ((cy - extent_.miny()) / height));
+                hilbert_values[i] = detail::hilbert(x, y);
+            }
+            std::stable_sort(order.begin(), order.end(),
+                             [&hilbert_values](std::size_t a, std::size_t b) { return hilbert_values[a] < hilbert_values[b]; });
+        }
+
+        std::vector<std::size_t> levels = detail::packed_rtree_levels(num_items, node_size_);
+        std::vector<bbox_type> boxes;
+        boxes.reserve(levels.back());
+        for (std::size_t i : order)
+        {
+            boxes.push_back(boxes_[i]);
+        }
+        for (std::size_t level = 1; level < levels.size(); ++level)
+        {
+            std::size_t begin = level > 1 ? levels[level - 2] : 0;
+            std::size_t end = levels[level - 1];
+            for (std::size_t i = begin; i < end; i += node_size_)
+            {
+                bbox_type box = boxes[i];
+                std::size_t last = std::min<std::size_t>(i + node_size_, end);
+                for (std::size_t j = i + 1; j < last; ++j)
+                {
+                    box.expand_to_include(boxes[j]);
+                }
+                boxes.push_back(box);
+            }
+        }
+
+        char header[16];
+        std::memset(header, 0, 16);
+        std::strcpy(header, "mapnik-rtree");
+        out.write(header, 16);
+        write_ndr_integer(out, node_size_);
+        write_ndr_integer(out, static_cast<std::uint32_t>(num_items));
+        out.write(reinterpret_cast<char const*>(&extent_), sizeof(bbox_type));
+        if (!boxes.empty())
+        {
+            out.write(reinterpret_cast<char const*>(boxes.data()), boxes.size() * sizeof(bbox_type));
+        }
+        for (std::size_t i : order)
+        {
+            out.write(reinterpret_cast<char const*>(&values_[i]), sizeof(value_type));
+        }
+    }
+
+private:
+    // little endian, like the integers of the quadtree index
+    template <typename OutputStream>
+    static void write_ndr_integer(OutputStream & out, std::uint32_t value)
+    {
+        char bytes[4] = { static_cast<char>(value & 0xff),
+                          static_cast<char>((value >> 8) & 0xff),
+                          static_cast<char>((value >> 16) & 0xff),
+                          static_cast<char>((value >> 24) & 0xff) };
+        out.write(bytes, 4);
+    }
+
+    std::uint32_t node_size_;
+    std::vector<value_type> values_;
+    std::vector<bbox_type> boxes_;
+    bbox_type extent_;
+};
+
+}
+
+#endif // MAPNIK_PACKED_RTREE_HPP
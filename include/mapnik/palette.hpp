@@ -42,8 +42,12 @@ using rgba_hash_table = std::unordered_map<unsigned int, unsigned char>;
 #pragma GCC diagnostic pop
 
 // stl
+#include <cstdint>
 #include <vector>
 #include <tuple>
+#ifdef MAPNIK_THREADSAFE
+#include <mutex>
+#endif
 
 #define U2RED(x) ((x)&0xff)
 #define U2GREEN(x) (((x)>>8)&0xff)
@@ -113,12 +117,17 @@ struct MAPNIK_DECL rgba
 };
 
 
+// A fixed palette. Quantized colors are remembered in a lookup table
+// shared by all users of the palette, so a single instance can be reused
+// (and, with MAPNIK_THREADSAFE, shared between threads) for every tile of
+// a seeding job to skip both palette creation and repeated searches.
 class MAPNIK_DECL rgba_palette : private util::noncopyable
 {
 public:
     enum palette_type { PALETTE_RGBA = 0, PALETTE_RGB = 1, PALETTE_ACT = 2 };
 
     explicit rgba_palette(std::string const& pal, palette_type type = PALETTE_RGBA);
+    explicit rgba_palette(std::vector<rgba> const& colors);
     rgba_palette();
 
     inline std::vector<rgb> const& palette() const { return rgb_pal_;}
@@ -134,16 +143,63 @@ public:
 
 private:
     void parse(std::string const& pal, palette_type type);
+    void assign(std::vector<rgba> && colors);
+    unsigned char find_nearest(unsigned val) const;
 
 private:
     std::vector<rgba> sorted_pal_;
     mutable rgba_hash_table color_hashmap_;
+#ifdef MAPNIK_THREADSAFE
+    mutable std::mutex mutex_;
+#endif
 
     unsigned colors_;
     std::vector<rgb> rgb_pal_;
     std::vector<unsigned> alpha_pal_;
 };
 
+// Direct mapped color -> index cache in front of a quantizer (rgba_palette,
+// hextree or octree). It is meant to live for a single encode: lookups are
+// lock free and most pixels of a tile are repeats of a few colors, so only
+// the first occurrence of a color reaches the quantizer's own search.
+template <typename Quantizer>
+class quantize_cache : private util::noncopyable
+{
+public:
+    static constexpr unsigned bits = 12;
+    static constexpr unsigned size = 1u << bits;
+
+    explicit quantize_cache(Quantizer const& quantizer)
+        : quantizer_(quantizer),
+          keys_(size, 0),
+          indices_(size, static_cast<std::uint8_t>(quantizer.quantize(0))),
+          last_key_(0),
+          last_index_(indices_[0]) {}
+
+    inline std::uint8_t quantize(unsigned val)
+    {
+        // runs of equal pixels are by far the most common case
+        if (val == last_key_) return last_index_;
+        // every slot starts out holding the correct index for 0
+        unsigned slot = (val * 2654435761u) >> (32 - bits);
+        if (keys_[slot] != val)
+        {
+            keys_[slot] = val;
+            indices_[slot] = static_cast<std::uint8_t>(quantizer_.quantize(val));
+        }
+        last_key_ = val;
+        last_index_ = indices_[slot];
+        return last_index_;
+    }
+
+private:
+    Quantizer const& quantizer_;
+    std::vector<unsigned> keys_;
+    std::vector<std::uint8_t> indices_;
+    unsigned last_key_;
+    std::uint8_t last_index_;
+};
+
 } // namespace mapnik
 
 #endif // MAPNIK_PALETTE_HPP
@@ -28,6 +28,7 @@
 #include <mapnik/octree.hpp>
 #include <mapnik/hextree.hpp>
 #include <mapnik/image.hpp>
+#include <mapnik/util/parallel_for.hpp>
 
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
@@ -39,7 +40,12 @@ extern "C"
 {
 #include <png.h>
 }
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <set>
+#include <stdexcept>
+#include <vector>
 #pragma GCC diagnostic pop
 
 #define MAX_OCTREE_LEVELS 4
@@ -55,6 +61,7 @@ struct png_options {
     double gamma;
     bool paletted;
     bool use_hextree;
+    unsigned threads;
 
     png_options() :
         colors(256),
@@ -64,7 +71,8 @@ struct png_options {
         trans_mode(-1),
         gamma(-1),
         paletted(true),
-        use_hextree(true) {}
+        use_hextree(true),
+        threads(1) {}
 };
 
 template <typename T>
@@ -81,12 +89,354 @@ void flush_data (png_structp png_ptr)
     out->flush();
 }
 
+namespace detail {
+
+// Parallel encoder for large images: rows are filtered and deflated in
+// independent chunks of roughly png_chunk_bytes, each primed with the last
+// 32k of the preceding rows so compression barely suffers. Chunks other than
+// the last end on a sync flush, so their raw deflate streams concatenate
+// into a single zlib stream whose checksum is combined from the chunk ones.
+
+static constexpr std::size_t png_chunk_bytes = 1 << 20;
+static constexpr std::size_t png_window_bytes = 32768;
+
+inline std::size_t png_rows_per_chunk(std::size_t row_bytes)
+{
+    return std::max<std::size_t>(1, png_chunk_bytes / (row_bytes + 1));
+}
+
+inline bool png_parallel(png_options const& opts, unsigned height, std::size_t row_bytes)
+{
+    return opts.threads > 1 && height > png_rows_per_chunk(row_bytes);
+}
+
+inline void png_put_uint32(unsigned char * buf, std::uint32_t val)
+{
+    buf[0] = static_cast<unsigned char>(val >> 24);
+    buf[1] = static_cast<unsigned char>(val >> 16);
+    buf[2] = static_cast<unsigned char>(val >> 8);
+    buf[3] = static_cast<unsigned char>(val);
+}
+
+template <typename T>
+class png_chunk_writer
+{
+public:
+    png_chunk_writer(T & file, char const* type, std::size_t length)
+        : file_(file),
+          crc_(crc32(0, Z_NULL, 0))
+    {
+        unsigned char buf[4];
+        png_put_uint32(buf, static_cast<std::uint32_t>(length));
+        file_.write(reinterpret_cast<char const*>(buf), 4);
+        write(type, 4);
+    }
+
+    void write(void const* data, std::size_t size)
+    {
+        crc_ = crc32(crc_, static_cast<Bytef const*>(data), static_cast<uInt>(size));
+        file_.write(static_cast<char const*>(data), size);
+    }
+
+    void finish()
+    {
+        unsigned char buf[4];
+        png_put_uint32(buf, static_cast<std::uint32_t>(crc_));
+        file_.write(reinterpret_cast<char const*>(buf), 4);
+    }
+
+private:
+    T & file_;
+    uLong crc_;
+};
+
+template <typename T>
+void png_write_chunk(T & file, char const* type, void const* data, std::size_t size)
+{
+    png_chunk_writer<T> chunk(file, type, size);
+    if (size > 0) chunk.write(data, size);
+    chunk.finish();
+}
+
+inline unsigned png_paeth(unsigned a, unsigned b, unsigned c)
+{
+    int p = static_cast<int>(a + b) - static_cast<int>(c);
+    int pa = std::abs(p - static_cast<int>(a));
+    int pb = std::abs(p - static_cast<int>(b));
+    int pc = std::abs(p - static_cast<int>(c));
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+inline void png_apply_filter(int type, unsigned char const* row, unsigned char const* prev,
+                             std::size_t row_bytes, std::size_t bpp, unsigned char * out)
+{
+    switch (type)
+    {
+    case PNG_FILTER_VALUE_SUB:
+        for (std::size_t i = 0; i < row_bytes; ++i)
+        {
+            out[i] = row[i] - (i < bpp ? 0 : row[i - bpp]);
+        }
+        break;
+    case PNG_FILTER_VALUE_UP:
+        for (std::size_t i = 0; i < row_bytes; ++i)
+        {
+            out[i] = row[i] - prev[i];
+        }
+        break;
+    case PNG_FILTER_VALUE_AVG:
+        for (std::size_t i = 0; i < row_bytes; ++i)
+        {
+            unsigned a = i < bpp ? 0 : row[i - bpp];
+            out[i] = row[i] - ((a + prev[i]) >> 1);
+        }
+        break;
+    case PNG_FILTER_VALUE_PAETH:
+        for (std::size_t i = 0; i < row_bytes; ++i)
+        {
+            unsigned a = i < bpp ? 0 : row[i - bpp];
+            unsigned c = i < bpp ? 0 : prev[i - bpp];
+            out[i] = row[i] - png_paeth(a, prev[i], c);
+        }
+        break;
+    default:
+        std::memcpy(out, row, row_bytes);
+        break;
+    }
+}
+
+// filter types enabled by a png_set_filter style argument
+inline std::vector<int> png_filter_types(int filters)
+{
+    int mask;
+    switch (filters & (PNG_ALL_FILTERS | 0x07))
+    {
+    case PNG_FILTER_VALUE_SUB: mask = PNG_FILTER_SUB; break;
+    case PNG_FILTER_VALUE_UP: mask = PNG_FILTER_UP; break;
+    case PNG_FILTER_VALUE_AVG: mask = PNG_FILTER_AVG; break;
+    case PNG_FILTER_VALUE_PAETH: mask = PNG_FILTER_PAETH; break;
+    default: mask = filters & PNG_ALL_FILTERS; break;
+    }
+    std::vector<int> types;
+    if (mask & PNG_FILTER_NONE) types.push_back(PNG_FILTER_VALUE_NONE);
+    if (mask & PNG_FILTER_SUB) types.push_back(PNG_FILTER_VALUE_SUB);
+    if (mask & PNG_FILTER_UP) types.push_back(PNG_FILTER_VALUE_UP);
+    if (mask & PNG_FILTER_AVG) types.push_back(PNG_FILTER_VALUE_AVG);
+    if (mask & PNG_FILTER_PAETH) types.push_back(PNG_FILTER_VALUE_PAETH);
+    if (types.empty()) types.push_back(PNG_FILTER_VALUE_NONE);
+    return types;
+}
+
+// Writes the filter type byte followed by the filtered row. With several
+// filter types enabled the one with the smallest sum of absolute signed
+// differences wins, the same heuristic libpng uses.
+inline void png_filter_row(std::vector<int> const& types, unsigned char const* row,
+                           unsigned char const* prev, std::size_t row_bytes, std::size_t bpp,
+                           unsigned char * out, std::vector<unsigned char> & scratch)
+{
+    if (types.size() == 1)
+    {
+        out[0] = static_cast<unsigned char>(types.front());
+        png_apply_filter(types.front(), row, prev, row_bytes, bpp, out + 1);
+        return;
+    }
+    scratch.resize(row_bytes);
+    std::size_t best_sum = 0;
+    bool first = true;
+    for (int type : types)
+    {
+        png_apply_filter(type, row, prev, row_bytes, bpp, scratch.data());
+        std::size_t sum = 0;
+        for (std::size_t i = 0; i < row_bytes; ++i)
+        {
+            sum += scratch[i] < 128 ? scratch[i] : 256 - scratch[i];
+        }
+        if (first || sum < best_sum)
+        {
+            first = false;
+            best_sum = sum;
+            out[0] = static_cast<unsigned char>(type);
+            std::memcpy(out + 1, scratch.data(), row_bytes);
+        }
+    }
+}
+
+struct png_deflated_chunk
+{
+    std::vector<unsigned char> data;
+    uLong adler;
+    std::size_t length;
+};
+
+// Filters and deflates rows [y0, y1) into a raw deflate stream.
+// get_row(y, out) copies the packed bytes of row y into out.
+template <typename RowFunc>
+void png_deflate_rows(RowFunc const& get_row, unsigned y0, unsigned y1,
+                      std::size_t row_bytes, std::size_t bpp, bool last,
+                      png_options const& opts, png_deflated_chunk & chunk)
+{
+    std::size_t const stride = row_bytes + 1;
+    // trailing rows of the previous chunk are filtered again to prime the window
+    unsigned dict_rows = std::min<std::size_t>(y0, (png_window_bytes + stride - 1) / stride);
+    unsigned start = y0 - dict_rows;
+    std::vector<int> types = png_filter_types(opts.filters);
+    std::vector<unsigned char> filtered((y1 - start) * stride);
+    std::vector<unsigned char> prev(row_bytes, 0);
+    std::vector<unsigned char> row(row_bytes);
+    std::vector<unsigned char> scratch;
+    if (start > 0) get_row(start - 1, prev.data());
+    for (unsigned y = start; y < y1; ++y)
+    {
+        get_row(y, row.data());
+        png_filter_row(types, row.data(), prev.data(), row_bytes, bpp,
+                       filtered.data() + (y - start) * stride, scratch);
+        std::swap(row, prev);
+    }
+    unsigned char * input = filtered.data() + dict_rows * stride;
+    std::size_t input_size = (y1 - y0) * stride;
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, std::min(opts.compression, Z_BEST_COMPRESSION), Z_DEFLATED,
+                     -MAX_WBITS, 8, opts.strategy) != Z_OK)
+    {
+        throw std::runtime_error("png: failed to initialise deflate");
+    }
+    if (dict_rows > 0)
+    {
+        std::size_t dict_size = std::min(png_window_bytes, dict_rows * stride);
+        deflateSetDictionary(&stream, input - dict_size, static_cast<uInt>(dict_size));
+    }
+    chunk.data.resize(deflateBound(&stream, input_size) + 64);
+    stream.next_in = input;
+    stream.avail_in = static_cast<uInt>(input_size);
+    std::size_t out_size = 0;
+    for (;;)
+    {
+        stream.next_out = chunk.data.data() + out_size;
+        stream.avail_out = static_cast<uInt>(chunk.data.size() - out_size);
+        int ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+        out_size = chunk.data.size() - stream.avail_out;
+        if (ret == Z_STREAM_ERROR)
+        {
+            deflateEnd(&stream);
+            throw std::runtime_error("png: deflate failed");
+        }
+        if (last ? ret == Z_STREAM_END : (stream.avail_in == 0 && stream.avail_out > 0)) break;
+        chunk.data.resize(chunk.data.size() * 2);
+    }
+    deflateEnd(&stream);
+    chunk.data.resize(out_size);
+    chunk.adler = adler32(adler32(0, Z_NULL, 0), input, static_cast<uInt>(input_size));
+    chunk.length = input_size;
+}
+
+template <typename T, typename RowFunc>
+void save_as_png_parallel(T & file,
+                          unsigned width,
+                          unsigned height,
+                          int bit_depth,
+                          int color_type,
+                          std::size_t row_bytes,
+                          std::size_t bpp,
+                          RowFunc const& get_row,
+                          std::vector<unsigned char> const& plte,
+                          std::vector<unsigned char> const& trns,
+                          png_options const& opts)
+{
+    std::size_t rows_per_chunk = png_rows_per_chunk(row_bytes);
+    std::size_t num_chunks = (height + rows_per_chunk - 1) / rows_per_chunk;
+    std::vector<png_deflated_chunk> chunks(num_chunks);
+    util::parallel_for(num_chunks, opts.threads, [&](std::size_t i)
+    {
+        unsigned y0 = static_cast<unsigned>(i * rows_per_chunk);
+        unsigned y1 = static_cast<unsigned>(std::min<std::size_t>(height, y0 + rows_per_chunk));
+        png_deflate_rows(get_row, y0, y1, row_bytes, bpp, i + 1 == num_chunks, opts, chunks[i]);
+    });
+
+    static unsigned char const signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    file.write(reinterpret_cast<char const*>(signature), 8);
+
+    unsigned char ihdr[13];
+    png_put_uint32(ihdr, width);
+    png_put_uint32(ihdr + 4, height);
+    ihdr[8] = static_cast<unsigned char>(bit_depth);
+    ihdr[9] = static_cast<unsigned char>(color_type);
+    ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+    ihdr[11] = PNG_FILTER_TYPE_BASE;
+    ihdr[12] = PNG_INTERLACE_NONE;
+    png_write_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+    if (!plte.empty()) png_write_chunk(file, "PLTE", plte.data(), plte.size());
+    if (!trns.empty()) png_write_chunk(file, "tRNS", trns.data(), trns.size());
+
+    // zlib header advertising a 32k window and the compression level
+    int level = opts.compression == Z_DEFAULT_COMPRESSION ? 6 : opts.compression;
+    int flevel = (level < 2 || opts.strategy >= Z_HUFFMAN_ONLY) ? 0 : (level < 6 ? 1 : (level == 6 ? 2 : 3));
+    unsigned header = (0x78 << 8) | (flevel << 6);
+    header += 31 - (header % 31);
+    unsigned char zlib_header[2] = { static_cast<unsigned char>(header >> 8),
+                                     static_cast<unsigned char>(header) };
+    uLong adler = adler32(0, Z_NULL, 0);
+    for (std::size_t i = 0; i < num_chunks; ++i)
+    {
+        png_deflated_chunk const& chunk = chunks[i];
+        adler = adler32_combine(adler, chunk.adler, static_cast<z_off_t>(chunk.length));
+        bool first = i == 0;
+        bool last = i + 1 == num_chunks;
+        png_chunk_writer<T> idat(file, "IDAT", chunk.data.size() + (first ? 2 : 0) + (last ? 4 : 0));
+        if (first) idat.write(zlib_header, 2);
+        idat.write(chunk.data.data(), chunk.data.size());
+        if (last)
+        {
+            unsigned char trailer[4];
+            png_put_uint32(trailer, static_cast<std::uint32_t>(adler));
+            idat.write(trailer, 4);
+        }
+        idat.finish();
+    }
+    png_write_chunk(file, "IEND", nullptr, 0);
+}
+
+} // namespace detail
+
 template <typename T1, typename T2>
 void save_as_png(T1 & file,
                 T2 const& image,
                 png_options const& opts)
 
 {
+    if (detail::png_parallel(opts, image.height(), image.width() * (opts.trans_mode == 0 ? 3 : 4)))
+    {
+        // same output as png_write_png: rgba, or rgb with the alpha byte stripped
+        unsigned width = image.width();
+        if (opts.trans_mode == 0)
+        {
+            auto get_row = [&](unsigned y, unsigned char * out)
+            {
+                unsigned char const* row = reinterpret_cast<unsigned char const*>(image.get_row(y));
+                for (unsigned x = 0; x < width; ++x, row += 4, out += 3)
+                {
+                    out[0] = row[0];
+                    out[1] = row[1];
+                    out[2] = row[2];
+                }
+            };
+            detail::save_as_png_parallel(file, width, image.height(), 8, PNG_COLOR_TYPE_RGB,
+                                         width * 3, 3, get_row, {}, {}, opts);
+        }
+        else
+        {
+            auto get_row = [&](unsigned y, unsigned char * out)
+            {
+                std::memcpy(out, image.get_row(y), width * 4);
+            };
+            detail::save_as_png_parallel(file, width, image.height(), 8, PNG_COLOR_TYPE_RGB_ALPHA,
+                                         width * 4, 4, get_row, {}, {}, opts);
+        }
+        return;
+    }
     png_voidp error_ptr=0;
     png_structp png_ptr=png_create_write_struct(PNG_LIBPNG_VER_STRING,
                                                 error_ptr,0, 0);
@@ -258,6 +608,35 @@ void save_as_png(T & file, std::vector<mapnik::rgb> const& palette,
                  std::vector<unsigned> const& alpha,
                  png_options const& opts)
 {
+    std::size_t row_bytes = (static_cast<std::size_t>(width) * color_depth + 7) / 8;
+    if (detail::png_parallel(opts, height, row_bytes))
+    {
+        std::vector<unsigned char> plte;
+        plte.reserve(palette.size() * 3);
+        for (mapnik::rgb const& c : palette)
+        {
+            plte.push_back(c.r);
+            plte.push_back(c.g);
+            plte.push_back(c.b);
+        }
+        // same truncation to the last non opaque entry as below
+        std::vector<unsigned char> trns;
+        for (unsigned i = 0; i < alpha.size(); ++i)
+        {
+            if (alpha[i] < 255) trns.resize(i + 1);
+        }
+        for (unsigned i = 0; i < trns.size(); ++i)
+        {
+            trns[i] = static_cast<unsigned char>(alpha[i]);
+        }
+        auto get_row = [&](unsigned y, unsigned char * out)
+        {
+            std::memcpy(out, image.get_row(y), row_bytes);
+        };
+        detail::save_as_png_parallel(file, width, height, color_depth, PNG_COLOR_TYPE_PALETTE,
+                                     row_bytes, 1, get_row, plte, trns, opts);
+        return;
+    }
     png_voidp error_ptr=0;
     png_structp png_ptr=png_create_write_struct(PNG_LIBPNG_VER_STRING,
                                                 error_ptr,0, 0);
@@ -573,13 +952,14 @@ void save_as_png8(T1 & file,
     {
         // >16 && <=256 colors -> write 8-bit color depth
         image_gray8 reduced_image(width, height);
+        quantize_cache<T3> cache(tree);
         for (unsigned y = 0; y < height; ++y)
         {
             mapnik::image_rgba8::pixel_type const * row = image.get_row(y);
             mapnik::image_gray8::pixel_type  * row_out = reduced_image.get_row(y);
             for (unsigned x = 0; x < width; ++x)
             {
-                row_out[x] = tree.quantize(row[x]);
+                row_out[x] = cache.quantize(row[x]);
             }
         }
         save_as_png(file, palette, reduced_image, width, height, 8, alpha_table, opts);
@@ -599,6 +979,7 @@ void save_as_png8(T1 & file,
         unsigned image_width  = ((width + 7) >> 1) & ~3U; // 4-bit image, round up to 32-bit boundary
         unsigned image_height = height;
         image_gray8 reduced_image(image_width, image_height);
+        quantize_cache<T3> cache(tree);
         for (unsigned y = 0; y < height; ++y)
         {
             mapnik::image_rgba8::pixel_type const * row = image.get_row(y);
@@ -607,7 +988,7 @@ void save_as_png8(T1 & file,
             for (unsigned x = 0; x < width; ++x)
             {
 
-                index = tree.quantize(row[x]);
+                index = cache.quantize(row[x]);
                 if (x%2 == 0)
                 {
                     index = index<<4;
@@ -619,6 +1000,51 @@ void save_as_png8(T1 & file,
     }
 }
 
+template <typename T>
+void create_hextree_palette(hextree<mapnik::rgba> & tree,
+                            T const& image,
+                            png_options const& opts,
+                            std::vector<mapnik::rgba> & palette)
+{
+    if (opts.trans_mode >= 0)
+    {
+        tree.setTransMode(opts.trans_mode);
+    }
+    if (opts.gamma > 0)
+    {
+        tree.setGamma(opts.gamma);
+    }
+    unsigned width = image.width();
+    unsigned height = image.height();
+    for (unsigned y = 0; y < height; ++y)
+    {
+        typename T::pixel_type const * row = image.get_row(y);
+        for (unsigned x = 0; x < width; ++x)
+        {
+            unsigned val = row[x];
+            tree.insert(mapnik::rgba(U2RED(val), U2GREEN(val), U2BLUE(val), U2ALPHA(val)));
+        }
+    }
+    tree.create_palette(palette);
+}
+
+// Computes the palette save_as_png8_hex would use for image. Built once from
+// a representative image (e.g. a mosaic of sample tiles) and wrapped in an
+// rgba_palette it can be shared by every tile of a seeding job, which then
+// skips the per tile hextree entirely (see save_as_png8_pal).
+template <typename T>
+void create_hextree_palette(T const& image,
+                            png_options const& opts,
+                            std::vector<mapnik::rgba> & palette)
+{
+    if (image.width() + image.height() <= 3) // hextree implementation requirement
+    {
+        throw std::runtime_error("create_hextree_palette: image must have at least 3 pixels");
+    }
+    hextree<mapnik::rgba> tree(opts.colors);
+    create_hextree_palette(tree, image, opts, palette);
+}
+
 template <typename T1,typename T2>
 void save_as_png8_hex(T1 & file,
                       T2 const& image,
@@ -631,28 +1057,9 @@ void save_as_png8_hex(T1 & file,
     {
         // structure for color quantization
         hextree<mapnik::rgba> tree(opts.colors);
-        if (opts.trans_mode >= 0)
-        {
-            tree.setTransMode(opts.trans_mode);
-        }
-        if (opts.gamma > 0)
-        {
-            tree.setGamma(opts.gamma);
-        }
-
-        for (unsigned y = 0; y < height; ++y)
-        {
-            typename T2::pixel_type const * row = image.get_row(y);
-            for (unsigned x = 0; x < width; ++x)
-            {
-                unsigned val = row[x];
-                tree.insert(mapnik::rgba(U2RED(val), U2GREEN(val), U2BLUE(val), U2ALPHA(val)));
-            }
-        }
-
         //transparency values per palette index
         std::vector<mapnik::rgba> rgba_palette;
-        tree.create_palette(rgba_palette);
+        create_hextree_palette(tree, image, opts, rgba_palette);
         auto size = rgba_palette.size();
         std::vector<mapnik::rgb> palette;
         std::vector<unsigned> alpha_table;
@@ -29,6 +29,7 @@
 #include <mapnik/make_unique.hpp>
 
 // stl
+#include <algorithm>
 #include <memory>
 #include <new>
 #include <vector>
@@ -111,7 +112,8 @@ public:
         : max_depth_(max_depth),
           ratio_(ratio),
           query_result_(),
-          nodes_()
+          nodes_(),
+          spare_nodes_()
     {
         nodes_.push_back(std::make_unique<node>(ext));
         root_ = nodes_[0].get();
@@ -146,11 +148,20 @@ public:
         return  nodes_.end();
     }
 
+    // Empties the tree. Nodes and their item storage are kept for reuse so
+    // a tree that is cleared and refilled (e.g. a placement detector reused
+    // across renders) stops allocating once it has warmed up.
     void clear ()
     {
         bbox_type ext = root_->extent_;
+        for (auto & n : nodes_)
+        {
+            n->cont_.clear();
+            std::fill(n->children_, n->children_ + 4, nullptr);
+            spare_nodes_.push_back(std::move(n));
+        }
         nodes_.clear();
-        nodes_.push_back(std::make_unique<node>(ext));
+        nodes_.push_back(make_node(ext));
         root_ = nodes_[0].get();
     }
 
@@ -224,7 +235,7 @@ private:
                 {
                     if (!n->children_[i])
                     {
-                        nodes_.push_back(std::make_unique<node>(ext[i]));
+                        nodes_.push_back(make_node(ext[i]));
                         n->children_[i]=nodes_.back().get();
                     }
                     do_insert_data(data,box,n->children_[i],depth);
@@ -235,6 +246,18 @@ private:
         }
     }
 
+    std::unique_ptr<node> make_node(bbox_type const& ext)
+    {
+        if (spare_nodes_.empty())
+        {
+            return std::make_unique<node>(ext);
+        }
+        std::unique_ptr<node> n = std::move(spare_nodes_.back());
+        spare_nodes_.pop_back();
+        n->extent_ = ext;
+        return n;
+    }
+
     void split_box(bbox_type const& node_extent,bbox_type * ext)
     {
         typename bbox_type::value_type width = node_extent.width();
@@ -351,6 +374,7 @@ private:
     const double ratio_;
     result_type query_result_;
     nodes_type nodes_;
+    nodes_type spare_nodes_;
     node * root_;
 
 };
@@ -217,6 +217,9 @@ public:
     inline float get_epsilon() const { return epsilon_; }
 
 private:
+    //! \brief get_color, with a binary search of the stops when they are sorted
+    unsigned color_of(float v, bool sorted) const;
+
     colorizer_stops stops_;         //!< The vector of stops
 
     colorizer_mode default_mode_;   //!< The default mode inherited by stops
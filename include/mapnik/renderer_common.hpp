@@ -51,8 +51,19 @@ struct renderer_common : private util::noncopyable
                        detector_ptr detector);
     renderer_common(Map const &m, request const &req, attributes const& vars, unsigned offset_x, unsigned offset_y,
                        unsigned width, unsigned height, double scale_factor);
+    renderer_common(Map const &m, request const &req, attributes const& vars, unsigned offset_x, unsigned offset_y,
+                       unsigned width, unsigned height, double scale_factor,
+                       detector_ptr detector);
     ~renderer_common();
 
+    // prepare for another render of `req`, keeping the font caches. A
+    // placement detector created by the renderer is cleared, or replaced
+    // when the buffered extent changes. A detector backed by a
+    // label_placement_store is moved to the new render the same way, so it
+    // shares labels around the new extent. Any other detector passed in by
+    // the caller may be shared and is left for the caller to clear or replace.
+    void reset(request const& req, attributes const& vars, unsigned offset_x, unsigned offset_y);
+
     unsigned width_;
     unsigned height_;
     double scale_factor_;
@@ -64,6 +75,8 @@ struct renderer_common : private util::noncopyable
     box2d<double> query_extent_;
     view_transform t_;
     detector_ptr detector_;
+    // whether detector_ was created here rather than passed in
+    bool owns_detector_;
 
 protected:
     // it's desirable to keep this class implicitly noncopyable to prevent
@@ -74,7 +87,8 @@ protected:
 
 private:
     renderer_common(Map const &m, unsigned width, unsigned height, double scale_factor,
-                    attributes const& vars, view_transform && t, detector_ptr detector);
+                    attributes const& vars, view_transform && t, detector_ptr detector,
+                    bool owns_detector);
 };
 
 }
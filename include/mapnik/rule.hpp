@@ -32,9 +32,12 @@
 #include <string>
 #include <vector>
 #include <limits>
+#include <memory>
 
 namespace mapnik
 {
+class expression_program;
+
 class MAPNIK_DECL rule
 {
 public:
@@ -46,6 +49,7 @@ private:
     double max_scale_;
     symbolizers syms_;
     expression_ptr filter_;
+    std::shared_ptr<expression_program const> compiled_filter_;
     bool else_filter_;
     bool also_filter_;
 
@@ -73,6 +77,11 @@ public:
     symbolizers::iterator end();
     void set_filter(expression_ptr const& filter);
     expression_ptr const& get_filter() const;
+    // filter compiled by set_filter, see expression_program.hpp
+    expression_program const& get_compiled_filter() const
+    {
+        return *compiled_filter_;
+    }
     void set_else(bool else_filter);
     bool has_else_filter() const;
     void set_also(bool also_filter);
@@ -25,9 +25,13 @@
 
 // mapnik
 #include <mapnik/rule.hpp>
+#include <mapnik/expression_node.hpp>
 #include <mapnik/util/noncopyable.hpp>
 
 // stl
+#include <map>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include <type_traits>
 
@@ -38,15 +42,36 @@ class rule_cache : private util::noncopyable
 {
 public:
     using rule_ptrs = std::vector<rule const*>;
+
+    // if-rule to test for a feature; `index` is the position of the
+    // rule in get_if_rules() and `matched` tells whether its filter is
+    // already known to be true
+    struct filter_candidate
+    {
+        rule const* rule_;
+        std::size_t index;
+        bool matched;
+    };
+    using filter_candidates = std::vector<filter_candidate>;
+
+    // minimum number of [attribute] = 'string' rules worth indexing
+    static constexpr std::size_t min_indexed_rules = 3;
+
     rule_cache()
         : if_rules_(),
           else_rules_(),
-          also_rules_() {}
+          also_rules_(),
+          index_attribute_(),
+          index_(),
+          unindexed_() {}
 
     rule_cache(rule_cache && rhs) // move ctor
         :  if_rules_(std::move(rhs.if_rules_)),
            else_rules_(std::move(rhs.else_rules_)),
-           also_rules_(std::move(rhs.also_rules_))
+           also_rules_(std::move(rhs.also_rules_)),
+           index_attribute_(std::move(rhs.index_attribute_)),
+           index_(std::move(rhs.index_)),
+           unindexed_(std::move(rhs.unindexed_))
     {}
 
     rule_cache& operator=(rule_cache && rhs) // move assign
@@ -54,6 +79,9 @@ public:
         std::swap(if_rules_, rhs.if_rules_);
         std::swap(else_rules_,rhs.else_rules_);
         std::swap(also_rules_, rhs.also_rules_);
+        std::swap(index_attribute_, rhs.index_attribute_);
+        std::swap(index_, rhs.index_);
+        std::swap(unindexed_, rhs.unindexed_);
         return *this;
     }
 
@@ -88,10 +116,131 @@ public:
         return also_rules_;
     }
 
+    // Builds a dispatch table for classification style sheets, where many
+    // if-rules test one attribute for equality with a string literal.
+    // Features can then be tested only against the rules matching their
+    // value of that attribute plus the rules that could not be indexed.
+    // Must be called again after adding rules.
+    void build_filter_index()
+    {
+        index_attribute_.clear();
+        index_.clear();
+        unindexed_.clear();
+
+        std::vector<equality_key> keys;
+        keys.reserve(if_rules_.size());
+        std::map<std::string, std::size_t> counts;
+        for (rule const* r : if_rules_)
+        {
+            keys.push_back(util::apply_visitor(equality_key_visitor(), *r->get_filter()));
+            if (keys.back().first) ++counts[*keys.back().first];
+        }
+        std::size_t best = 0;
+        for (auto const& kv : counts)
+        {
+            if (kv.second > best)
+            {
+                best = kv.second;
+                index_attribute_ = kv.first;
+            }
+        }
+        if (best < min_indexed_rules)
+        {
+            index_attribute_.clear();
+            return;
+        }
+
+        // every list keeps the original rule order
+        for (std::size_t i = 0; i < if_rules_.size(); ++i)
+        {
+            if (keys[i].first && *keys[i].first == index_attribute_)
+            {
+                auto itr = index_.find(*keys[i].second);
+                if (itr == index_.end())
+                {
+                    itr = index_.emplace(*keys[i].second, unindexed_).first;
+                }
+                itr->second.push_back({if_rules_[i], i, true});
+            }
+            else
+            {
+                filter_candidate candidate{if_rules_[i], i, false};
+                unindexed_.push_back(candidate);
+                for (auto & kv : index_)
+                {
+                    kv.second.push_back(candidate);
+                }
+            }
+        }
+    }
+
+    bool has_filter_index() const
+    {
+        return !index_attribute_.empty();
+    }
+
+    std::string const& filter_index_attribute() const
+    {
+        return index_attribute_;
+    }
+
+    // if-rules to test for a feature with the given value of the indexed attribute
+    filter_candidates const& get_filter_candidates(value const& val) const
+    {
+        if (val.is<value_unicode_string>())
+        {
+            auto itr = index_.find(val.get<value_unicode_string>());
+            if (itr != index_.end())
+            {
+                return itr->second;
+            }
+        }
+        // equality with a string literal only holds for string values
+        return unindexed_;
+    }
+
 private:
+    struct unicode_string_hash
+    {
+        std::size_t operator()(value_unicode_string const& str) const
+        {
+            return static_cast<std::size_t>(str.hashCode());
+        }
+    };
+
+    using equality_key = std::pair<std::string const*, value_unicode_string const*>;
+
+    // attribute and literal of a `[attribute] = 'literal'` filter
+    struct equality_key_visitor
+    {
+        equality_key operator() (binary_node<tags::equal_to> const& node) const
+        {
+            if (node.left.is<attribute>() && node.right.is<value_unicode_string>())
+            {
+                return equality_key(&node.left.get<attribute>().name(),
+                                    &node.right.get<value_unicode_string>());
+            }
+            if (node.right.is<attribute>() && node.left.is<value_unicode_string>())
+            {
+                return equality_key(&node.right.get<attribute>().name(),
+                                    &node.left.get<value_unicode_string>());
+            }
+            return equality_key(nullptr, nullptr);
+        }
+
+        template <typename T>
+        equality_key operator() (T const&) const
+        {
+            return equality_key(nullptr, nullptr);
+        }
+    };
+
     rule_ptrs if_rules_;
     rule_ptrs else_rules_;
     rule_ptrs also_rules_;
+    std::string index_attribute_;
+    std::unordered_map<value_unicode_string, filter_candidates, unicode_string_hash> index_;
+    filter_candidates unindexed_;
 };
 
 }
@@ -0,0 +1,94 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef MAPNIK_SOLID_TILE_CACHE_HPP
+#define MAPNIK_SOLID_TILE_CACHE_HPP
+
+// mapnik
+#include <mapnik/config.hpp>
+#include <mapnik/util/singleton.hpp>
+#include <mapnik/util/noncopyable.hpp>
+#include <mapnik/util/lru_cache.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <boost/optional.hpp>
+#pragma GCC diagnostic pop
+
+namespace mapnik
+{
+
+using solid_tile_cache_stats = util::lru_cache_stats;
+
+// Process wide cache of encoded single color rgba8 images, keyed by color,
+// size, premultiplication and format string. save_to_string consults it for
+// solid images, so ocean and land tiles are encoded once per format instead
+// of once per tile. Encodings are kept in a util::lru_cache under the
+// singleton's lock, within both max_entries and max_bytes.
+class MAPNIK_DECL solid_tile_cache :
+        public singleton<solid_tile_cache, CreateStatic>,
+        private util::noncopyable
+{
+    friend class CreateStatic<solid_tile_cache>;
+    solid_tile_cache();
+    static std::string make_key(std::uint32_t color,
+                                std::size_t width,
+                                std::size_t height,
+                                bool premultiplied,
+                                std::string const& format);
+    util::lru_cache<std::string, std::string> cache_;
+    std::atomic<bool> enabled_;
+    std::atomic<std::size_t> max_entries_;
+    std::atomic<std::size_t> max_bytes_;
+public:
+    boost::optional<std::string> find(std::uint32_t color,
+                                      std::size_t width,
+                                      std::size_t height,
+                                      bool premultiplied,
+                                      std::string const& format);
+    void insert(std::uint32_t color,
+                std::size_t width,
+                std::size_t height,
+                bool premultiplied,
+                std::string const& format,
+                std::string const& data);
+    void clear();
+    void set_enabled(bool enabled);
+    bool enabled() const;
+    // either limit is off when set to 0
+    void set_max_entries(std::size_t max_entries);
+    std::size_t max_entries() const;
+    void set_max_bytes(std::size_t max_bytes);
+    std::size_t max_bytes() const;
+    solid_tile_cache_stats stats();
+};
+
+extern template class MAPNIK_DECL singleton<solid_tile_cache, CreateStatic>;
+
+}
+
+#endif // MAPNIK_SOLID_TILE_CACHE_HPP
@@ -40,6 +40,7 @@ extern "C"
 #pragma GCC diagnostic pop
 
 //stl
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -50,7 +51,9 @@ namespace mapnik
 class MAPNIK_DECL font_face : util::noncopyable
 {
 public:
-    font_face(FT_Face face);
+    // file_name is the font file, or the key of its font memory cache entry,
+    // the face was opened from
+    font_face(FT_Face face, std::string const& file_name);
 
     std::string family_name() const
     {
@@ -72,10 +75,17 @@ public:
 
     bool glyph_dimensions(glyph_info &glyph) const;
 
+    // identifies the font in the glyph_cache
+    std::uint32_t cache_id() const
+    {
+        return cache_id_;
+    }
+
     ~font_face();
 
 private:
     FT_Face face_;
+    std::uint32_t cache_id_;
 };
 using face_ptr = std::shared_ptr<font_face>;
 
@@ -0,0 +1,95 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef MAPNIK_TEXT_FACE_POOL_HPP
+#define MAPNIK_TEXT_FACE_POOL_HPP
+
+// mapnik
+#include <mapnik/config.hpp>
+#include <mapnik/util/singleton.hpp>
+#include <mapnik/util/noncopyable.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mapnik
+{
+
+class font_face;
+using face_ptr = std::shared_ptr<font_face>;
+
+struct face_pool_stats
+{
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t evictions = 0;
+    std::size_t faces = 0;
+    // size of the font files the pooled faces are opened on
+    std::size_t font_bytes = 0;
+    std::size_t threads = 0;
+};
+
+// Faces of the globally registered fonts, kept open across renders. Every
+// thread has its own pool with its own FreeType library, so a thread only
+// ever touches faces it opened and looking one up takes no lock. Each pool
+// drops its least recently used faces beyond max_faces. face_manager asks
+// the pool for fonts the map does not register itself, on every lookup, so
+// that a renderer moved to another thread uses that thread's faces.
+class MAPNIK_DECL face_pool :
+        public singleton<face_pool, CreateStatic>,
+        private util::noncopyable
+{
+    friend class CreateStatic<face_pool>;
+    struct thread_pool;
+    face_pool();
+    void add_pool(thread_pool * pool);
+    void remove_pool(thread_pool * pool);
+    std::atomic<bool> enabled_;
+    std::atomic<std::size_t> max_faces_;
+    // pools with an older generation drop their faces
+    std::atomic<std::size_t> generation_;
+    std::vector<thread_pool*> pools_;
+    face_pool_stats retired_; // counts of pools whose threads have exited
+public:
+    // A face of the registered family `name`, opened on the calling thread,
+    // or null when the family is unknown, can't be opened or the pool is
+    // disabled.
+    face_ptr get_face(std::string const& name);
+    // faces are dropped by each thread at its next lookup
+    void clear();
+    void set_enabled(bool enabled);
+    bool enabled() const;
+    // per thread
+    void set_max_faces(std::size_t max_faces);
+    std::size_t max_faces() const;
+    face_pool_stats stats();
+};
+
+extern template class MAPNIK_DECL singleton<face_pool, CreateStatic>;
+
+}
+
+#endif // MAPNIK_TEXT_FACE_POOL_HPP
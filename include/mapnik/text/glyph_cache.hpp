@@ -0,0 +1,133 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef MAPNIK_TEXT_GLYPH_CACHE_HPP
+#define MAPNIK_TEXT_GLYPH_CACHE_HPP
+
+// mapnik
+#include <mapnik/config.hpp>
+#include <mapnik/util/singleton.hpp>
+#include <mapnik/util/noncopyable.hpp>
+#include <mapnik/util/lru_cache.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mapnik
+{
+
+// 8 bit coverage of a rasterized glyph or glyph halo, rows packed without
+// padding. left and top are relative to the whole pixel part of the pen.
+struct glyph_bitmap
+{
+    int left = 0;
+    int top = 0;
+    unsigned width = 0;
+    unsigned rows = 0;
+    std::vector<std::uint8_t> buffer;
+};
+
+using glyph_bitmap_ptr = std::shared_ptr<glyph_bitmap const>;
+
+// Everything FreeType needs to produce a glyph_bitmap, in the fixed point
+// units it is handed over in.
+struct glyph_cache_key
+{
+    std::uint32_t face_id = 0;
+    std::uint32_t glyph_index = 0;
+    std::int32_t char_size = 0; // 26.6
+    std::int32_t stroke = -1;   // halo stroke radius in 26.6, -1 for the glyph itself
+    std::int32_t xx = 0x10000;  // 16.16 rotation matrix
+    std::int32_t xy = 0;
+    std::int32_t yx = 0;
+    std::int32_t yy = 0x10000;
+    std::int32_t dx = 0;        // subpixel pen offset in 26.6
+    std::int32_t dy = 0;
+
+    bool operator==(glyph_cache_key const& rhs) const
+    {
+        return face_id == rhs.face_id && glyph_index == rhs.glyph_index &&
+            char_size == rhs.char_size && stroke == rhs.stroke &&
+            xx == rhs.xx && xy == rhs.xy && yx == rhs.yx && yy == rhs.yy &&
+            dx == rhs.dx && dy == rhs.dy;
+    }
+};
+
+struct glyph_cache_key_hash
+{
+    std::size_t operator()(glyph_cache_key const& key) const;
+};
+
+using glyph_cache_stats = util::lru_cache_stats;
+
+// Process wide cache of glyph bitmaps used by agg_text_renderer, so that
+// glyphs repeated within and across tiles are loaded, stroked and rasterized
+// once. By default the output matches uncached rendering exactly. Fewer
+// subpixel_steps positions per pixel, or rotation_steps angles per turn,
+// can be opted into so that more glyphs hit at the cost of moving them by
+// fractions of a pixel. Bitmaps live in a util::sharded_lru_cache bounded
+// by max_bytes.
+class MAPNIK_DECL glyph_cache :
+        public singleton<glyph_cache, CreateStatic>,
+        private util::noncopyable
+{
+    friend class CreateStatic<glyph_cache>;
+    glyph_cache();
+    util::sharded_lru_cache<glyph_cache_key, glyph_bitmap_ptr, glyph_cache_key_hash> cache_;
+    std::unordered_map<std::string, std::uint32_t> face_ids_;
+    std::atomic<bool> enabled_;
+    std::atomic<unsigned> subpixel_steps_;
+    std::atomic<unsigned> rotation_steps_;
+public:
+    // Small integer standing for a font, stable for the process lifetime.
+    // Fonts with the same identity string share cached glyphs.
+    std::uint32_t face_id(std::string const& identity);
+    glyph_bitmap_ptr find(glyph_cache_key const& key);
+    // returns the bitmap to draw, which is the cached one when the glyph
+    // was rasterized twice concurrently
+    glyph_bitmap_ptr insert(glyph_cache_key const& key, glyph_bitmap && bitmap);
+    void clear();
+    void set_enabled(bool enabled);
+    bool enabled() const;
+    // total size of the cached bitmaps, unbounded when 0
+    void set_max_bytes(std::size_t max_bytes);
+    std::size_t max_bytes() const;
+    // clamped to [1, 64], 64 (the default) keeps pen positions exact
+    void set_subpixel_steps(unsigned steps);
+    unsigned subpixel_steps() const;
+    // 0 (the default) keeps rotations exact
+    void set_rotation_steps(unsigned steps);
+    unsigned rotation_steps() const;
+    glyph_cache_stats stats();
+};
+
+extern template class MAPNIK_DECL singleton<glyph_cache, CreateStatic>;
+
+}
+
+#endif // MAPNIK_TEXT_GLYPH_CACHE_HPP
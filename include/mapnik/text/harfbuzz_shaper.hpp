@@ -29,6 +29,7 @@
 #include <mapnik/text/face.hpp>
 #include <mapnik/text/font_feature_settings.hpp>
 #include <mapnik/text/itemizer.hpp>
+#include <mapnik/text/shaping_cache.hpp>
 #include <mapnik/safe_cast.hpp>
 #include <mapnik/font_engine_freetype.hpp>
 
@@ -64,6 +65,38 @@ static inline const uint16_t * uchar_to_utf16(const UChar* src)
 
 struct harfbuzz_shaper
 {
+// Adds the glyphs of a cached line, scaled to the format's size
+static void add_shaped_line(text_line & line,
+                            shaped_line const& shaped,
+                            evaluated_format_properties_ptr const& format,
+                            std::vector<face_ptr> const& faces,
+                            std::map<unsigned,double> & width_map,
+                            double scale_factor)
+{
+    double size = format->text_size * scale_factor;
+    for (auto const& item : shaped)
+    {
+        double max_glyph_height = 0;
+        for (shaped_glyph const& sg : item)
+        {
+            face_ptr const& theface = faces[sg.face_index];
+            glyph_info g(sg.glyph_index, sg.char_index, format);
+            g.face = theface;
+            g.unscaled_ymin = sg.unscaled_ymin;
+            g.unscaled_ymax = sg.unscaled_ymax;
+            g.unscaled_line_height = sg.unscaled_line_height;
+            g.scale_multiplier = size / theface->get_face()->units_per_EM;
+            g.unscaled_advance = sg.unscaled_advance;
+            g.offset.set(sg.x_offset * g.scale_multiplier, sg.y_offset * g.scale_multiplier);
+            double tmp_height = g.height();
+            if (tmp_height > max_glyph_height) max_glyph_height = tmp_height;
+            width_map[sg.char_index] += g.advance();
+            line.add_glyph(std::move(g), scale_factor);
+        }
+        line.update_max_char_height(max_glyph_height);
+    }
+}
+
 static void shape_text(text_line & line,
                        text_itemizer & itemizer,
                        std::map<unsigned,double> & width_map,
@@ -75,6 +108,31 @@ static void shape_text(text_line & line,
     std::size_t length = end - start;
     if (!length) return;
 
+    // lines with a single format are looked up in the shaping cache first
+    shaping_cache & cache = shaping_cache::instance();
+    evaluated_format_properties_ptr const* single_format = cache.enabled() ? itemizer.single_format() : nullptr;
+    std::string cache_key;
+    shaped_line shaped;
+    if (single_format)
+    {
+        evaluated_format_properties_ptr const& format = *single_format;
+        face_set_ptr face_set = font_manager.get_face_set(format->face_name, format->fontset);
+        std::vector<face_ptr> faces(face_set->begin(), face_set->end());
+        std::vector<std::uint32_t> face_ids;
+        face_ids.reserve(faces.size());
+        for (face_ptr const& face : faces)
+        {
+            face_ids.push_back(face->cache_id());
+        }
+        cache_key = shaping_cache::make_key(itemizer.text(), start, end, face_ids, format->ff_settings.to_string());
+        if (shaped_line_ptr cached = cache.find(cache_key))
+        {
+            line.reserve(length);
+            add_shaped_line(line, *cached, format, faces, width_map, scale_factor);
+            return;
+        }
+    }
+
     std::list<text_item> const& list = itemizer.itemize(start, end);
 
     line.reserve(length);
@@ -86,6 +144,7 @@ static void shape_text(text_line & line,
 
     for (auto const& text_item : list)
     {
+        if (single_format) shaped.emplace_back();
         face_set_ptr face_set = font_manager.get_face_set(text_item.format_->face_name, text_item.format_->fontset);
         double size = text_item.format_->text_size * scale_factor;
         face_set->set_unscaled_character_sizes();
@@ -98,6 +157,7 @@ static void shape_text(text_line & line,
         struct glyph_face_info
         {
             face_ptr face;
+            unsigned face_index;
             hb_glyph_info_t glyph;
             hb_glyph_position_t position;
         };
@@ -144,7 +204,7 @@ static void shape_text(text_line & line,
                     {
                         ++valid_glyphs;
                     }
-                    glyphinfos[i] = { face, glyphs[i], positions[i] };
+                    glyphinfos[i] = { face, static_cast<unsigned>(pos - 1), glyphs[i], positions[i] };
                 }
             }
             if (valid_glyphs < num_glyphs && (pos < num_faces))
@@ -159,11 +219,13 @@ static void shape_text(text_line & line,
                 auto& gpos = positions[i];
                 auto& glyph = glyphs[i];
                 face_ptr theface = face;
+                unsigned face_index = static_cast<unsigned>(pos - 1);
                 if (glyphinfos[i].glyph.codepoint)
                 {
                     gpos = glyphinfos[i].position;
                     glyph = glyphinfos[i].glyph;
                     theface = glyphinfos[i].face;
+                    face_index = glyphinfos[i].face_index;
                 }
                 unsigned char_index = glyph.cluster;
                 glyph_info g(glyph.codepoint,char_index,text_item.format_);
@@ -174,6 +236,13 @@ static void shape_text(text_line & line,
                     //Overwrite default advance with better value provided by HarfBuzz
                     g.unscaled_advance = gpos.x_advance;
                     g.offset.set(gpos.x_offset * g.scale_multiplier, gpos.y_offset * g.scale_multiplier);
+                    if (single_format)
+                    {
+                        shaped.back().push_back({ face_index, g.glyph_index, char_index,
+                                    g.unscaled_ymin, g.unscaled_ymax, g.unscaled_advance,
+                                    g.unscaled_line_height,
+                                    static_cast<double>(gpos.x_offset), static_cast<double>(gpos.y_offset) });
+                    }
                     double tmp_height = g.height();
                     if (tmp_height > max_glyph_height) max_glyph_height = tmp_height;
                     width_map[char_index] += g.advance();
@@ -184,6 +253,10 @@ static void shape_text(text_line & line,
             break; //When we reach this point the current font had all glyphs.
         }
     }
+    if (single_format)
+    {
+        cache.insert(cache_key, std::move(shaped));
+    }
 }
 };
 } // namespace mapnik
@@ -82,6 +82,11 @@ public:
     std::list<text_item> const& itemize(unsigned start=0, unsigned end=0);
     void clear();
     value_unicode_string const& text() const { return text_; }
+    // Format of the whole text, nullptr if it has several.
+    evaluated_format_properties_ptr const* single_format() const
+    {
+        return (format_runs_.size() == 1) ? &format_runs_.front().data : nullptr;
+    }
     // Returns the start and end position of a certain line.
     // Only forced line breaks with \n characters are handled here.
     std::pair<unsigned, unsigned> line(unsigned i) const;
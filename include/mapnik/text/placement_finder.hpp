@@ -71,6 +71,10 @@ private:
     double get_spacing(double path_length, double layout_width) const;
     // Checks for collision.
     bool collision(box2d<double> const& box, const value_unicode_string &repeat_key, bool line_placement) const;
+    // Checks the glyphs of a line placement for collision with placed labels.
+    bool collision(std::vector<box2d<double>> const& boxes, const value_unicode_string &repeat_key) const;
+    // Checks whether a box leaves the extent where avoid-edges or minimum-padding ask for it to stay.
+    bool off_extent(box2d<double> const& box) const;
     // Adds marker to glyph_positions and to collision detector. Returns false if there is a collision.
     bool add_marker(glyph_positions_ptr & glyphs, pixel_position const& pos, std::vector<box2d<double>> & bboxes) const;
     // Maps upright==auto, left-only and right-only to left,right to simplify processing.
@@ -25,6 +25,7 @@
 
 // mapnik
 #include <mapnik/text/placement_finder.hpp>
+#include <mapnik/text/glyph_cache.hpp>
 #include <mapnik/image_compositing.hpp>
 #include <mapnik/symbolizer_enumerations.hpp>
 #include <mapnik/util/noncopyable.hpp>
@@ -118,7 +119,12 @@ public:
     void render(glyph_positions const& positions);
 private:
     pixmap_type & pixmap_;
-    void render_halo(FT_Bitmap_ *bitmap, unsigned rgba, int x, int y,
+    void render_cached(glyph_positions const& positions,
+                       FT_Vector const& start, FT_Vector const& start_halo);
+    glyph_bitmap_ptr cached_bitmap(glyph_info const& glyph, glyph_cache_key const& key,
+                                   double halo_radius);
+    void render_halo(unsigned char const* buffer, int width, int height,
+                     unsigned rgba, int x, int y,
                      double halo_radius, double opacity,
                      composite_mode_e comp_op);
 };
@@ -0,0 +1,101 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef MAPNIK_TEXT_SHAPING_CACHE_HPP
+#define MAPNIK_TEXT_SHAPING_CACHE_HPP
+
+// mapnik
+#include <mapnik/config.hpp>
+#include <mapnik/value/types.hpp>
+#include <mapnik/util/singleton.hpp>
+#include <mapnik/util/noncopyable.hpp>
+#include <mapnik/util/lru_cache.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mapnik
+{
+
+// A glyph as produced by the shaper, in font units. The face is given by
+// its position in the font set, as faces are opened again for every render.
+struct shaped_glyph
+{
+    unsigned face_index;
+    unsigned glyph_index;
+    unsigned char_index;
+    double unscaled_ymin;
+    double unscaled_ymax;
+    double unscaled_advance;
+    double unscaled_line_height;
+    double x_offset;
+    double y_offset;
+};
+
+// Glyphs of each text item of a line, in item order.
+using shaped_line = std::vector<std::vector<shaped_glyph>>;
+using shaped_line_ptr = std::shared_ptr<shaped_line const>;
+
+using shaping_cache_stats = util::lru_cache_stats;
+
+// Process wide cache of shaped lines, keyed by the text around them, the
+// range of the line, the faces of the font set and the font features.
+// Glyph shapes do not depend on the text size, so one entry serves every
+// size and scale factor. harfbuzz_shaper consults it for lines with a
+// single format, which skips itemization and shaping for labels repeated
+// across tiles. Lines are kept in a util::sharded_lru_cache bounded by
+// max_entries.
+class MAPNIK_DECL shaping_cache :
+        public singleton<shaping_cache, CreateStatic>,
+        private util::noncopyable
+{
+    friend class CreateStatic<shaping_cache>;
+    shaping_cache();
+    util::sharded_lru_cache<std::string, shaped_line_ptr> cache_;
+    std::atomic<bool> enabled_;
+public:
+    static std::string make_key(value_unicode_string const& text,
+                                unsigned start,
+                                unsigned end,
+                                std::vector<std::uint32_t> const& face_ids,
+                                std::string const& features);
+    shaped_line_ptr find(std::string const& key);
+    void insert(std::string const& key, shaped_line && line);
+    void clear();
+    void set_enabled(bool enabled);
+    bool enabled() const;
+    // number of cached lines, unbounded when 0
+    void set_max_entries(std::size_t max_entries);
+    std::size_t max_entries() const;
+    shaping_cache_stats stats();
+};
+
+extern template class MAPNIK_DECL singleton<shaping_cache, CreateStatic>;
+
+}
+
+#endif // MAPNIK_TEXT_SHAPING_CACHE_HPP
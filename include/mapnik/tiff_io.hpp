@@ -27,10 +27,14 @@
 #include <mapnik/image_util.hpp>
 #include <mapnik/image_any.hpp>
 #include <mapnik/util/variant.hpp>
+#include <mapnik/util/parallel_for.hpp>
 
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
 
+// zlib
+#include <zlib.h>
+
 extern "C"
 {
 #include <tiffio.h>
@@ -42,7 +46,10 @@ extern "C"
 
 
 //std
+#include <algorithm>
 #include <memory>
+#include <type_traits>
+#include <vector>
 
 #define TIFF_WRITE_SCANLINE 0
 #define TIFF_WRITE_STRIPPED 1
@@ -175,7 +182,8 @@ struct tiff_config
         tile_width(0),
         tile_height(0),
         rows_per_strip(0),
-        method(TIFF_WRITE_STRIPPED) {}
+        method(TIFF_WRITE_STRIPPED),
+        threads(1) {}
 
     int compression;
     int zlevel;
@@ -183,6 +191,7 @@ struct tiff_config
     int tile_height; // Tile height of zero means tile the height of the image
     int rows_per_strip;
     int method; // The method to use to write the TIFF.
+    unsigned threads; // Strips or tiles are deflated on this many threads
 
 };
 
@@ -392,6 +401,73 @@ inline void set_tiff_config(TIFF* output, tiff_config const& config)
     }
 }
 
+namespace detail {
+
+// Strip size aimed for when strips are deflated in parallel and
+// rows_per_strip is left to the writer.
+static constexpr std::size_t tiff_strip_bytes = 1 << 20;
+
+// Layout of a pixel for the horizontal predictor: rgba8 pixels are four
+// 8 bit samples, every other type is a single sample.
+template <typename Pixel>
+struct tiff_samples
+{
+    static constexpr std::size_t count = 1;
+    using type = typename std::conditional<sizeof(typename Pixel::type) == 1, std::uint8_t,
+                 typename std::conditional<sizeof(typename Pixel::type) == 2, std::uint16_t,
+                 typename std::conditional<sizeof(typename Pixel::type) == 4, std::uint32_t,
+                                           std::uint64_t>::type>::type>::type;
+};
+
+template <>
+struct tiff_samples<rgba8_t>
+{
+    static constexpr std::size_t count = 4;
+    using type = std::uint8_t;
+};
+
+// Strips and tiles are compressed outside of libtiff, which only handles one
+// at a time, and written raw. Limited to deflate with the integer predictor;
+// everything else goes through libtiff's encoders.
+template <typename T>
+bool tiff_parallel(tiff_config const& config)
+{
+    return config.threads > 1
+        && (config.compression == COMPRESSION_DEFLATE
+            || config.compression == COMPRESSION_ADOBE_DEFLATE)
+        && !std::is_floating_point<typename T::pixel_type>::value;
+}
+
+// Applies the horizontal predictor in place and deflates the rows into a
+// zlib stream, as libtiff's ZIP codec would.
+template <typename Pixel>
+void tiff_deflate(typename Pixel::type * data, std::size_t width, std::size_t rows,
+                  int zlevel, std::vector<unsigned char> & out)
+{
+    using sample_type = typename tiff_samples<Pixel>::type;
+    std::size_t const spp = tiff_samples<Pixel>::count;
+    std::size_t const row_samples = width * spp;
+    sample_type * samples = reinterpret_cast<sample_type*>(data);
+    for (std::size_t y = 0; y < rows; ++y)
+    {
+        sample_type * row = samples + y * row_samples;
+        for (std::size_t i = row_samples; i-- > spp;)
+        {
+            row[i] = static_cast<sample_type>(row[i] - row[i - spp]);
+        }
+    }
+    uLong size = static_cast<uLong>(width * rows * sizeof(typename Pixel::type));
+    uLongf out_size = compressBound(size);
+    out.resize(out_size);
+    if (compress2(out.data(), &out_size, reinterpret_cast<Bytef const*>(data), size, zlevel) != Z_OK)
+    {
+        throw image_writer_exception("Could not write TIFF - deflate failed");
+    }
+    out.resize(out_size);
+}
+
+} // namespace detail
+
 template <typename T1, typename T2>
 void save_as_tiff(T1 & file, T2 const& image, tiff_config const& config)
 {
@@ -441,12 +517,43 @@ void save_as_tiff(T1 & file, T2 const& image, tiff_config const& config)
     }
     else if (TIFF_WRITE_STRIPPED == config.method)
     {
+        bool parallel = detail::tiff_parallel<T2>(config);
         std::size_t rows_per_strip = config.rows_per_strip;
         if (0 == rows_per_strip)
         {
             rows_per_strip = height;
+            if (parallel)
+            {
+                // a single strip would leave nothing to share out
+                rows_per_strip = std::max<std::size_t>(1, detail::tiff_strip_bytes / std::max<std::size_t>(1, width * sizeof(pixel_type)));
+            }
         }
         TIFFSetField(output, TIFFTAG_ROWSPERSTRIP, rows_per_strip);
+        if (parallel)
+        {
+            std::size_t num_strips = (height + rows_per_strip - 1) / rows_per_strip;
+            std::vector<std::vector<unsigned char>> strips(num_strips);
+            util::parallel_for(num_strips, config.threads, [&](std::size_t i)
+            {
+                int y = static_cast<int>(i * rows_per_strip);
+                int ty1 = std::min(height, static_cast<int>(y + rows_per_strip)) - y;
+                std::unique_ptr<pixel_type[]> strip_buffer(new pixel_type[width * ty1]);
+                for (int ty = 0; ty < ty1; ++ty)
+                {
+                    std::copy(image.get_row(y + ty), image.get_row(y + ty) + width, strip_buffer.get() + ty * width);
+                }
+                detail::tiff_deflate<typename T2::pixel>(strip_buffer.get(), width, ty1, config.zlevel, strips[i]);
+            });
+            for (std::size_t i = 0; i < num_strips; ++i)
+            {
+                if (TIFFWriteRawStrip(output, static_cast<uint32>(i), strips[i].data(), strips[i].size()) == -1)
+                {
+                    throw image_writer_exception("Could not write TIFF - TIFF Strip Write failed");
+                }
+            }
+            RealTIFFClose(output);
+            return;
+        }
         std::size_t strip_size = width * rows_per_strip;
         std::unique_ptr<pixel_type[]> strip_buffer(new pixel_type[strip_size]);
         for (int y=0; y < height; y+=rows_per_strip)
@@ -488,6 +595,37 @@ void save_as_tiff(T1 & file, T2 const& image, tiff_config const& config)
         TIFFSetField(output, TIFFTAG_TILELENGTH, tile_height);
         TIFFSetField(output, TIFFTAG_TILEDEPTH, 1);
         std::size_t tile_size = tile_width * tile_height;
+        if (detail::tiff_parallel<T2>(config))
+        {
+            std::size_t tiles_across = (width + tile_width - 1) / tile_width;
+            std::size_t tiles_down = (height + tile_height - 1) / tile_height;
+            std::vector<std::vector<unsigned char>> tiles(tiles_across * tiles_down);
+            util::parallel_for(tiles.size(), config.threads, [&](std::size_t i)
+            {
+                int x = static_cast<int>(i % tiles_across) * tile_width;
+                int y = static_cast<int>(i / tiles_across) * tile_height;
+                int ty1 = std::min(height, y + tile_height) - y;
+                int tx1 = std::min(width, x + tile_width);
+                // value initialised, the padding is zero
+                std::unique_ptr<pixel_type[]> tile_buffer(new pixel_type[tile_size]());
+                for (int ty = 0; ty < ty1; ++ty)
+                {
+                    std::copy(image.get_row(y + ty, x), image.get_row(y + ty, tx1), tile_buffer.get() + ty * tile_width);
+                }
+                detail::tiff_deflate<typename T2::pixel>(tile_buffer.get(), tile_width, tile_height, config.zlevel, tiles[i]);
+            });
+            for (std::size_t i = 0; i < tiles.size(); ++i)
+            {
+                uint32 x = static_cast<uint32>((i % tiles_across) * tile_width);
+                uint32 y = static_cast<uint32>((i / tiles_across) * tile_height);
+                if (TIFFWriteRawTile(output, TIFFComputeTile(output, x, y, 0, 0), tiles[i].data(), tiles[i].size()) == -1)
+                {
+                    throw image_writer_exception("Could not write TIFF - TIFF Tile Write failed");
+                }
+            }
+            RealTIFFClose(output);
+            return;
+        }
         std::unique_ptr<pixel_type[]> image_out (new pixel_type[tile_size]);
         int end_y = (height / tile_height + 1) * tile_height;
         int end_x = (width / tile_width + 1) * tile_width;
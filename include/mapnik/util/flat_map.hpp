@@ -0,0 +1,117 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef MAPNIK_UTIL_FLAT_MAP_HPP
+#define MAPNIK_UTIL_FLAT_MAP_HPP
+
+// stl
+#include <algorithm>
+#include <functional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace mapnik { namespace util {
+
+// Associative container keeping its elements sorted in a contiguous vector.
+// Lookups are binary searches over cache friendly storage and iteration order
+// matches std::map. Insertion is linear, so it is meant for small, mostly
+// read maps such as feature contexts.
+template <typename Key, typename T, typename Compare = std::less<Key>>
+class flat_map
+{
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<Key, T>;
+    using container_type = std::vector<value_type>;
+    using size_type = typename container_type::size_type;
+    using difference_type = typename container_type::difference_type;
+    using iterator = typename container_type::iterator;
+    using const_iterator = typename container_type::const_iterator;
+
+    flat_map()
+        : data_() {}
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(key_type const& key, Args &&... args)
+    {
+        iterator itr = lower_bound(key);
+        if (itr != data_.end() && !comp_(key, itr->first))
+        {
+            return std::make_pair(itr, false);
+        }
+        itr = data_.emplace(itr, std::piecewise_construct,
+                            std::forward_as_tuple(key),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+        return std::make_pair(itr, true);
+    }
+
+    iterator find(key_type const& key)
+    {
+        iterator itr = lower_bound(key);
+        if (itr != data_.end() && !comp_(key, itr->first)) return itr;
+        return data_.end();
+    }
+
+    const_iterator find(key_type const& key) const
+    {
+        const_iterator itr = lower_bound(key);
+        if (itr != data_.end() && !comp_(key, itr->first)) return itr;
+        return data_.end();
+    }
+
+    size_type count(key_type const& key) const
+    {
+        return find(key) != data_.end() ? 1 : 0;
+    }
+
+    size_type size() const { return data_.size(); }
+    bool empty() const { return data_.empty(); }
+    void reserve(size_type n) { data_.reserve(n); }
+    void clear() { data_.clear(); }
+
+    iterator begin() { return data_.begin(); }
+    iterator end() { return data_.end(); }
+    const_iterator begin() const { return data_.begin(); }
+    const_iterator end() const { return data_.end(); }
+
+private:
+    iterator lower_bound(key_type const& key)
+    {
+        return std::lower_bound(data_.begin(), data_.end(), key,
+                                [this](value_type const& v, key_type const& k) { return comp_(v.first, k); });
+    }
+
+    const_iterator lower_bound(key_type const& key) const
+    {
+        return std::lower_bound(data_.begin(), data_.end(), key,
+                                [this](value_type const& v, key_type const& k) { return comp_(v.first, k); });
+    }
+
+    container_type data_;
+    Compare comp_;
+};
+
+}}
+
+#endif // MAPNIK_UTIL_FLAT_MAP_HPP
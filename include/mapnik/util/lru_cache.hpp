@@ -0,0 +1,267 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef MAPNIK_UTIL_LRU_CACHE_HPP
+#define MAPNIK_UTIL_LRU_CACHE_HPP
+
+// mapnik
+#include <mapnik/util/noncopyable.hpp>
+
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <boost/optional.hpp>
+#pragma GCC diagnostic pop
+
+// stl
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#ifdef MAPNIK_THREADSAFE
+#include <mutex>
+#endif
+
+namespace mapnik { namespace util {
+
+struct lru_cache_stats
+{
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t evictions = 0;
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+};
+
+// Map from keys to values that drops its least recently used entries once
+// evict() is given a limit they exceed. Every value is inserted with the
+// number of bytes it accounts for. Not synchronized.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class lru_cache : util::noncopyable
+{
+    struct entry
+    {
+        Value value;
+        std::size_t bytes;
+        typename std::list<Key>::iterator lru_pos;
+    };
+public:
+    lru_cache()
+        : cache_(),
+          lru_(),
+          stats_() {}
+
+    // null when the key is not cached
+    Value const* find(Key const& key)
+    {
+        auto itr = cache_.find(key);
+        if (itr == cache_.end())
+        {
+            ++stats_.misses;
+            return nullptr;
+        }
+        ++stats_.hits;
+        lru_.splice(lru_.begin(), lru_, itr->second.lru_pos);
+        return &itr->second.value;
+    }
+
+    // keeps and returns the value already cached under `key`, if any
+    Value const& insert(Key const& key, Value value, std::size_t bytes = 0)
+    {
+        auto itr = cache_.find(key);
+        if (itr != cache_.end()) return itr->second.value;
+        lru_.push_front(key);
+        itr = cache_.emplace(key, entry{std::move(value), bytes, lru_.begin()}).first;
+        stats_.bytes += bytes;
+        return itr->second.value;
+    }
+
+    // a limit of 0 means no limit
+    void evict(std::size_t max_entries, std::size_t max_bytes)
+    {
+        while (!lru_.empty() &&
+               ((max_entries > 0 && cache_.size() > max_entries) ||
+                (max_bytes > 0 && stats_.bytes > max_bytes)))
+        {
+            auto itr = cache_.find(lru_.back());
+            stats_.bytes -= itr->second.bytes;
+            cache_.erase(itr);
+            lru_.pop_back();
+            ++stats_.evictions;
+        }
+    }
+
+    // drops all entries, the hit, miss and eviction counts are kept
+    void clear()
+    {
+        cache_.clear();
+        lru_.clear();
+        stats_.bytes = 0;
+    }
+
+    lru_cache_stats stats() const
+    {
+        lru_cache_stats result = stats_;
+        result.entries = cache_.size();
+        return result;
+    }
+
+private:
+    std::unordered_map<Key, entry, Hash> cache_;
+    std::list<Key> lru_; // most recently used first
+    lru_cache_stats stats_;
+};
+
+// lru_cache split by key hash into shards with a lock each, for caches hit
+// by many rendering threads at once. The limits are divided evenly between
+// the shards, so an entry may be dropped a little before the whole cache is
+// full. Values are handed out by copy and are typically shared pointers.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, std::size_t Shards = 16>
+class sharded_lru_cache : util::noncopyable
+{
+    struct shard
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::mutex mutex;
+#endif
+        lru_cache<Key, Value, Hash> cache;
+    };
+public:
+    sharded_lru_cache(std::size_t max_entries, std::size_t max_bytes)
+        : shards_(),
+          max_entries_(max_entries),
+          max_bytes_(max_bytes) {}
+
+    boost::optional<Value> find(Key const& key)
+    {
+        shard & s = shard_for(key);
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(s.mutex);
+#endif
+        Value const* value = s.cache.find(key);
+        if (value == nullptr) return boost::optional<Value>();
+        return boost::optional<Value>(*value);
+    }
+
+    // the cached value, which is an earlier one when another thread
+    // inserted the same key first
+    Value insert(Key const& key, Value value, std::size_t bytes = 0)
+    {
+        shard & s = shard_for(key);
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(s.mutex);
+#endif
+        Value result = s.cache.insert(key, std::move(value), bytes);
+        evict(s);
+        return result;
+    }
+
+    void clear()
+    {
+        for (shard & s : shards_)
+        {
+#ifdef MAPNIK_THREADSAFE
+            std::lock_guard<std::mutex> lock(s.mutex);
+#endif
+            s.cache.clear();
+        }
+    }
+
+    // 0 means no limit
+    void set_max_entries(std::size_t max_entries)
+    {
+        max_entries_ = max_entries;
+        evict_all();
+    }
+
+    std::size_t max_entries() const
+    {
+        return max_entries_;
+    }
+
+    // 0 means no limit
+    void set_max_bytes(std::size_t max_bytes)
+    {
+        max_bytes_ = max_bytes;
+        evict_all();
+    }
+
+    std::size_t max_bytes() const
+    {
+        return max_bytes_;
+    }
+
+    lru_cache_stats stats()
+    {
+        lru_cache_stats result;
+        for (shard & s : shards_)
+        {
+#ifdef MAPNIK_THREADSAFE
+            std::lock_guard<std::mutex> lock(s.mutex);
+#endif
+            lru_cache_stats stats = s.cache.stats();
+            result.hits += stats.hits;
+            result.misses += stats.misses;
+            result.evictions += stats.evictions;
+            result.entries += stats.entries;
+            result.bytes += stats.bytes;
+        }
+        return result;
+    }
+
+private:
+    shard & shard_for(Key const& key)
+    {
+        return shards_[Hash()(key) % Shards];
+    }
+
+    static std::size_t shard_limit(std::size_t limit)
+    {
+        return (limit > 0) ? std::max<std::size_t>(limit / Shards, 1) : 0;
+    }
+
+    void evict(shard & s)
+    {
+        s.cache.evict(shard_limit(max_entries_), shard_limit(max_bytes_));
+    }
+
+    void evict_all()
+    {
+        for (shard & s : shards_)
+        {
+#ifdef MAPNIK_THREADSAFE
+            std::lock_guard<std::mutex> lock(s.mutex);
+#endif
+            evict(s);
+        }
+    }
+
+    std::array<shard, Shards> shards_;
+    std::atomic<std::size_t> max_entries_;
+    std::atomic<std::size_t> max_bytes_;
+};
+
+}}
+
+#endif // MAPNIK_UTIL_LRU_CACHE_HPP
@@ -0,0 +1,112 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef MAPNIK_UTIL_PARALLEL_FOR_HPP
+#define MAPNIK_UTIL_PARALLEL_FOR_HPP
+
+// stl
+#include <cstddef>
+#ifdef MAPNIK_THREADSAFE
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+#endif
+
+namespace mapnik { namespace util {
+
+// Calls func(i) for every i in [0, count) using up to `threads` threads,
+// the calling thread included. Items are handed out one at a time so uneven
+// work balances itself. The first exception thrown by an item (in item order)
+// is rethrown once all threads have finished. If a thread cannot be started
+// the threads already running are joined and the error is rethrown. Without
+// MAPNIK_THREADSAFE the items are processed in order on the calling thread.
+template <typename F>
+void parallel_for(std::size_t count, unsigned threads, F && func)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::size_t num_threads = std::min<std::size_t>(threads, count);
+    if (num_threads > 1)
+    {
+        std::atomic<std::size_t> next(0);
+        std::vector<std::exception_ptr> errors(count);
+        auto worker = [&]()
+        {
+            std::size_t i;
+            while ((i = next++) < count)
+            {
+                try
+                {
+                    func(i);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            }
+        };
+        // the calling thread is the last worker
+        std::vector<std::thread> workers;
+        workers.reserve(num_threads - 1);
+        try
+        {
+            for (std::size_t i = 1; i < num_threads; ++i)
+            {
+                workers.emplace_back(worker);
+            }
+        }
+        catch (...)
+        {
+            // stop handing out items, and wait for the threads already
+            // running before reporting that one could not be started
+            next = count;
+            for (std::thread & t : workers)
+            {
+                t.join();
+            }
+            throw;
+        }
+        worker();
+        for (std::thread & t : workers)
+        {
+            t.join();
+        }
+        for (std::exception_ptr const& error : errors)
+        {
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+        return;
+    }
+#endif
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        func(i);
+    }
+}
+
+}}
+
+#endif // MAPNIK_UTIL_PARALLEL_FOR_HPP
@@ -28,9 +28,15 @@
 #include <mapnik/geometry/box2d.hpp>
 #include <mapnik/query.hpp>
 #include <mapnik/geom_util.hpp>
+#include <mapnik/packed_rtree.hpp>
 // stl
-#include <type_traits>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 using mapnik::box2d;
 using mapnik::query;
@@ -38,15 +44,160 @@ using mapnik::query;
 namespace mapnik { namespace util {
 
 
+inline bool is_packed_rtree(char const* header)
+{
+    return std::strncmp(header, "mapnik-rtree", 12) == 0;
+}
+
+// accepts both the quadtree and the packed R-tree index formats
 template <typename InputStream>
 bool check_spatial_index(InputStream& in)
 {
     char header[17]; // mapnik-index
     std::memset(header, 0, 17);
     in.read(header,16);
-    return (std::strncmp(header, "mapnik-index",12) == 0);
+    return (std::strncmp(header, "mapnik-index",12) == 0) || is_packed_rtree(header);
 }
 
+// Layout of a mapnik::packed_rtree index, read from its header. The
+// offsets of the boxes and items are validated against the index size
+// once, and queries fetch only the ranges of boxes and items they visit
+// through a read_at(offset, dst, size) callable, so the same code serves
+// indexes held in memory and indexes read from a stream.
+template <typename Value, typename BBox = box2d<double> >
+class packed_rtree_layout
+{
+    using bbox_type = BBox;
+public:
+    static constexpr std::size_t header_size = 16 + 8;
+
+    // `header` holds the first header_size bytes of an index of `size` bytes
+    packed_rtree_layout(char const* header, std::size_t size)
+    {
+        static_assert(std::is_standard_layout<Value>::value, "Values stored in packed R-tree must be standard layout type");
+        if (header == nullptr || size < header_size + sizeof(bbox_type) || !is_packed_rtree(header))
+        {
+            throw std::runtime_error("Invalid packed R-tree index file");
+        }
+        std::uint32_t node_size = read_ndr_integer(header + 16);
+        std::uint32_t num_items = read_ndr_integer(header + 20);
+        if (node_size < 2) throw std::runtime_error("Invalid packed R-tree index file: bad node size");
+        node_size_ = node_size;
+        levels_ = mapnik::detail::packed_rtree_levels(num_items, node_size);
+        boxes_ = header_size + sizeof(bbox_type);
+        values_ = boxes_ + levels_.back() * sizeof(bbox_type);
+        if (values_ > size || static_cast<std::size_t>(num_items) * sizeof(Value) > size - values_)
+        {
+            throw std::runtime_error("Invalid packed R-tree index file: truncated");
+        }
+    }
+
+    // offset of the extent of the whole index
+    static constexpr std::size_t extent_offset() { return header_size; }
+
+    template <typename Filter, typename ReadAt>
+    void query_first_n(Filter const& filter, std::vector<Value>& results, std::size_t count, ReadAt && read_at) const
+    {
+        if (levels_.front() == 0) return; // empty
+        std::size_t root = levels_.back() - 1;
+        bbox_type root_box;
+        read_at(boxes_ + root * sizeof(bbox_type), reinterpret_cast<char*>(&root_box), sizeof(bbox_type));
+        if (!filter.pass(root_box)) return;
+        // node index and level of nodes whose box passed the filter,
+        // children are pushed in reverse to visit them in order
+        std::vector<std::pair<std::size_t, std::size_t>> stack;
+        stack.emplace_back(root, levels_.size() - 1);
+        std::vector<bbox_type> boxes;
+        std::vector<Value> items;
+        while (!stack.empty() && results.size() < count)
+        {
+            std::size_t index = stack.back().first;
+            std::size_t level = stack.back().second - 1;
+            stack.pop_back();
+            // the children of a node are stored next to each other
+            std::size_t level_begin = level > 0 ? levels_[level - 1] : 0;
+            std::size_t first = level_begin + (index - levels_[level]) * node_size_;
+            std::size_t last = std::min(first + node_size_, levels_[level]);
+            std::size_t num_children = last - first;
+            boxes.resize(num_children);
+            read_at(boxes_ + first * sizeof(bbox_type), reinterpret_cast<char*>(boxes.data()),
+                    num_children * sizeof(bbox_type));
+            if (level > 0)
+            {
+                for (std::size_t i = num_children; i-- > 0;)
+                {
+                    if (filter.pass(boxes[i])) stack.emplace_back(first + i, level);
+                }
+                continue;
+            }
+            bool items_read = false;
+            for (std::size_t i = 0; i < num_children && results.size() < count; ++i)
+            {
+                if (!filter.pass(boxes[i])) continue;
+                if (!items_read)
+                {
+                    items.resize(num_children);
+                    read_at(values_ + first * sizeof(Value), reinterpret_cast<char*>(items.data()),
+                            num_children * sizeof(Value));
+                    items_read = true;
+                }
+                results.push_back(items[i]);
+            }
+        }
+    }
+
+private:
+    static std::uint32_t read_ndr_integer(char const* data)
+    {
+        unsigned char const* b = reinterpret_cast<unsigned char const*>(data);
+        return b[0] | b[1] << 8 | b[2] << 16 | static_cast<std::uint32_t>(b[3]) << 24;
+    }
+
+    std::size_t node_size_;
+    std::vector<std::size_t> levels_;
+    std::size_t boxes_;  // offset of the boxes
+    std::size_t values_; // offset of the items
+};
+
+// Reads a mapnik::packed_rtree index held in memory. The contents are
+// validated against the buffer size once on construction.
+template <typename Value, typename Filter, typename BBox = box2d<double> >
+class packed_rtree_view
+{
+    using bbox_type = BBox;
+    using layout_type = packed_rtree_layout<Value, BBox>;
+public:
+    packed_rtree_view(char const* data, std::size_t size)
+        : data_(data),
+          layout_(data, size) {}
+
+    bbox_type bounding_box() const
+    {
+        bbox_type box;
+        std::memcpy(reinterpret_cast<char*>(&box), data_ + layout_type::extent_offset(), sizeof(bbox_type));
+        return box;
+    }
+
+    void query(Filter const& filter, std::vector<Value>& results) const
+    {
+        query_first_n(filter, results, std::numeric_limits<std::size_t>::max());
+    }
+
+    void query_first_n(Filter const& filter, std::vector<Value>& results, std::size_t count) const
+    {
+        char const* data = data_;
+        layout_.query_first_n(filter, results, count,
+                              [data](std::size_t offset, char * dst, std::size_t size)
+                              {
+                                  std::memcpy(dst, data + offset, size);
+                              });
+    }
+
+private:
+    char const* data_;
+    layout_type layout_;
+};
+
 template <typename Value, typename Filter, typename InputStream, typename BBox = box2d<double> >
 class spatial_index
 {
@@ -62,6 +213,9 @@ private:
     spatial_index& operator=(spatial_index const&);
     static int read_ndr_integer(InputStream& in);
     static void read_envelope(InputStream& in, bbox_type& envelope);
+    using packed_layout = packed_rtree_layout<Value, BBox>;
+    static std::unique_ptr<packed_layout> read_packed(InputStream& in);
+    static void read_at(InputStream& in, std::size_t offset, char * dst, std::size_t size);
     static void query_node(Filter const& filter, InputStream& in, std::vector<Value> & results);
     static void query_first_n_impl(Filter const& filter, InputStream& in, std::vector<Value> & results, std::size_t count);
 };
@@ -70,7 +224,13 @@ template <typename Value, typename Filter, typename InputStream, typename BBox>
 BBox spatial_index<Value, Filter, InputStream, BBox>::bounding_box(InputStream& in)
 {
     static_assert(std::is_standard_layout<Value>::value, "Values stored in quad-tree must be standard layout type");
-    if (!check_spatial_index(in)) throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+    if (read_packed(in))
+    {
+        typename spatial_index<Value, Filter, InputStream, BBox>::bbox_type box;
+        read_at(in, packed_layout::extent_offset(), reinterpret_cast<char*>(&box), sizeof(box));
+        in.seekg(0, std::ios::beg);
+        return box;
+    }
     in.seekg(16 + 4, std::ios::beg);
     typename spatial_index<Value, Filter, InputStream, BBox>::bbox_type box;
     read_envelope(in, box);
@@ -82,7 +242,16 @@ template <typename Value, typename Filter, typename InputStream, typename BBox>
 void spatial_index<Value, Filter, InputStream, BBox>::query(Filter const& filter, InputStream& in, std::vector<Value>& results)
 {
     static_assert(std::is_standard_layout<Value>::value, "Values stored in quad-tree must be standard layout type");
-    if (!check_spatial_index(in)) throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+    if (auto packed = read_packed(in))
+    {
+        packed->query_first_n(filter, results, std::numeric_limits<std::size_t>::max(),
+                              [&in](std::size_t offset, char * dst, std::size_t size)
+                              {
+                                  read_at(in, offset, dst, size);
+                              });
+        in.seekg(0, std::ios::beg);
+        return;
+    }
     in.seekg(16, std::ios::beg);
     query_node(filter, in, results);
 }
@@ -118,7 +287,16 @@ template <typename Value, typename Filter, typename InputStream, typename BBox>
 void spatial_index<Value, Filter, InputStream, BBox>::query_first_n(Filter const& filter, InputStream& in, std::vector<Value>& results, std::size_t count)
 {
     static_assert(std::is_standard_layout<Value>::value, "Values stored in quad-tree must be standard layout type");
-    if (!check_spatial_index(in)) throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+    if (auto packed = read_packed(in))
+    {
+        packed->query_first_n(filter, results, count,
+                              [&in](std::size_t offset, char * dst, std::size_t size)
+                              {
+                                  read_at(in, offset, dst, size);
+                              });
+        in.seekg(0, std::ios::beg);
+        return;
+    }
     in.seekg(16, std::ios::beg);
     query_first_n_impl(filter, in, results, count);
 }
@@ -164,6 +342,230 @@ void spatial_index<Value, Filter, InputStream, BBox>::read_envelope(InputStream&
     in.read(reinterpret_cast<char*>(&envelope), sizeof(envelope));
 }
 
+// Checks the header and leaves a quadtree index positioned after it.
+// For a packed R-tree only the header is read and its layout returned;
+// queries then seek to the boxes and items they visit.
+template <typename Value, typename Filter, typename InputStream, typename BBox>
+std::unique_ptr<typename spatial_index<Value, Filter, InputStream, BBox>::packed_layout>
+spatial_index<Value, Filter, InputStream, BBox>::read_packed(InputStream& in)
+{
+    char header[packed_layout::header_size + 1];
+    std::memset(header, 0, sizeof(header));
+    in.read(header, 16);
+    if (is_packed_rtree(header))
+    {
+        in.read(header + 16, packed_layout::header_size - 16);
+        in.seekg(0, std::ios::end);
+        std::streamoff size = in.tellg();
+        in.seekg(0, std::ios::beg);
+        return std::unique_ptr<packed_layout>(new packed_layout(header, size > 0 ? static_cast<std::size_t>(size) : 0));
+    }
+    if (std::strncmp(header, "mapnik-index", 12) != 0)
+    {
+        throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+    }
+    return std::unique_ptr<packed_layout>();
+}
+
+template <typename Value, typename Filter, typename InputStream, typename BBox>
+void spatial_index<Value, Filter, InputStream, BBox>::read_at(InputStream& in, std::size_t offset, char * dst, std::size_t size)
+{
+    in.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+    in.read(dst, static_cast<std::streamsize>(size));
+}
+
+// Reads an index held in memory, typically a mapped region, without going
+// through a stream. The tree is walked iteratively over the pre-order node
+// layout, skipping rejected subtrees by their stored size; every read is
+// bounds checked and a malformed index throws instead of reading past the
+// buffer. cache_nodes() decodes the node headers once so that subsequent
+// queries only scan a flat array.
+template <typename Value, typename Filter, typename BBox = box2d<double> >
+class spatial_index_view
+{
+    using bbox_type = BBox;
+    static constexpr std::size_t header_size = 16;
+    static constexpr std::size_t node_header_size = 4 + sizeof(bbox_type) + 4;
+
+    struct node
+    {
+        bbox_type ext;
+        std::size_t items;     // offset of the first item
+        std::size_t num_items;
+        std::size_t skip;      // index of the first node after this subtree
+    };
+public:
+    spatial_index_view(char const* data, std::size_t size)
+        : data_(data),
+          size_(size),
+          nodes_(),
+          packed_()
+    {
+        static_assert(std::is_standard_layout<Value>::value, "Values stored in quad-tree must be standard layout type");
+        if (data_ != nullptr && size_ >= header_size && is_packed_rtree(data_))
+        {
+            packed_ = std::make_shared<packed_rtree_view<Value, Filter, BBox>>(data_, size_);
+        }
+        else if (data_ == nullptr || size_ < header_size + node_header_size ||
+                 std::strncmp(data_, "mapnik-index", 12) != 0)
+        {
+            throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+        }
+    }
+
+    bbox_type bounding_box() const
+    {
+        if (packed_) return packed_->bounding_box();
+        bbox_type box;
+        std::memcpy(reinterpret_cast<char*>(&box), data_ + header_size + 4, sizeof(bbox_type));
+        return box;
+    }
+
+    void query(Filter const& filter, std::vector<Value>& results) const
+    {
+        query_first_n(filter, results, std::numeric_limits<std::size_t>::max());
+    }
+
+    void query_first_n(Filter const& filter, std::vector<Value>& results, std::size_t count) const
+    {
+        if (packed_)
+        {
+            packed_->query_first_n(filter, results, count);
+            return;
+        }
+        if (!nodes_.empty())
+        {
+            std::size_t i = 0;
+            while (i < nodes_.size() && results.size() < count)
+            {
+                node const& n = nodes_[i];
+                if (filter.pass(n.ext))
+                {
+                    read_items(n.items, n.num_items, results, count);
+                    ++i;
+                }
+                else
+                {
+                    i = n.skip;
+                }
+            }
+            return;
+        }
+        std::size_t pos = header_size;
+        std::size_t end = size_;
+        while (pos < end && results.size() < count)
+        {
+            bbox_type ext;
+            std::size_t children_size, num_items;
+            read_node_header(pos, ext, children_size, num_items);
+            std::size_t items = pos + node_header_size;
+            std::size_t children = items + num_items * sizeof(Value) + 4;
+            if (pos == header_size)
+            {
+                // the root subtree spans the rest of the index
+                end = checked_end(children, children_size);
+            }
+            if (filter.pass(ext))
+            {
+                read_items(items, num_items, results, count);
+                pos = children;
+            }
+            else
+            {
+                pos = checked_end(children, children_size);
+            }
+        }
+    }
+
+    void cache_nodes()
+    {
+        // packed R-trees are flat already
+        if (packed_ || !nodes_.empty()) return;
+        std::vector<node> nodes;
+        // indices of the nodes whose subtree is still being decoded
+        std::vector<std::pair<std::size_t, std::size_t>> open; // node, end offset
+        std::size_t pos = header_size;
+        std::size_t end = size_;
+        while (pos < end)
+        {
+            while (!open.empty() && open.back().second <= pos)
+            {
+                nodes[open.back().first].skip = nodes.size();
+                open.pop_back();
+            }
+            node n;
+            std::size_t children_size;
+            read_node_header(pos, n.ext, children_size, n.num_items);
+            n.items = pos + node_header_size;
+            std::size_t children = n.items + n.num_items * sizeof(Value) + 4;
+            std::size_t subtree_end = checked_end(children, children_size);
+            if (pos == header_size) end = subtree_end;
+            open.emplace_back(nodes.size(), subtree_end);
+            nodes.push_back(n);
+            pos = children;
+        }
+        for (auto const& item : open)
+        {
+            nodes[item.first].skip = nodes.size();
+        }
+        nodes_ = std::move(nodes);
+    }
+
+    bool nodes_cached() const
+    {
+        return packed_ || !nodes_.empty();
+    }
+
+private:
+    std::size_t checked_end(std::size_t pos, std::size_t length) const
+    {
+        if (pos > size_ || length > size_ - pos)
+        {
+            throw std::runtime_error("Invalid index file: node exceeds file size");
+        }
+        return pos + length;
+    }
+
+    std::int32_t read_ndr_integer(std::size_t pos) const
+    {
+        unsigned char const* b = reinterpret_cast<unsigned char const*>(data_ + pos);
+        return static_cast<std::int32_t>(b[0] | b[1] << 8 | b[2] << 16 | static_cast<std::uint32_t>(b[3]) << 24);
+    }
+
+    void read_node_header(std::size_t pos, bbox_type & ext,
+                          std::size_t & children_size, std::size_t & num_items) const
+    {
+        checked_end(pos, node_header_size);
+        std::int32_t offset = read_ndr_integer(pos);
+        std::memcpy(reinterpret_cast<char*>(&ext), data_ + pos + 4, sizeof(bbox_type));
+        std::int32_t num_shapes = read_ndr_integer(pos + 4 + sizeof(bbox_type));
+        if (offset < 0 || num_shapes < 0)
+        {
+            throw std::runtime_error("Invalid index file: negative node size");
+        }
+        children_size = static_cast<std::size_t>(offset);
+        num_items = static_cast<std::size_t>(num_shapes);
+        // items and the children count
+        checked_end(pos + node_header_size, num_items * sizeof(Value) + 4);
+    }
+
+    void read_items(std::size_t pos, std::size_t num_items,
+                    std::vector<Value>& results, std::size_t count) const
+    {
+        for (std::size_t i = 0; i < num_items && results.size() < count; ++i)
+        {
+            Value item;
+            std::memcpy(&item, data_ + pos + i * sizeof(Value), sizeof(Value));
+            results.push_back(std::move(item));
+        }
+    }
+
+    char const* data_;
+    std::size_t size_;
+    std::vector<node> nodes_;
+    std::shared_ptr<packed_rtree_view<Value, Filter, BBox> const> packed_;
+};
+
 }} // mapnik/util
 
 #endif // MAPNIK_UTIL_SPATIAL_INDEX_HPP
@@ -34,13 +34,13 @@ namespace mapnik
 class view_transform
 {
 private:
-    const int width_;
-    const int height_;
-    const box2d<double> extent_;
-    const double sx_;
-    const double sy_;
-    const double offset_x_;
-    const double offset_y_;
+    int width_;
+    int height_;
+    box2d<double> extent_;
+    double sx_;
+    double sy_;
+    double offset_x_;
+    double offset_y_;
     int offset_;
 public:
 
@@ -56,6 +56,7 @@ public:
           offset_(0) {}
 
     view_transform(view_transform const&) = default;
+    view_transform & operator=(view_transform const&) = default;
 
     inline int offset() const
     {
@@ -62,11 +62,19 @@ geojson_index_featureset::geojson_index_featureset(std::string const& filename,
     if (!file_) throw std::runtime_error("Can't open " + filename);
 #endif
     std::string indexname = filename + ".index";
+#if defined (MAPNIK_MEMORY_MAPPED_FILE)
+    boost::optional<mapnik::mapped_region_ptr> index =
+        mapnik::mapped_memory_cache::instance().find(indexname, true);
+    if (!index) throw mapnik::datasource_exception("GeoJSON Plugin: can't open index file " + indexname);
+    mapnik::util::spatial_index_view<value_type, mapnik::filter_in_box>(
+        static_cast<char const*>((*index)->get_address()), (*index)->get_size()).query(filter, positions_);
+#else
     std::ifstream index(indexname.c_str(), std::ios::binary);
     if (!index) throw mapnik::datasource_exception("GeoJSON Plugin: can't open index file " + indexname);
     mapnik::util::spatial_index<value_type,
                                 mapnik::filter_in_box,
                                 std::ifstream>::query(filter, index, positions_);
+#endif
 
     std::sort(positions_.begin(), positions_.end(),
               [](value_type const& lhs, value_type const& rhs) { return lhs.first < rhs.first;});
@@ -66,7 +66,8 @@ shape_index_featureset<filterT>::shape_index_featureset(filterT const& filter,
     if (index)
     {
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
-        mapnik::util::spatial_index<mapnik::detail::node, filterT,boost::interprocess::ibufferstream>::query(filter, index->file(), offsets_);
+        auto buffer = index->file().buffer();
+        mapnik::util::spatial_index_view<mapnik::detail::node, filterT>(buffer.first, buffer.second).query(filter, offsets_);
 #else
         mapnik::util::spatial_index<mapnik::detail::node, filterT, std::ifstream>::query(filter, index->file(), offsets_);
 #endif
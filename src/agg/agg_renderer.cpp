@@ -63,7 +63,9 @@
 #pragma GCC diagnostic pop
 
 // stl
+#include <algorithm>
 #include <cmath>
+#include <stdexcept>
 
 namespace mapnik
 {
@@ -73,6 +75,7 @@ agg_renderer<T0,T1>::agg_renderer(Map const& m, T0 & pixmap, double scale_factor
     : feature_style_processor<agg_renderer>(m, scale_factor),
       pixmap_(pixmap),
       internal_buffer_(),
+      internal_dirty_(),
       current_buffer_(&pixmap),
       style_level_compositing_(false),
       ras_ptr(new rasterizer),
@@ -88,6 +91,7 @@ agg_renderer<T0,T1>::agg_renderer(Map const& m, request const& req, attributes c
     : feature_style_processor<agg_renderer>(m, scale_factor),
       pixmap_(pixmap),
       internal_buffer_(),
+      internal_dirty_(),
       current_buffer_(&pixmap),
       style_level_compositing_(false),
       ras_ptr(new rasterizer),
@@ -98,12 +102,31 @@ agg_renderer<T0,T1>::agg_renderer(Map const& m, request const& req, attributes c
     setup(m);
 }
 
+template <typename T0, typename T1>
+agg_renderer<T0,T1>::agg_renderer(Map const& m, request const& req, attributes const& vars, T0 & pixmap,
+                                  std::shared_ptr<T1> detector,
+                                  double scale_factor, unsigned offset_x, unsigned offset_y)
+    : feature_style_processor<agg_renderer>(m, scale_factor),
+      pixmap_(pixmap),
+      internal_buffer_(),
+      internal_dirty_(),
+      current_buffer_(&pixmap),
+      style_level_compositing_(false),
+      ras_ptr(new rasterizer),
+      gamma_method_(GAMMA_POWER),
+      gamma_(1.0),
+      common_(m, req, vars, offset_x, offset_y, req.width(), req.height(), scale_factor, detector)
+{
+    setup(m);
+}
+
 template <typename T0, typename T1>
 agg_renderer<T0,T1>::agg_renderer(Map const& m, T0 & pixmap, std::shared_ptr<T1> detector,
                               double scale_factor, unsigned offset_x, unsigned offset_y)
     : feature_style_processor<agg_renderer>(m, scale_factor),
       pixmap_(pixmap),
       internal_buffer_(),
+      internal_dirty_(),
       current_buffer_(&pixmap),
       style_level_compositing_(false),
       ras_ptr(new rasterizer),
@@ -194,6 +217,21 @@ void agg_renderer<T0,T1>::setup(Map const &m)
 template <typename T0, typename T1>
 agg_renderer<T0,T1>::~agg_renderer() {}
 
+template <typename T0, typename T1>
+void agg_renderer<T0,T1>::reset(request const& req, attributes const& vars, unsigned offset_x, unsigned offset_y)
+{
+    if (req.width() > pixmap_.width() || req.height() > pixmap_.height())
+    {
+        throw std::runtime_error("agg_renderer: request does not fit the target image");
+    }
+    common_.reset(req, vars, offset_x, offset_y);
+    current_buffer_ = &pixmap_;
+    style_level_compositing_ = false;
+    mapnik::fill(pixmap_, 0);
+    pixmap_.painted(false);
+    setup(this->map());
+}
+
 template <typename T0, typename T1>
 void agg_renderer<T0,T1>::start_map_processing(Map const& map)
 {
@@ -234,6 +272,115 @@ void agg_renderer<T0,T1>::end_layer_processing(layer const&)
     MAPNIK_LOG_DEBUG(agg_renderer) << "agg_renderer: End layer processing";
 }
 
+namespace {
+
+// comp-ops leaving the destination untouched where the source is fully
+// transparent, so only the painted part of a style needs compositing
+bool transparent_is_noop(composite_mode_e mode)
+{
+    switch (mode)
+    {
+    case dst:
+    case src_over:
+    case dst_over:
+    case src_atop:
+    case _xor:
+    case plus:
+    case minus:
+    case multiply:
+    case screen:
+    case overlay:
+    case darken:
+    case lighten:
+    case color_dodge:
+    case color_burn:
+    case hard_light:
+    case soft_light:
+    case difference:
+    case exclusion:
+    case invert:
+    case invert_rgb:
+    case grain_merge:
+    case hue:
+    case saturation:
+    case _color:
+    case _value:
+    case linear_dodge:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// How far image filters spread painted pixels into transparent ones. Filters
+// that can make transparent pixels visible on their own have to see the
+// whole buffer.
+struct filter_spread_visitor
+{
+    filter_spread_visitor(int & spread, bool & local, double scale_factor)
+        : spread_(spread), local_(local), scale_factor_(scale_factor) {}
+
+    template <typename T>
+    void operator() (T const&) const {}
+
+    void operator() (filter::blur const&) const { spread_ += 1; }
+    void operator() (filter::emboss const&) const { spread_ += 1; }
+    void operator() (filter::sharpen const&) const { spread_ += 1; }
+    void operator() (filter::edge_detect const&) const { spread_ += 1; }
+    void operator() (filter::sobel const&) const { spread_ += 1; }
+
+    void operator() (filter::agg_stack_blur const& op) const
+    {
+        spread_ += static_cast<int>(std::max(op.rx, op.ry) * scale_factor_) + 1;
+    }
+
+    void operator() (filter::x_gradient const&) const { local_ = false; }
+    void operator() (filter::y_gradient const&) const { local_ = false; }
+
+    int & spread_;
+    bool & local_;
+    double scale_factor_;
+};
+
+// bounding box of the pixels that are not fully transparent black
+template <typename T>
+box2d<int> painted_extent(T const& image)
+{
+    using pixel_type = typename T::pixel_type;
+    int width = static_cast<int>(image.width());
+    int height = static_cast<int>(image.height());
+    box2d<int> extent;
+    for (int y = 0; y < height; ++y)
+    {
+        pixel_type const* row = image.get_row(y);
+        pixel_type any = 0;
+        for (int x = 0; x < width; ++x)
+        {
+            any |= row[x];
+        }
+        if (any == 0) continue;
+        int x0 = 0;
+        while (row[x0] == 0) ++x0;
+        int x1 = width;
+        while (row[x1 - 1] == 0) --x1;
+        extent.expand_to_include(x0, y);
+        extent.expand_to_include(x1, y + 1);
+    }
+    return extent;
+}
+
+template <typename T>
+void clear_region(T & image, box2d<int> const& region)
+{
+    if (!region.valid()) return;
+    for (int y = region.miny(); y < region.maxy(); ++y)
+    {
+        std::fill(image.get_row(y, region.minx()), image.get_row(y, region.maxx()), 0);
+    }
+}
+
+}
+
 template <typename T0, typename T1>
 void agg_renderer<T0,T1>::start_style_processing(feature_type_style const& st)
 {
@@ -271,25 +418,24 @@ void agg_renderer<T0,T1>::start_style_processing(feature_type_style const& st)
                 internal_buffer_->height() < target_height))
             {
                 internal_buffer_ = std::make_shared<buffer_type>(target_width,target_height);
-            }
-            else
-            {
-                mapnik::fill(*internal_buffer_, 0); // fill with transparent colour
+                internal_dirty_ = box2d<int>();
             }
         }
         else
         {
-            if (!internal_buffer_)
+            if (!internal_buffer_ ||
+               (internal_buffer_->width() < common_.width_ ||
+                internal_buffer_->height() < common_.height_))
             {
                 internal_buffer_ = std::make_shared<buffer_type>(common_.width_,common_.height_);
-            }
-            else
-            {
-                mapnik::fill(*internal_buffer_, 0); // fill with transparent colour
+                internal_dirty_ = box2d<int>();
             }
             common_.t_.set_offset(0);
             ras_ptr->clip_box(0,0,common_.width_,common_.height_);
         }
+        // only what the previous style left behind needs clearing
+        clear_region(*internal_buffer_, internal_dirty_);
+        internal_dirty_ = box2d<int>();
         current_buffer_ = internal_buffer_.get();
         set_premultiplied_alpha(*current_buffer_,true);
     }
@@ -306,30 +452,64 @@ void agg_renderer<T0,T1>::end_style_processing(feature_type_style const& st)
 {
     if (style_level_compositing_)
     {
-        bool blend_from = false;
-        if (st.image_filters().size() > 0)
+        // the style is composited with src-over unless it sets a comp-op
+        composite_mode_e comp_op = st.comp_op() ? *st.comp_op() : src_over;
+        int spread = 0;
+        bool local = transparent_is_noop(comp_op);
+        filter_spread_visitor spread_visitor(spread, local, common_.scale_factor_);
+        for (mapnik::filter::filter_type const& filter_tag : st.image_filters())
         {
-            blend_from = true;
-            mapnik::filter::filter_visitor<buffer_type> visitor(*current_buffer_, common_.scale_factor_);
-            for (mapnik::filter::filter_type const& filter_tag : st.image_filters())
-            {
-                util::apply_visitor(visitor, filter_tag);
-            }
-            mapnik::premultiply_alpha(*current_buffer_);
+            util::apply_visitor(spread_visitor, filter_tag);
         }
-        if (st.comp_op())
+        if (local)
         {
-            composite(pixmap_, *current_buffer_,
-                      *st.comp_op(), st.get_opacity(),
-                      -common_.t_.offset(),
-                      -common_.t_.offset());
+            // filter and composite just the painted pixels and the
+            // transparent margin the filters can spread them into
+            box2d<int> painted = painted_extent(*current_buffer_);
+            internal_dirty_ = painted;
+            if (painted.valid())
+            {
+                box2d<int> region(painted.minx() - spread, painted.miny() - spread,
+                                  painted.maxx() + spread, painted.maxy() + spread);
+                region.clip(box2d<int>(0, 0, current_buffer_->width(), current_buffer_->height()));
+                buffer_type part(region.width(), region.height(), false, true);
+                for (int y = region.miny(); y < region.maxy(); ++y)
+                {
+                    std::copy(current_buffer_->get_row(y, region.minx()),
+                              current_buffer_->get_row(y, region.maxx()),
+                              part.get_row(y - region.miny()));
+                }
+                if (st.image_filters().size() > 0)
+                {
+                    mapnik::filter::filter_visitor<buffer_type> visitor(part, common_.scale_factor_);
+                    for (mapnik::filter::filter_type const& filter_tag : st.image_filters())
+                    {
+                        util::apply_visitor(visitor, filter_tag);
+                    }
+                    mapnik::premultiply_alpha(part);
+                }
+                composite(pixmap_, part,
+                          comp_op, st.get_opacity(),
+                          region.minx() - common_.t_.offset(),
+                          region.miny() - common_.t_.offset());
+            }
         }
-        else if (blend_from || st.get_opacity() < 1.0)
+        else
         {
+            if (st.image_filters().size() > 0)
+            {
+                mapnik::filter::filter_visitor<buffer_type> visitor(*current_buffer_, common_.scale_factor_);
+                for (mapnik::filter::filter_type const& filter_tag : st.image_filters())
+                {
+                    util::apply_visitor(visitor, filter_tag);
+                }
+                mapnik::premultiply_alpha(*current_buffer_);
+            }
             composite(pixmap_, *current_buffer_,
-                      src_over, st.get_opacity(),
+                      comp_op, st.get_opacity(),
                       -common_.t_.offset(),
                       -common_.t_.offset());
+            internal_dirty_ = box2d<int>(0, 0, current_buffer_->width(), current_buffer_->height());
         }
     }
     if (st.direct_image_filters().size() > 0)
@@ -0,0 +1,140 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+// mapnik
+#include <mapnik/band_renderer.hpp>
+#include <mapnik/band_writer.hpp>
+#include <mapnik/map.hpp>
+#include <mapnik/request.hpp>
+#include <mapnik/agg_renderer.hpp>
+#include <mapnik/image_util.hpp>
+#include <mapnik/label_collision_detector.hpp>
+
+// stl
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace mapnik
+{
+
+namespace {
+// Map::resize rejects sizes below this
+constexpr unsigned min_band_height = 16;
+}
+
+void render_bands(Map const& m,
+                  unsigned band_height,
+                  band_handler const& handler,
+                  double scale_factor,
+                  attributes const& vars)
+{
+    if (band_height < min_band_height)
+    {
+        throw std::runtime_error("render_bands: band height must be at least " + std::to_string(min_band_height));
+    }
+    unsigned width = m.width();
+    unsigned height = m.height();
+    int buffer_size = m.buffer_size();
+    box2d<double> const extent = m.get_current_extent();
+    double res_y = extent.height() / height;
+
+    // layer queries are driven by the map extent, so render a copy sized
+    // to each band in turn
+    Map map(m);
+    std::shared_ptr<label_collision_detector4> previous;
+    unsigned previous_rows = 0;
+    unsigned y = 0;
+    while (y < height)
+    {
+        unsigned rows = std::min(band_height, height - y);
+        if (height - y - rows < min_band_height)
+        {
+            // the last band takes a short remainder along
+            rows = height - y;
+        }
+        box2d<double> band_extent(extent.minx(), extent.maxy() - (y + rows) * res_y,
+                                  extent.maxx(), extent.maxy() - y * res_y);
+        map.resize(width, rows);
+        if (map.width() != width || map.height() != rows)
+        {
+            throw std::runtime_error("render_bands: map size out of the supported range");
+        }
+        map.zoom_to_box(band_extent);
+        request req(width, rows, map.get_current_extent());
+        req.set_buffer_size(buffer_size);
+
+        auto detector = std::make_shared<label_collision_detector4>(
+            box2d<double>(-buffer_size, -buffer_size, width + buffer_size, rows + buffer_size));
+        if (previous)
+        {
+            for (auto const& lbl : *previous)
+            {
+                box2d<double> box = lbl.box;
+                box.move(0, -static_cast<double>(previous_rows));
+                detector->insert_carried(box, lbl.text);
+            }
+        }
+
+        image_rgba8 band(width, rows);
+        agg_renderer<image_rgba8> ren(map, req, vars, band, detector, scale_factor);
+        ren.apply();
+        handler(band, y);
+        previous = detector;
+        previous_rows = rows;
+        y += rows;
+    }
+}
+
+void render_to_stream(Map const& m,
+                      std::ostream & stream,
+                      std::string const& format,
+                      unsigned band_height,
+                      double scale_factor,
+                      attributes const& vars)
+{
+    std::unique_ptr<band_writer> writer = create_band_writer(stream, format, m.width(), m.height());
+    render_bands(m, band_height,
+                 [&writer](image_rgba8 const& band, unsigned) { writer->write(band); },
+                 scale_factor, vars);
+    writer->close();
+}
+
+void render_to_file(Map const& m,
+                    std::string const& filename,
+                    std::string const& format,
+                    unsigned band_height,
+                    double scale_factor,
+                    attributes const& vars)
+{
+    std::ofstream file (filename.c_str(), std::ios::out| std::ios::trunc|std::ios::binary);
+    if (!file)
+    {
+        throw image_writer_exception("Could not write file to " + filename);
+    }
+    render_to_stream(m, file, format, band_height, scale_factor, vars);
+}
+
+}
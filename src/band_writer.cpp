@@ -0,0 +1,57 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+// mapnik
+#include <mapnik/band_writer.hpp>
+#include <mapnik/image_util.hpp>
+#include <mapnik/image_util_png.hpp>
+#include <mapnik/image_util_tiff.hpp>
+
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#pragma GCC diagnostic pop
+
+namespace mapnik
+{
+
+std::unique_ptr<band_writer> create_band_writer(std::ostream & stream,
+                                                std::string const& format,
+                                                unsigned width,
+                                                unsigned height)
+{
+    if (width == 0 || height == 0)
+    {
+        throw image_writer_exception("band writer: width and height must be greater than zero");
+    }
+    if (boost::algorithm::starts_with(format, "png"))
+    {
+        return create_png_band_writer(stream, format, width, height);
+    }
+    else if (boost::algorithm::starts_with(format, "tif"))
+    {
+        return create_tiff_band_writer(stream, format, width, height);
+    }
+    throw image_writer_exception("band writer: unsupported format '" + format + "'");
+}
+
+}
@@ -155,11 +155,15 @@ source = Split(
     expression_grammar_x3.cpp
     fs.cpp
     request.cpp
+    metatile.cpp
+    band_renderer.cpp
+    band_writer.cpp
     well_known_srs.cpp
     params.cpp
     parse_image_filters.cpp
     generate_image_filters.cpp
     image_filter_grammar_x3.cpp
+    image_filter.cpp
     color.cpp
     conversions_numeric.cpp
     conversions_string.cpp
@@ -175,6 +179,7 @@ source = Split(
     expression_node.cpp
     expression_string.cpp
     expression.cpp
+    expression_program.cpp
     transform_expression.cpp
     transform_expression_grammar_x3.cpp
     feature_kv_iterator.cpp
@@ -221,6 +226,8 @@ source = Split(
     unicode.cpp
     raster_colorizer.cpp
     mapped_memory_cache.cpp
+    solid_tile_cache.cpp
+    label_placement_store.cpp
     marker_cache.cpp
     svg/svg_parser.cpp
     svg/svg_path_parser.cpp
@@ -237,6 +244,9 @@ source = Split(
     text/itemizer.cpp
     text/scrptrun.cpp
     text/face.cpp
+    text/glyph_cache.cpp
+    text/face_pool.cpp
+    text/shaping_cache.cpp
     text/glyph_positions.cpp
     text/placement_finder.cpp
     text/properties_util.cpp
@@ -107,7 +107,7 @@ void cairo_renderer<T>::process(debug_symbolizer const& sym,
     {
         for (auto & n : *common_.detector_)
         {
-            render_debug_box(context_, n.get().box);
+            render_debug_box(context_, n.box);
         }
     }
     else if (mode == DEBUG_SYM_MODE_VERTEX)
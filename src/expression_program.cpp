@@ -0,0 +1,322 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+// mapnik
+#include <mapnik/expression_program.hpp>
+#include <mapnik/expression_node.hpp>
+#include <mapnik/util/geometry_to_ds_type.hpp>
+
+// stl
+#include <algorithm>
+#include <limits>
+
+namespace mapnik
+{
+
+namespace {
+
+template <typename Tag> struct opcode_of;
+template <> struct opcode_of<tags::plus> { static constexpr expression_program::opcode value = expression_program::op_plus; };
+template <> struct opcode_of<tags::minus> { static constexpr expression_program::opcode value = expression_program::op_minus; };
+template <> struct opcode_of<tags::mult> { static constexpr expression_program::opcode value = expression_program::op_mult; };
+template <> struct opcode_of<tags::div> { static constexpr expression_program::opcode value = expression_program::op_div; };
+template <> struct opcode_of<tags::mod> { static constexpr expression_program::opcode value = expression_program::op_mod; };
+template <> struct opcode_of<tags::less> { static constexpr expression_program::opcode value = expression_program::op_less; };
+template <> struct opcode_of<tags::less_equal> { static constexpr expression_program::opcode value = expression_program::op_less_equal; };
+template <> struct opcode_of<tags::greater> { static constexpr expression_program::opcode value = expression_program::op_greater; };
+template <> struct opcode_of<tags::greater_equal> { static constexpr expression_program::opcode value = expression_program::op_greater_equal; };
+template <> struct opcode_of<tags::equal_to> { static constexpr expression_program::opcode value = expression_program::op_equal_to; };
+template <> struct opcode_of<tags::not_equal_to> { static constexpr expression_program::opcode value = expression_program::op_not_equal_to; };
+
+template <typename T>
+std::uint32_t index_of(std::vector<T> & list, T const& item)
+{
+    auto itr = std::find(list.begin(), list.end(), item);
+    if (itr != list.end())
+    {
+        return static_cast<std::uint32_t>(itr - list.begin());
+    }
+    list.push_back(item);
+    return static_cast<std::uint32_t>(list.size() - 1);
+}
+
+}
+
+struct expression_compiler
+{
+    explicit expression_compiler(expression_program & prog)
+        : prog_(prog),
+          depth_(0) {}
+
+    void emit(expression_program::opcode op, std::uint32_t arg, int stack_effect)
+    {
+        prog_.code_.push_back({op, arg});
+        depth_ += stack_effect;
+        prog_.max_depth_ = std::max(prog_.max_depth_, depth_);
+    }
+
+    void constant(value_type && val)
+    {
+        prog_.constants_.push_back(std::move(val));
+        emit(expression_program::op_constant,
+             static_cast<std::uint32_t>(prog_.constants_.size() - 1), 1);
+    }
+
+    void operator() (value_null val) { constant(val); }
+    void operator() (value_bool val) { constant(val); }
+    void operator() (value_integer val) { constant(val); }
+    void operator() (value_double val) { constant(val); }
+    void operator() (value_unicode_string const& str) { constant(str); }
+
+    void operator() (attribute const& attr)
+    {
+        emit(expression_program::op_attribute, index_of(prog_.attribute_names_, attr.name()), 1);
+    }
+
+    void operator() (global_attribute const& attr)
+    {
+        emit(expression_program::op_global_attribute, index_of(prog_.global_names_, attr.name), 1);
+    }
+
+    void operator() (geometry_type_attribute const&)
+    {
+        emit(expression_program::op_geometry_type, 0, 1);
+    }
+
+    void operator() (binary_node<tags::logical_and> const& x)
+    {
+        short_circuit(expression_program::op_and_jump, x);
+    }
+
+    void operator() (binary_node<tags::logical_or> const& x)
+    {
+        short_circuit(expression_program::op_or_jump, x);
+    }
+
+    template <typename Tag>
+    void operator() (binary_node<Tag> const& x)
+    {
+        util::apply_visitor(*this, x.left);
+        util::apply_visitor(*this, x.right);
+        emit(opcode_of<Tag>::value, 0, -1);
+    }
+
+    void operator() (unary_node<tags::negate> const& x)
+    {
+        util::apply_visitor(*this, x.expr);
+        emit(expression_program::op_negate, 0, 0);
+    }
+
+    void operator() (unary_node<tags::logical_not> const& x)
+    {
+        util::apply_visitor(*this, x.expr);
+        emit(expression_program::op_logical_not, 0, 0);
+    }
+
+    void operator() (regex_match_node const& x)
+    {
+        util::apply_visitor(*this, x.expr);
+        prog_.regex_matches_.push_back(x);
+        emit(expression_program::op_regex_match,
+             static_cast<std::uint32_t>(prog_.regex_matches_.size() - 1), 0);
+    }
+
+    void operator() (regex_replace_node const& x)
+    {
+        util::apply_visitor(*this, x.expr);
+        prog_.regex_replaces_.push_back(x);
+        emit(expression_program::op_regex_replace,
+             static_cast<std::uint32_t>(prog_.regex_replaces_.size() - 1), 0);
+    }
+
+    void operator() (unary_function_call const& call)
+    {
+        util::apply_visitor(*this, call.arg);
+        prog_.unary_calls_.push_back(call.fun);
+        emit(expression_program::op_unary_call,
+             static_cast<std::uint32_t>(prog_.unary_calls_.size() - 1), 0);
+    }
+
+    void operator() (binary_function_call const& call)
+    {
+        util::apply_visitor(*this, call.arg1);
+        util::apply_visitor(*this, call.arg2);
+        prog_.binary_calls_.push_back(call.fun);
+        emit(expression_program::op_binary_call,
+             static_cast<std::uint32_t>(prog_.binary_calls_.size() - 1), -1);
+    }
+
+    template <typename Tag>
+    void short_circuit(expression_program::opcode op, binary_node<Tag> const& x)
+    {
+        util::apply_visitor(*this, x.left);
+        std::size_t jump = prog_.code_.size();
+        // the jump keeps the left operand on the stack only when taken
+        emit(op, 0, -1);
+        util::apply_visitor(*this, x.right);
+        emit(expression_program::op_to_bool, 0, 0);
+        prog_.code_[jump].arg = static_cast<std::uint32_t>(prog_.code_.size());
+    }
+
+    expression_program & prog_;
+    std::size_t depth_;
+};
+
+expression_program::expression_program(expr_node const& expr)
+    : max_depth_(0)
+{
+    expression_compiler compiler(*this);
+    util::apply_visitor(compiler, expr);
+}
+
+void expression_program::bind(feature_impl const& feature,
+                              attributes const& vars,
+                              binding & b) const
+{
+    context_type const& ctx = feature.get_context();
+    b.ctx_ = feature.context();
+    b.ctx_size_ = ctx.size();
+    b.slots_.resize(attribute_names_.size());
+    for (std::size_t i = 0; i < attribute_names_.size(); ++i)
+    {
+        auto itr = ctx.find(attribute_names_[i]);
+        b.slots_[i] = (itr != ctx.end()) ? itr->second : std::numeric_limits<std::size_t>::max();
+    }
+    b.vars_ = &vars;
+    b.globals_.resize(global_names_.size());
+    for (std::size_t i = 0; i < global_names_.size(); ++i)
+    {
+        auto itr = vars.find(global_names_[i]);
+        b.globals_[i] = (itr != vars.end()) ? &itr->second : &default_feature_value;
+    }
+    b.temps_.resize(code_.size());
+    b.stack_.resize(max_depth_);
+}
+
+value_type expression_program::evaluate(feature_impl const& feature,
+                                        attributes const& vars,
+                                        binding & b) const
+{
+    context_type const& ctx = feature.get_context();
+    if (b.ctx_.get() != &ctx || b.ctx_size_ != ctx.size() || b.vars_ != &vars)
+    {
+        bind(feature, vars, b);
+    }
+
+    value_type const** stack = b.stack_.data();
+    value_type * temps = b.temps_.data();
+    std::size_t sp = 0;
+    std::size_t size = code_.size();
+    for (std::size_t pc = 0; pc < size; ++pc)
+    {
+        instruction const& ins = code_[pc];
+        switch (ins.op)
+        {
+        case op_constant:
+            stack[sp++] = &constants_[ins.arg];
+            break;
+        case op_attribute:
+            // unresolved slots are out of range and yield the default value
+            stack[sp++] = &feature.get(b.slots_[ins.arg]);
+            break;
+        case op_global_attribute:
+            stack[sp++] = b.globals_[ins.arg];
+            break;
+        case op_geometry_type:
+            temps[pc] = static_cast<value_integer>(util::to_ds_type(feature.get_geometry()));
+            stack[sp++] = &temps[pc];
+            break;
+        case op_negate:
+            temps[pc] = -(*stack[sp - 1]);
+            stack[sp - 1] = &temps[pc];
+            break;
+        case op_logical_not:
+            temps[pc] = !stack[sp - 1]->to_bool();
+            stack[sp - 1] = &temps[pc];
+            break;
+        case op_to_bool:
+            temps[pc] = stack[sp - 1]->to_bool();
+            stack[sp - 1] = &temps[pc];
+            break;
+        case op_and_jump:
+            if (!stack[sp - 1]->to_bool())
+            {
+                temps[pc] = false;
+                stack[sp - 1] = &temps[pc];
+                pc = ins.arg - 1;
+            }
+            else --sp;
+            break;
+        case op_or_jump:
+            if (stack[sp - 1]->to_bool())
+            {
+                temps[pc] = true;
+                stack[sp - 1] = &temps[pc];
+                pc = ins.arg - 1;
+            }
+            else --sp;
+            break;
+        case op_regex_match:
+            temps[pc] = regex_matches_[ins.arg].apply(*stack[sp - 1]);
+            stack[sp - 1] = &temps[pc];
+            break;
+        case op_regex_replace:
+            temps[pc] = regex_replaces_[ins.arg].apply(*stack[sp - 1]);
+            stack[sp - 1] = &temps[pc];
+            break;
+        case op_unary_call:
+            temps[pc] = unary_calls_[ins.arg](*stack[sp - 1]);
+            stack[sp - 1] = &temps[pc];
+            break;
+        case op_binary_call:
+            temps[pc] = binary_calls_[ins.arg](*stack[sp - 2], *stack[sp - 1]);
+            stack[--sp - 1] = &temps[pc];
+            break;
+        default:
+        {
+            value_type const& lhs = *stack[sp - 2];
+            value_type const& rhs = *stack[sp - 1];
+            switch (ins.op)
+            {
+            case op_plus: temps[pc] = lhs + rhs; break;
+            case op_minus: temps[pc] = lhs - rhs; break;
+            case op_mult: temps[pc] = lhs * rhs; break;
+            case op_div: temps[pc] = lhs / rhs; break;
+            case op_mod: temps[pc] = lhs % rhs; break;
+            case op_less: temps[pc] = lhs < rhs; break;
+            case op_less_equal: temps[pc] = lhs <= rhs; break;
+            case op_greater: temps[pc] = lhs > rhs; break;
+            case op_greater_equal: temps[pc] = lhs >= rhs; break;
+            case op_equal_to: temps[pc] = lhs == rhs; break;
+            case op_not_equal_to: temps[pc] = lhs != rhs; break;
+            default: break;
+            }
+            stack[--sp - 1] = &temps[pc];
+            break;
+        }
+        }
+    }
+    if (sp == 0) return value_type();
+    return *stack[sp - 1];
+}
+
+}
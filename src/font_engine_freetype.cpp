@@ -25,6 +25,7 @@
 #include <mapnik/font_engine_freetype.hpp>
 #include <mapnik/pixel_position.hpp>
 #include <mapnik/text/face.hpp>
+#include <mapnik/text/face_pool.hpp>
 #include <mapnik/util/fs.hpp>
 #include <mapnik/util/file_io.hpp>
 #include <mapnik/make_unique.hpp>
@@ -300,7 +301,7 @@ face_ptr freetype_engine::create_face(std::string const& family_name,
                                                 static_cast<FT_Long>(mem_font_itr->second.second), // size
                                                 itr->second.first, // face index
                                                 &face);
-            if (!error) return std::make_shared<font_face>(face);
+            if (!error) return std::make_shared<font_face>(face, itr->second.second);
         }
         // we don't add to cache here because the map and its font_cache
         // must be immutable during rendering for predictable thread safety
@@ -322,7 +323,7 @@ face_ptr freetype_engine::create_face(std::string const& family_name,
                                                     static_cast<FT_Long>(mem_font_itr->second.second), // size
                                                     itr->second.first, // face index
                                                     &face);
-                if (!error) return std::make_shared<font_face>(face);
+                if (!error) return std::make_shared<font_face>(face, itr->second.second);
             }
             found_font_file = true;
         }
@@ -349,7 +350,7 @@ face_ptr freetype_engine::create_face(std::string const& family_name,
                 global_memory_fonts.erase(result.first);
                 return face_ptr();
             }
-            return std::make_shared<font_face>(face);
+            return std::make_shared<font_face>(face, itr->second.second);
         }
     }
     return face_ptr();
@@ -374,6 +375,15 @@ face_manager::face_manager(font_library & library,
 
 face_ptr face_manager::get_face(std::string const& name)
 {
+    face_pool & pool = face_pool::instance();
+    // fonts registered on the map live as long as the map, the pool only
+    // keeps faces of the global registry. Pooled faces belong to the calling
+    // thread and a face_manager may be used on another thread later, so
+    // they are looked up in the pool every time rather than kept here.
+    if (pool.enabled() && font_file_mapping_.find(name) == font_file_mapping_.end())
+    {
+        return pool.get_face(name);
+    }
     auto itr = face_cache_->find(name);
     if (itr != face_cache_->end())
     {
@@ -26,6 +26,9 @@
 #include <mapnik/image_any.hpp>
 #include <mapnik/safe_cast.hpp>
 #include <mapnik/util/const_rendering_buffer.hpp>
+#ifdef SSE_MATH
+#include <mapnik/sse.hpp>
+#endif
 
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
@@ -44,6 +47,10 @@
 #include "agg_color_rgba.h"
 #pragma GCC diagnostic pop
 
+// stl
+#include <algorithm>
+#include <cstring>
+
 namespace mapnik
 {
 
@@ -124,6 +131,211 @@ For example, if you generate some pattern with AGG (premultiplied) and would lik
 
 */
 
+#ifdef SSE_MATH
+namespace detail {
+
+// SSE2 versions of the agg::comp_op_rgba_* blenders for the most common
+// modes. They work on two premultiplied rgba pixels unpacked to 16 bit lanes
+// and reproduce the scalar arithmetic exactly, including the rounding and the
+// truncation to 8 bits, so the AGG path stays the reference implementation.
+
+static inline __m128i _mm_alpha_epu16(__m128i x)
+{
+    // broadcast the alpha lane of both pixels
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+}
+
+static inline __m128i _mm_mul_round_epu16(__m128i x, __m128i y, __m128i bias)
+{
+    // (x * y + bias) >> 8
+    return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(x, y), bias), 8);
+}
+
+static inline __m128i _mm_select_si128(__m128i mask, __m128i x, __m128i y)
+{
+    // x where mask is set, y elsewhere
+    return _mm_or_si128(_mm_and_si128(mask, x), _mm_andnot_si128(mask, y));
+}
+
+struct sse_blend_src_over
+{
+    // Dca' = Sca + Dca.(1 - Sa)
+    static inline __m128i apply(__m128i s, __m128i d)
+    {
+        __m128i const mask = _mm_set1_epi16(0xff);
+        __m128i s1a = _mm_sub_epi16(mask, _mm_alpha_epu16(s));
+        return _mm_add_epi16(s, _mm_mul_round_epu16(d, s1a, mask));
+    }
+};
+
+struct sse_blend_dst_in
+{
+    // Dca' = Dca.Sa, cover is applied to the source alpha by the kernel
+    static inline __m128i apply(__m128i s, __m128i d)
+    {
+        return _mm_mul_round_epu16(d, _mm_alpha_epu16(s), _mm_set1_epi16(0xff));
+    }
+};
+
+struct sse_blend_dst_out
+{
+    // Dca' = Dca.(1 - Sa), rounded with base_shift as in AGG
+    static inline __m128i apply(__m128i s, __m128i d)
+    {
+        __m128i s1a = _mm_sub_epi16(_mm_set1_epi16(0xff), _mm_alpha_epu16(s));
+        return _mm_mul_round_epu16(d, s1a, _mm_set1_epi16(8));
+    }
+};
+
+struct sse_blend_plus
+{
+    // Dca' = Sca + Dca, clamped
+    static inline __m128i apply(__m128i s, __m128i d)
+    {
+        __m128i r = _mm_min_epi16(_mm_add_epi16(s, d), _mm_set1_epi16(0xff));
+        return _mm_select_si128(_mm_cmpeq_epi16(_mm_alpha_epu16(s), _mm_setzero_si128()), d, r);
+    }
+};
+
+struct sse_blend_screen
+{
+    // Dca' = Sca + Dca - Sca.Dca
+    static inline __m128i apply(__m128i s, __m128i d)
+    {
+        __m128i r = _mm_sub_epi16(_mm_add_epi16(s, d), _mm_mul_round_epu16(s, d, _mm_set1_epi16(0xff)));
+        return _mm_select_si128(_mm_cmpeq_epi16(_mm_alpha_epu16(s), _mm_setzero_si128()), d, r);
+    }
+};
+
+struct sse_blend_multiply
+{
+    // Dca' = Sca.Dca + Sca.(1 - Da) + Dca.(1 - Sa)
+    // Da'  = Sa + Da - Sa.Da
+    static inline __m128i apply(__m128i s, __m128i d)
+    {
+        __m128i const mask = _mm_set1_epi16(0xff);
+        __m128i sa = _mm_alpha_epu16(s);
+        __m128i p0 = _mm_mullo_epi16(s, d);
+        __m128i p1 = _mm_mullo_epi16(s, _mm_sub_epi16(mask, _mm_alpha_epu16(d)));
+        __m128i p2 = _mm_mullo_epi16(d, _mm_sub_epi16(mask, sa));
+        // the sum of the three products can exceed 16 bits for malformed
+        // input, so add high and low bytes separately to keep AGG's result
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_srli_epi16(p0, 8), _mm_srli_epi16(p1, 8)),
+                                   _mm_srli_epi16(p2, 8));
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask)),
+                                   _mm_add_epi16(_mm_and_si128(p2, mask), mask));
+        __m128i rgb = _mm_add_epi16(hi, _mm_srli_epi16(lo, 8));
+        __m128i alpha = _mm_sub_epi16(_mm_add_epi16(s, d), _mm_srli_epi16(_mm_add_epi16(p0, mask), 8));
+        __m128i r = _mm_select_si128(_mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0), alpha, rgb);
+        return _mm_select_si128(_mm_cmpeq_epi16(sa, _mm_setzero_si128()), d, r);
+    }
+};
+
+template <typename Blender, bool DstIn = false>
+struct sse_composite_kernel
+{
+    explicit sse_composite_kernel(unsigned cover)
+        : cover_(_mm_set1_epi16(static_cast<short>(cover))),
+          scale_(cover < 255) {}
+
+    // blends four pixels
+    inline __m128i operator() (__m128i src, __m128i dst) const
+    {
+        __m128i const zero = _mm_setzero_si128();
+        __m128i const mask = _mm_set1_epi16(0xff);
+        __m128i s0 = _mm_unpacklo_epi8(src, zero);
+        __m128i s1 = _mm_unpackhi_epi8(src, zero);
+        if (scale_)
+        {
+            if (DstIn)
+            {
+                // Sa' = 1 - cover.(1 - Sa)
+                s0 = _mm_sub_epi16(mask, _mm_mul_round_epu16(cover_, _mm_sub_epi16(mask, s0), mask));
+                s1 = _mm_sub_epi16(mask, _mm_mul_round_epu16(cover_, _mm_sub_epi16(mask, s1), mask));
+            }
+            else
+            {
+                s0 = _mm_mul_round_epu16(s0, cover_, mask);
+                s1 = _mm_mul_round_epu16(s1, cover_, mask);
+            }
+        }
+        __m128i r0 = _mm_and_si128(Blender::apply(s0, _mm_unpacklo_epi8(dst, zero)), mask);
+        __m128i r1 = _mm_and_si128(Blender::apply(s1, _mm_unpackhi_epi8(dst, zero)), mask);
+        return _mm_packus_epi16(r0, r1);
+    }
+
+    __m128i cover_;
+    bool scale_;
+};
+
+template <typename Kernel>
+void sse_composite(image_rgba8 & dst, image_rgba8 const& src, Kernel const& kernel, int dx, int dy)
+{
+    // the part of dst covered by src placed at (dx, dy)
+    int x0 = std::max(dx, 0);
+    int y0 = std::max(dy, 0);
+    int x1 = std::min(static_cast<int>(dst.width()), static_cast<int>(src.width()) + dx);
+    int y1 = std::min(static_cast<int>(dst.height()), static_cast<int>(src.height()) + dy);
+    if (x0 >= x1 || y0 >= y1) return;
+    int width = x1 - x0;
+    for (int y = y0; y < y1; ++y)
+    {
+        image_rgba8::pixel_type const* src_row = src.get_row(static_cast<std::size_t>(y - dy)) + (x0 - dx);
+        image_rgba8::pixel_type * dst_row = dst.get_row(static_cast<std::size_t>(y)) + x0;
+        int x = 0;
+        for (; x < ROUND_DOWN(width, 4); x += 4)
+        {
+            __m128i s = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src_row + x));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i*>(dst_row + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst_row + x), kernel(s, d));
+        }
+        if (x < width)
+        {
+            // remaining pixels go through a zero padded register
+            std::size_t bytes = static_cast<std::size_t>(width - x) * sizeof(image_rgba8::pixel_type);
+            m128_int s, d;
+            s.v = _mm_setzero_si128();
+            d.v = _mm_setzero_si128();
+            std::memcpy(s.u8, src_row + x, bytes);
+            std::memcpy(d.u8, dst_row + x, bytes);
+            d.v = kernel(s.v, d.v);
+            std::memcpy(dst_row + x, d.u8, bytes);
+        }
+    }
+}
+
+// Returns false for modes without an SSE kernel.
+inline bool sse_composite(image_rgba8 & dst, image_rgba8 const& src, composite_mode_e mode,
+                          unsigned cover, int dx, int dy)
+{
+    switch (mode)
+    {
+    case src_over:
+        sse_composite(dst, src, sse_composite_kernel<sse_blend_src_over>(cover), dx, dy);
+        return true;
+    case dst_in:
+        sse_composite(dst, src, sse_composite_kernel<sse_blend_dst_in, true>(cover), dx, dy);
+        return true;
+    case dst_out:
+        sse_composite(dst, src, sse_composite_kernel<sse_blend_dst_out>(cover), dx, dy);
+        return true;
+    case plus:
+        sse_composite(dst, src, sse_composite_kernel<sse_blend_plus>(cover), dx, dy);
+        return true;
+    case multiply:
+        sse_composite(dst, src, sse_composite_kernel<sse_blend_multiply>(cover), dx, dy);
+        return true;
+    case screen:
+        sse_composite(dst, src, sse_composite_kernel<sse_blend_screen>(cover), dx, dy);
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // end detail ns
+#endif
+
 template <>
 MAPNIK_DECL void composite(image_rgba8 & dst, image_rgba8 const& src, composite_mode_e mode,
                float opacity,
@@ -137,11 +349,6 @@ MAPNIK_DECL void composite(image_rgba8 & dst, image_rgba8 const& src, composite_
     using pixfmt_type = agg::pixfmt_custom_blend_rgba<blender_type, agg::rendering_buffer>;
     using renderer_type = agg::renderer_base<pixfmt_type>;
 
-    agg::rendering_buffer dst_buffer(dst.bytes(),safe_cast<unsigned>(dst.width()),safe_cast<unsigned>(dst.height()),safe_cast<int>(dst.row_size()));
-    const_rendering_buffer src_buffer(src);
-    pixfmt_type pixf(dst_buffer);
-    pixf.comp_op(static_cast<agg::comp_op_e>(mode));
-    agg::pixfmt_alpha_blend_rgba<agg::blender_rgba32_pre, const_rendering_buffer, agg::pixel32_type> pixf_mask(src_buffer);
 #ifdef MAPNIK_DEBUG
     if (!src.get_premultiplied())
     {
@@ -152,8 +359,21 @@ MAPNIK_DECL void composite(image_rgba8 & dst, image_rgba8 const& src, composite_
         throw std::runtime_error("DESTINATION MUST BE PREMULTIPLIED FOR COMPOSITING!");
     }
 #endif
+    agg::cover_type cover = safe_cast<agg::cover_type>(255*opacity);
+#ifdef SSE_MATH
+    // AGG copes with overlapping buffers, the SSE kernels do not
+    if (&dst != &src && detail::sse_composite(dst, src, mode, cover, dx, dy))
+    {
+        return;
+    }
+#endif
+    agg::rendering_buffer dst_buffer(dst.bytes(),safe_cast<unsigned>(dst.width()),safe_cast<unsigned>(dst.height()),safe_cast<int>(dst.row_size()));
+    const_rendering_buffer src_buffer(src);
+    pixfmt_type pixf(dst_buffer);
+    pixf.comp_op(static_cast<agg::comp_op_e>(mode));
+    agg::pixfmt_alpha_blend_rgba<agg::blender_rgba32_pre, const_rendering_buffer, agg::pixel32_type> pixf_mask(src_buffer);
     renderer_type ren(pixf);
-    ren.blend_from(pixf_mask,0,dx,dy,safe_cast<agg::cover_type>(255*opacity));
+    ren.blend_from(pixf_mask,0,dx,dy,cover);
 }
 
 template <>
@@ -0,0 +1,360 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+// mapnik
+#include <mapnik/image_filter.hpp>
+#include <mapnik/util/parallel_for.hpp>
+
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore_agg.hpp>
+#include "agg_blur.h"
+#pragma GCC diagnostic pop
+
+// stl
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace mapnik { namespace filter {
+
+namespace {
+
+std::atomic<unsigned> filter_thread_count(1);
+
+}
+
+void set_filter_threads(unsigned threads)
+{
+    filter_thread_count = threads;
+}
+
+unsigned get_filter_threads()
+{
+    return filter_thread_count;
+}
+
+namespace detail {
+
+namespace {
+
+// images with fewer pixels are filtered on the calling thread only
+constexpr std::size_t parallel_pixels = 1 << 20;
+// rows handed to a thread at a time by the row oriented passes
+constexpr std::size_t task_rows = 64;
+// columns blurred together by the vertical stack blur pass, one cache line of rgba8
+constexpr std::size_t block_columns = 16;
+// weight of each sample of the 3x3 blur
+constexpr float blur_weight = 0.1111f;
+
+unsigned filter_threads(std::size_t width, std::size_t height)
+{
+    if (width * height < parallel_pixels) return 1;
+    unsigned threads = filter_thread_count;
+    if (threads > 0) return threads;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// One source row split into colour planes, padded by a clamped pixel on
+// each side, plus the horizontal parts of the separable kernels.
+struct planar_row
+{
+    explicit planar_row(std::size_t width)
+    {
+        for (std::size_t c = 0; c < 3; ++c)
+        {
+            v[c].resize(width + 2);
+            h[c].resize(width);
+            d[c].resize(width);
+        }
+    }
+
+    void load(std::uint8_t const* row, std::size_t width, kernel_3x3 kernel)
+    {
+        for (std::size_t c = 0; c < 3; ++c)
+        {
+            std::int32_t * dst = v[c].data() + 1;
+            for (std::size_t x = 0; x < width; ++x)
+            {
+                dst[x] = row[x * 4 + c];
+            }
+            dst[-1] = dst[0];
+            dst[width] = dst[width - 1];
+            std::int32_t const* p = v[c].data();
+            std::int32_t * hs = h[c].data();
+            std::int32_t * ds = d[c].data();
+            if (kernel == kernel_3x3::blur)
+            {
+                for (std::size_t x = 0; x < width; ++x)
+                {
+                    hs[x] = p[x] + p[x + 1] + p[x + 2];
+                }
+            }
+            else if (kernel == kernel_3x3::sobel)
+            {
+                for (std::size_t x = 0; x < width; ++x)
+                {
+                    hs[x] = p[x] + 2 * p[x + 1] + p[x + 2];
+                    ds[x] = p[x + 2] - p[x];
+                }
+            }
+        }
+    }
+
+    // v[c][x + 1] is the sample at x
+    std::vector<std::int32_t> v[3];
+    // blur: 1 1 1, sobel: 1 2 1
+    std::vector<std::int32_t> h[3];
+    // sobel: -1 0 1
+    std::vector<std::int32_t> d[3];
+};
+
+inline std::uint8_t clamp_channel(std::int32_t value)
+{
+    return static_cast<std::uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+void convolve_row(planar_row const& above, planar_row const& row, planar_row const& below,
+                  std::uint8_t const* src, std::uint8_t * dst, std::size_t width,
+                  kernel_3x3 kernel, std::vector<std::int32_t> & out)
+{
+    out.resize(width);
+    for (std::size_t c = 0; c < 3; ++c)
+    {
+        std::int32_t const* a = above.v[c].data();
+        std::int32_t const* m = row.v[c].data();
+        std::int32_t const* b = below.v[c].data();
+        std::int32_t * o = out.data();
+        switch (kernel)
+        {
+        case kernel_3x3::blur:
+        {
+            std::int32_t const* ha = above.h[c].data();
+            std::int32_t const* hm = row.h[c].data();
+            std::int32_t const* hb = below.h[c].data();
+            for (std::size_t x = 0; x < width; ++x)
+            {
+                // same value as summing the nine weighted samples in float,
+                // the rounding error is far below the distance to the
+                // next integer for any sum of nine bytes
+                o[x] = static_cast<std::int32_t>(static_cast<float>(ha[x] + hm[x] + hb[x]) * blur_weight);
+            }
+            break;
+        }
+        case kernel_3x3::emboss:
+            for (std::size_t x = 0; x < width; ++x)
+            {
+                o[x] = clamp_channel(-2 * a[x] - a[x + 1] - m[x] + m[x + 1] + m[x + 2] + b[x + 1] + 2 * b[x + 2]);
+            }
+            break;
+        case kernel_3x3::sharpen:
+            for (std::size_t x = 0; x < width; ++x)
+            {
+                o[x] = clamp_channel(5 * m[x + 1] - a[x + 1] - b[x + 1] - m[x] - m[x + 2]);
+            }
+            break;
+        case kernel_3x3::edge_detect:
+            for (std::size_t x = 0; x < width; ++x)
+            {
+                o[x] = clamp_channel(a[x + 1] + b[x + 1] + m[x] + m[x + 2] - 4 * m[x + 1]);
+            }
+            break;
+        case kernel_3x3::sobel:
+        {
+            std::int32_t const* sa = above.h[c].data();
+            std::int32_t const* sb = below.h[c].data();
+            std::int32_t const* da = above.d[c].data();
+            std::int32_t const* dm = row.d[c].data();
+            std::int32_t const* db = below.d[c].data();
+            for (std::size_t x = 0; x < width; ++x)
+            {
+                std::int32_t gx = da[x] + 2 * dm[x] + db[x];
+                std::int32_t gy = sa[x] - sb[x];
+                float value = std::sqrt(static_cast<float>(gx * gx + gy * gy));
+                o[x] = value > 255.0f ? 255 : static_cast<std::int32_t>(value);
+            }
+            break;
+        }
+        }
+        for (std::size_t x = 0; x < width; ++x)
+        {
+            dst[x * 4 + c] = static_cast<std::uint8_t>(o[x]);
+        }
+    }
+    for (std::size_t x = 0; x < width; ++x)
+    {
+        dst[x * 4 + 3] = src[x * 4 + 3];
+    }
+}
+
+struct stack_blur_params
+{
+    explicit stack_blur_params(unsigned radius)
+        : r(std::min(radius, 254u)),
+          mul(agg::stack_blur_tables<int>::g_stack_blur8_mul[r]),
+          shr(agg::stack_blur_tables<int>::g_stack_blur8_shr[r]) {}
+    unsigned r;
+    unsigned mul;
+    unsigned shr;
+};
+
+// Blurs `lanes` interleaved channels along a line of `count` samples, the
+// samples of lane i at src[k * lanes + i]. Produces exactly what
+// agg::stack_blur_rgba32 does: the sums the stack keeps track of are
+// rebuilt from the clamped source instead.
+void stack_blur_line(std::uint8_t const* src, std::size_t count, std::size_t lanes,
+                     std::uint8_t * dst, std::size_t dst_step,
+                     stack_blur_params const& p,
+                     std::vector<unsigned> & state)
+{
+    state.assign(lanes * 3, 0);
+    unsigned * sum = state.data();
+    unsigned * sum_in = sum + lanes;
+    unsigned * sum_out = sum_in + lanes;
+    std::size_t last = count - 1;
+    auto sample = [&](std::size_t k) { return src + std::min(k, last) * lanes; };
+    for (std::size_t i = 0; i < lanes; ++i)
+    {
+        sum[i] = src[i] * ((p.r + 1) * (p.r + 2) / 2);
+        sum_out[i] = src[i] * (p.r + 1);
+    }
+    for (unsigned k = 1; k <= p.r; ++k)
+    {
+        std::uint8_t const* s = sample(k);
+        for (std::size_t i = 0; i < lanes; ++i)
+        {
+            sum[i] += s[i] * (p.r + 1 - k);
+            sum_in[i] += s[i];
+        }
+    }
+    for (std::size_t k = 0; k < count; ++k)
+    {
+        std::uint8_t * d = dst + k * dst_step;
+        std::uint8_t const* s_old = sample(k > p.r ? k - p.r : 0);
+        std::uint8_t const* s_new = sample(k + p.r + 1);
+        std::uint8_t const* s_next = sample(k + 1);
+        for (std::size_t i = 0; i < lanes; ++i)
+        {
+            d[i] = static_cast<std::uint8_t>((sum[i] * p.mul) >> p.shr);
+            sum[i] -= sum_out[i];
+            sum_out[i] -= s_old[i];
+            sum_in[i] += s_new[i];
+            sum[i] += sum_in[i];
+            sum_out[i] += s_next[i];
+            sum_in[i] -= s_next[i];
+        }
+    }
+}
+
+} // anonymous namespace
+
+void convolve_3x3(std::uint8_t const* src, std::uint8_t * dst,
+                  std::size_t width, std::size_t height, std::size_t row_size,
+                  kernel_3x3 kernel)
+{
+    if (width == 0 || height == 0) return;
+    std::size_t tasks = (height + task_rows - 1) / task_rows;
+    util::parallel_for(tasks, filter_threads(width, height), [&](std::size_t task)
+    {
+        std::size_t y0 = task * task_rows;
+        std::size_t y1 = std::min(height, y0 + task_rows);
+        // rolling window over the rows above, at and below the output row;
+        // outside the image the row on the other side is used instead
+        auto source_row = [&](std::ptrdiff_t y)
+        {
+            if (y < 0) y = (height > 1) ? 1 : 0;
+            else if (y >= static_cast<std::ptrdiff_t>(height)) y = (height > 1) ? height - 2 : 0;
+            return y;
+        };
+        planar_row rows[3] = { planar_row(width), planar_row(width), planar_row(width) };
+        std::ptrdiff_t loaded[3] = { -1, -1, -1 };
+        auto get_row = [&](std::ptrdiff_t y) -> planar_row const&
+        {
+            std::size_t slot = static_cast<std::size_t>(y) % 3;
+            if (loaded[slot] != y)
+            {
+                rows[slot].load(src + y * row_size, width, kernel);
+                loaded[slot] = y;
+            }
+            return rows[slot];
+        };
+        std::vector<std::int32_t> out;
+        for (std::size_t y = y0; y < y1; ++y)
+        {
+            std::ptrdiff_t ya = source_row(static_cast<std::ptrdiff_t>(y) - 1);
+            std::ptrdiff_t yb = source_row(static_cast<std::ptrdiff_t>(y) + 1);
+            // the mirrored rows at the edges are both the same row, so the
+            // three slots never collide
+            planar_row const& below = get_row(yb);
+            planar_row const& row = get_row(static_cast<std::ptrdiff_t>(y));
+            planar_row const& above = get_row(ya);
+            convolve_row(above, row, below, src + y * row_size, dst + y * row_size, width, kernel, out);
+        }
+    });
+}
+
+void stack_blur_rgba8(std::uint8_t * data, std::size_t width, std::size_t height, std::size_t row_size,
+                      unsigned rx, unsigned ry)
+{
+    if (width == 0 || height == 0) return;
+    unsigned threads = filter_threads(width, height);
+    if (rx > 0)
+    {
+        stack_blur_params params(rx);
+        std::size_t tasks = (height + task_rows - 1) / task_rows;
+        util::parallel_for(tasks, threads, [&](std::size_t task)
+        {
+            std::vector<std::uint8_t> line(width * 4);
+            std::vector<unsigned> state;
+            std::size_t y1 = std::min(height, (task + 1) * task_rows);
+            for (std::size_t y = task * task_rows; y < y1; ++y)
+            {
+                std::uint8_t * row = data + y * row_size;
+                std::memcpy(line.data(), row, width * 4);
+                stack_blur_line(line.data(), width, 4, row, 4, params, state);
+            }
+        });
+    }
+    if (ry > 0)
+    {
+        // walk down blocks of neighbouring columns together rather than one
+        // column at a time, touching whole cache lines of each row
+        stack_blur_params params(ry);
+        std::size_t tasks = (width + block_columns - 1) / block_columns;
+        util::parallel_for(tasks, threads, [&](std::size_t task)
+        {
+            std::size_t x0 = task * block_columns;
+            std::size_t lanes = std::min(block_columns, width - x0) * 4;
+            std::vector<std::uint8_t> block(lanes * height);
+            std::vector<unsigned> state;
+            for (std::size_t y = 0; y < height; ++y)
+            {
+                std::memcpy(block.data() + y * lanes, data + y * row_size + x0 * 4, lanes);
+            }
+            stack_blur_line(block.data(), height, lanes, data + x0 * 4, row_size, params, state);
+        });
+    }
+}
+
+}}}
@@ -36,6 +36,7 @@
 #include <mapnik/util/variant.hpp>
 #include <mapnik/debug.hpp>
 #include <mapnik/safe_cast.hpp>
+#include <mapnik/solid_tile_cache.hpp>
 #ifdef SSE_MATH
 #include <mapnik/sse.hpp>
 #endif
@@ -66,13 +67,83 @@ MAPNIK_DECL std::string save_to_string(T const& image,
     return ss.str();
 }
 
+namespace detail {
+
+// color of the first pixel of rgba8 images, the only ones solid_tile_cache
+// keeps encodings for
+struct rgba8_color_visitor
+{
+    rgba8_color_visitor(std::uint32_t & color, bool & premultiplied)
+        : color_(color),
+          premultiplied_(premultiplied) {}
+
+    template <typename T>
+    bool operator() (T const&) const
+    {
+        return false;
+    }
+
+    bool operator() (image_rgba8 const& image) const
+    {
+        return first_pixel(image);
+    }
+
+    bool operator() (image_view_rgba8 const& image) const
+    {
+        return first_pixel(image);
+    }
+
+    template <typename T>
+    bool first_pixel(T const& image) const
+    {
+        if (image.width() == 0 || image.height() == 0) return false;
+        color_ = image.get_row(0)[0];
+        premultiplied_ = image.get_premultiplied();
+        return true;
+    }
+
+    std::uint32_t & color_;
+    bool & premultiplied_;
+};
+
+template <typename T>
+bool rgba8_color(T const& image, std::uint32_t & color, bool & premultiplied)
+{
+    return rgba8_color_visitor(color, premultiplied)(image);
+}
+
+inline bool rgba8_color(image_any const& image, std::uint32_t & color, bool & premultiplied)
+{
+    return util::apply_visitor(rgba8_color_visitor(color, premultiplied), image);
+}
+
+inline bool rgba8_color(image_view_any const& image, std::uint32_t & color, bool & premultiplied)
+{
+    return util::apply_visitor(rgba8_color_visitor(color, premultiplied), image);
+}
+
+} // end detail ns
+
 template <typename T>
 MAPNIK_DECL std::string save_to_string(T const& image,
                                        std::string const& type)
 {
+    std::uint32_t color = 0;
+    bool premultiplied = false;
+    bool solid = detail::rgba8_color(image, color, premultiplied) && is_solid(image);
+    if (solid)
+    {
+        auto cached = solid_tile_cache::instance().find(color, image.width(), image.height(), premultiplied, type);
+        if (cached) return *cached;
+    }
     std::ostringstream ss(std::ios::out|std::ios::binary);
     save_to_stream(image, ss, type);
-    return ss.str();
+    std::string data = ss.str();
+    if (solid)
+    {
+        solid_tile_cache::instance().insert(color, image.width(), image.height(), premultiplied, type, data);
+    }
+    return data;
 }
 
 template <typename T>
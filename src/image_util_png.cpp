@@ -35,6 +35,7 @@ extern "C"
 #include <mapnik/png_io.hpp>
 #endif
 
+#include <mapnik/band_writer.hpp>
 #include <mapnik/image_util.hpp>
 #include <mapnik/image_util_png.hpp>
 #include <mapnik/image.hpp>
@@ -44,14 +45,61 @@ extern "C"
 #include <mapnik/util/conversions.hpp>
 
 // stl
+#include <algorithm>
 #include <string>
 #include <iostream>
+#include <memory>
+#include <thread>
 
 namespace mapnik
 {
 
 #if defined(HAVE_PNG)
 
+namespace {
+
+// Speed / size presets, e.g. "png:fast" or "png8:small". Explicit z, s and
+// f options take precedence over the preset whatever their position.
+void apply_png_preset(std::string const& preset,
+                      png_options & opts,
+                      bool set_compression,
+                      bool set_strategy,
+                      bool set_filters)
+{
+    int compression = Z_DEFAULT_COMPRESSION;
+    int strategy = Z_DEFAULT_STRATEGY;
+    int filters = PNG_FILTER_NONE;
+    if (preset == "fast")
+    {
+        // run length matching is several times cheaper than a full LZ77
+        // search and holds up well on the large flat areas of map tiles,
+        // the sub filter turns smooth rgba gradients into runs as well
+        compression = Z_BEST_SPEED;
+        strategy = Z_RLE;
+        if (!opts.paletted) filters = PNG_FILTER_SUB;
+    }
+    else if (preset == "balanced")
+    {
+        compression = 3;
+        if (!opts.paletted) filters = PNG_FILTER_SUB;
+    }
+    else if (preset == "small")
+    {
+        compression = Z_BEST_COMPRESSION;
+        // filtering rarely helps paletted images
+        if (!opts.paletted) filters = PNG_ALL_FILTERS;
+    }
+    else
+    {
+        throw image_writer_exception("unknown png preset: " + preset);
+    }
+    if (!set_compression) opts.compression = compression;
+    if (!set_strategy) opts.strategy = strategy;
+    if (!set_filters) opts.filters = filters;
+}
+
+} // anonymous namespace
+
 void handle_png_options(std::string const& type,
                         png_options & opts)
 {
@@ -68,6 +116,10 @@ void handle_png_options(std::string const& type,
 
     bool set_colors = false;
     bool set_gamma = false;
+    bool set_compression = false;
+    bool set_strategy = false;
+    bool set_filters = false;
+    boost::optional<std::string> preset;
 
     for (auto const& kv : parse_image_options(type))
     {
@@ -86,6 +138,11 @@ void handle_png_options(std::string const& type,
             if (*val == "o") opts.use_hextree = false;
             else if (*val == "h") opts.use_hextree = true;
         }
+        else if (key == "fast" || key == "balanced" || key == "small")
+        {
+            if (val) throw image_writer_exception("png preset does not take a value: " + key);
+            preset = key;
+        }
         else if (key == "e" && val && *val == "miniz")
         {
             throw image_writer_exception("miniz support has been removed from Mapnik");
@@ -105,6 +162,16 @@ void handle_png_options(std::string const& type,
                 throw image_writer_exception("invalid trans_mode parameter: " + to_string(val));
             }
         }
+        else if (key == "threads")
+        {
+            // deflate large images on several threads, 0 uses every core
+            int threads = 0;
+            if (!val || !mapnik::util::string2int(*val, threads) || threads < 0)
+            {
+                throw image_writer_exception("invalid threads parameter: " + to_string(val));
+            }
+            opts.threads = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+        }
         else if (key == "g")
         {
             set_gamma = true;
@@ -121,6 +188,7 @@ void handle_png_options(std::string const& type,
               #define Z_BEST_COMPRESSION       9
               #define Z_DEFAULT_COMPRESSION  (-1)
             */
+            set_compression = true;
             if (!val || !mapnik::util::string2int(*val, opts.compression)
                 || opts.compression < Z_DEFAULT_COMPRESSION
                 || opts.compression > 10) // use 10 here rather than Z_BEST_COMPRESSION (9) to allow for MZ_UBER_COMPRESSION
@@ -130,6 +198,7 @@ void handle_png_options(std::string const& type,
         }
         else if (key == "s")
         {
+            set_strategy = true;
             if (!val) throw image_writer_exception("invalid compression parameter: <uninitialised>");
 
             if (*val == "default")
@@ -164,6 +233,7 @@ void handle_png_options(std::string const& type,
             // filters = PNG_FAST_FILTERS;
             // filters = PNG_FILTER_NONE | PNG_FILTER_SUB | PNG_FILTER_UP | PNG_FILTER_AVG | PNG_FILTER_PAETH;
 
+            set_filters = true;
             if (!val) throw image_writer_exception("invalid filters parameter: <uninitialised>");
             if (*val == "no") opts.filters = PNG_NO_FILTERS;
             else if (*val == "all") opts.filters = PNG_ALL_FILTERS;
@@ -175,6 +245,10 @@ void handle_png_options(std::string const& type,
             throw image_writer_exception("unhandled png option: " + key);
         }
     }
+    if (preset)
+    {
+        apply_png_preset(*preset, opts, set_compression, set_strategy, set_filters);
+    }
     // validation
     if (!opts.paletted && set_colors)
     {
@@ -373,4 +447,99 @@ template void png_saver_pal::operator()<image_view_gray64> (image_view_gray64 co
 template void png_saver_pal::operator()<image_view_gray64s> (image_view_gray64s const& image) const;
 template void png_saver_pal::operator()<image_view_gray64f> (image_view_gray64f const& image) const;
 
+#if defined(HAVE_PNG)
+namespace {
+
+class png_band_writer : public band_writer
+{
+public:
+    png_band_writer(std::ostream & stream, png_options const& opts, unsigned width, unsigned height)
+        : png_ptr_(png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr)),
+          info_ptr_(nullptr),
+          width_(width),
+          height_(height),
+          row_(0)
+    {
+        if (!png_ptr_)
+        {
+            throw image_writer_exception("png band writer: could not create write struct");
+        }
+        info_ptr_ = png_create_info_struct(png_ptr_);
+        if (!info_ptr_)
+        {
+            png_destroy_write_struct(&png_ptr_, static_cast<png_infopp>(0));
+            throw image_writer_exception("png band writer: could not create info struct");
+        }
+        png_set_filter(png_ptr_, PNG_FILTER_TYPE_BASE, opts.filters);
+        png_set_write_fn(png_ptr_, &stream, &write_data<std::ostream>, &flush_data<std::ostream>);
+        png_set_compression_level(png_ptr_, opts.compression);
+        png_set_compression_strategy(png_ptr_, opts.strategy);
+        png_set_compression_buffer_size(png_ptr_, 32768);
+        png_set_IHDR(png_ptr_, info_ptr_, width, height, 8,
+                     (opts.trans_mode == 0) ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
+                     PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(png_ptr_, info_ptr_);
+        if (opts.trans_mode == 0)
+        {
+            // drop the alpha byte of the rgba rows
+            png_set_filler(png_ptr_, 0, PNG_FILLER_AFTER);
+        }
+    }
+
+    ~png_band_writer()
+    {
+        png_destroy_write_struct(&png_ptr_, &info_ptr_);
+    }
+
+    void write(image_rgba8 const& band)
+    {
+        if (band.width() != width_ || row_ + band.height() > height_)
+        {
+            throw image_writer_exception("png band writer: band does not fit the image");
+        }
+        for (std::size_t y = 0; y < band.height(); ++y)
+        {
+            png_write_row(png_ptr_, const_cast<png_bytep>(reinterpret_cast<unsigned char const*>(band.get_row(y))));
+        }
+        row_ += band.height();
+    }
+
+    void close()
+    {
+        if (row_ != height_)
+        {
+            throw image_writer_exception("png band writer: image is incomplete");
+        }
+        png_write_end(png_ptr_, info_ptr_);
+    }
+
+private:
+    png_structp png_ptr_;
+    png_infop info_ptr_;
+    unsigned width_;
+    unsigned height_;
+    unsigned row_;
+};
+
+}
+#endif
+
+std::unique_ptr<band_writer> create_png_band_writer(std::ostream & stream,
+                                                    std::string const& t,
+                                                    unsigned width,
+                                                    unsigned height)
+{
+#if defined(HAVE_PNG)
+    png_options opts;
+    handle_png_options(t, opts);
+    if (opts.paletted)
+    {
+        throw image_writer_exception("paletted png can not be written in bands: '" + t + "'");
+    }
+    return std::make_unique<png_band_writer>(stream, opts, width, height);
+#else
+    throw image_writer_exception("png output is not enabled in your build of Mapnik");
+#endif
+}
+
 } // end ns
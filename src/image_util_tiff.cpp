@@ -25,6 +25,7 @@
 #include <mapnik/tiff_io.hpp>
 #endif
 
+#include <mapnik/band_writer.hpp>
 #include <mapnik/image_util.hpp>
 #include <mapnik/image_util_tiff.hpp>
 #include <mapnik/image.hpp>
@@ -33,7 +34,11 @@
 #include <mapnik/util/conversions.hpp>
 
 // stl
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace mapnik
 {
@@ -142,6 +147,19 @@ void handle_tiff_options(std::string const& type,
                     }
                 }
             }
+            else if (key == "threads")
+            {
+                if (val && !(*val).empty())
+                {
+                    int threads = 0;
+                    if (!mapnik::util::string2int(*val,threads) || threads < 0)
+                    {
+                        throw image_writer_exception("invalid tiff threads: '" + *val + "'");
+                    }
+                    // zero uses every core
+                    config.threads = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+                }
+            }
             else
             {
                 throw image_writer_exception("unhandled tiff option: " + key);
@@ -201,4 +219,103 @@ template void tiff_saver::operator()<image_view_gray64> (image_view_gray64 const
 template void tiff_saver::operator()<image_view_gray64s> (image_view_gray64s const& image) const;
 template void tiff_saver::operator()<image_view_gray64f> (image_view_gray64f const& image) const;
 
+#if defined(HAVE_TIFF)
+namespace {
+
+class tiff_band_writer : public band_writer
+{
+public:
+    tiff_band_writer(std::ostream & stream, tiff_config const& config, unsigned width, unsigned height)
+        : output_(nullptr),
+          row_buffer_(width),
+          width_(width),
+          height_(height),
+          row_(0)
+    {
+        output_ = RealTIFFOpen("mapnik_tiff_stream",
+                               "wm",
+                               (thandle_t)&stream,
+                               tiff_dummy_read_proc,
+                               tiff_write_proc,
+                               tiff_seek_proc,
+                               tiff_close_proc,
+                               tiff_size_proc,
+                               tiff_dummy_map_proc,
+                               tiff_dummy_unmap_proc);
+        if (!output_)
+        {
+            throw image_writer_exception("Could not write TIFF");
+        }
+        TIFFSetField(output_, TIFFTAG_IMAGEWIDTH, width);
+        TIFFSetField(output_, TIFFTAG_IMAGELENGTH, height);
+        TIFFSetField(output_, TIFFTAG_IMAGEDEPTH, 1);
+        set_tiff_config(output_, config);
+        // bands are not premultiplied
+        tag_setter set(output_, config);
+        set(image_rgba8());
+        std::size_t rows_per_strip = config.rows_per_strip;
+        if (0 == rows_per_strip)
+        {
+            rows_per_strip = std::max<std::size_t>(1, detail::tiff_strip_bytes / (width * sizeof(image_rgba8::pixel_type)));
+        }
+        TIFFSetField(output_, TIFFTAG_ROWSPERSTRIP, rows_per_strip);
+    }
+
+    ~tiff_band_writer()
+    {
+        if (output_) RealTIFFClose(output_);
+    }
+
+    void write(image_rgba8 const& band)
+    {
+        if (band.width() != width_ || row_ + band.height() > height_)
+        {
+            throw image_writer_exception("tiff band writer: band does not fit the image");
+        }
+        for (std::size_t y = 0; y < band.height(); ++y, ++row_)
+        {
+            // libtiff applies the predictor in place
+            std::copy(band.get_row(y), band.get_row(y) + width_, row_buffer_.begin());
+            if (TIFFWriteScanline(output_, row_buffer_.data(), row_, 0) == -1)
+            {
+                throw image_writer_exception("Could not write TIFF - TIFF Scanline Write failed");
+            }
+        }
+    }
+
+    void close()
+    {
+        if (row_ != height_)
+        {
+            throw image_writer_exception("tiff band writer: image is incomplete");
+        }
+        RealTIFFClose(output_);
+        output_ = nullptr;
+    }
+
+private:
+    TIFF * output_;
+    std::vector<image_rgba8::pixel_type> row_buffer_;
+    unsigned width_;
+    unsigned height_;
+    unsigned row_;
+};
+
+}
+#endif
+
+std::unique_ptr<band_writer> create_tiff_band_writer(std::ostream & stream,
+                                                     std::string const& t,
+                                                     unsigned width,
+                                                     unsigned height)
+{
+#if defined(HAVE_TIFF)
+    tiff_config config;
+    handle_tiff_options(t, config);
+    return std::make_unique<tiff_band_writer>(stream, config, width, height);
+#else
+    throw image_writer_exception("tiff output is not enabled in your build of Mapnik");
+#endif
+}
+
 } // end ns
@@ -0,0 +1,213 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+// mapnik
+#include <mapnik/label_placement_store.hpp>
+
+// stl
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace mapnik
+{
+
+label_placement_store::label_placement_store(double cell_size, std::size_t max_labels)
+    : cell_size_(cell_size > 0 ? cell_size : 1.0),
+      max_labels_(max_labels),
+      evicted_(0),
+      labels_(),
+      cells_(),
+      oversized_() {}
+
+std::uint64_t label_placement_store::cell_key(std::int64_t col, std::int64_t row)
+{
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(col)) << 32) |
+        static_cast<std::uint32_t>(row);
+}
+
+// false for boxes with NaNs or inverted corners, and for boxes spanning
+// more than max_label_cells
+bool label_placement_store::cell_range(box2d<double> const& box, std::int64_t & c0, std::int64_t & r0,
+                                       std::int64_t & c1, std::int64_t & r1) const
+{
+    if (!(box.minx() <= box.maxx() && box.miny() <= box.maxy())) return false;
+    // far beyond any map, keeps the cells in range of a 32 bit key
+    double const limit = static_cast<double>(std::numeric_limits<std::int32_t>::max());
+    auto cell = [&](double v) {
+        return static_cast<std::int64_t>(std::min(std::max(std::floor(v / cell_size_), -limit), limit));
+    };
+    c0 = cell(box.minx());
+    c1 = cell(box.maxx());
+    r0 = cell(box.miny());
+    r1 = cell(box.maxy());
+    std::int64_t const max_cells = static_cast<std::int64_t>(max_label_cells);
+    return (c1 - c0 < max_cells) && (r1 - r0 < max_cells) && (c1 - c0 + 1) * (r1 - r0 + 1) <= max_cells;
+}
+
+// Calls func with the index of every label that may intersect box, once
+// each and in insertion order.
+template <typename F>
+void label_placement_store::visit(box2d<double> const& box, F && func) const
+{
+    std::int64_t c0, r0, c1, r1;
+    if (!cell_range(box, c0, r0, c1, r1))
+    {
+        for (std::uint32_t index = 0; index < labels_.size(); ++index)
+        {
+            func(index);
+        }
+        return;
+    }
+    std::vector<std::uint32_t> indices(oversized_);
+    for (std::int64_t r = r0; r <= r1; ++r)
+    {
+        for (std::int64_t c = c0; c <= c1; ++c)
+        {
+            auto itr = cells_.find(cell_key(c, r));
+            if (itr != cells_.end())
+            {
+                indices.insert(indices.end(), itr->second.begin(), itr->second.end());
+            }
+        }
+    }
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    for (std::uint32_t index : indices)
+    {
+        func(index);
+    }
+}
+
+std::vector<placed_label> label_placement_store::query(box2d<double> const& box) const
+{
+    std::vector<placed_label> result;
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    visit(box, [&](std::uint32_t index) {
+            if (labels_[index].box.intersects(box))
+            {
+                result.push_back(labels_[index]);
+            }
+        });
+    return result;
+}
+
+bool label_placement_store::insert(box2d<double> const& box, value_unicode_string const& text)
+{
+    // the same label placed by another render, up to rounding in the
+    // transforms between them
+    double const eps = cell_size_ * 1e-6;
+    auto same = [&](box2d<double> const& other) {
+        return std::abs(other.minx() - box.minx()) < eps
+            && std::abs(other.miny() - box.miny()) < eps
+            && std::abs(other.maxx() - box.maxx()) < eps
+            && std::abs(other.maxy() - box.maxy()) < eps;
+    };
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    bool found = false;
+    visit(box, [&](std::uint32_t index) {
+            found = found || (same(labels_[index].box) && labels_[index].text == text);
+        });
+    if (found) return false;
+
+    labels_.push_back(placed_label{box, text});
+    index_label(static_cast<std::uint32_t>(labels_.size() - 1));
+    if (max_labels_ > 0 && labels_.size() > max_labels_)
+    {
+        evict();
+    }
+    return true;
+}
+
+void label_placement_store::index_label(std::uint32_t index)
+{
+    std::int64_t c0, r0, c1, r1;
+    if (cell_range(labels_[index].box, c0, r0, c1, r1))
+    {
+        for (std::int64_t r = r0; r <= r1; ++r)
+        {
+            for (std::int64_t c = c0; c <= c1; ++c)
+            {
+                cells_[cell_key(c, r)].push_back(index);
+            }
+        }
+    }
+    else
+    {
+        oversized_.push_back(index);
+    }
+}
+
+// Drops the oldest labels down to three quarters of max_labels_ and
+// rebuilds the index, so the cost is spread over the labels inserted
+// before the next eviction.
+void label_placement_store::evict()
+{
+    std::size_t keep = max_labels_ - max_labels_ / 4;
+    std::size_t drop = labels_.size() - keep;
+    labels_.erase(labels_.begin(), labels_.begin() + static_cast<std::ptrdiff_t>(drop));
+    evicted_ += drop;
+    cells_.clear();
+    oversized_.clear();
+    for (std::uint32_t index = 0; index < labels_.size(); ++index)
+    {
+        index_label(index);
+    }
+}
+
+std::size_t label_placement_store::size() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return labels_.size();
+}
+
+std::size_t label_placement_store::max_labels() const
+{
+    return max_labels_;
+}
+
+std::size_t label_placement_store::evicted() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return evicted_;
+}
+
+void label_placement_store::clear()
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    labels_.clear();
+    cells_.clear();
+    oversized_.clear();
+}
+
+}
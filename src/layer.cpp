@@ -40,6 +40,7 @@ layer::layer(std::string const& _name, std::string const& _srs)
       queryable_(false),
       clear_label_cache_(false),
       cache_features_(false),
+      stream_features_(false),
       group_by_(),
       styles_(),
       ds_(),
@@ -55,6 +56,7 @@ layer::layer(layer const& rhs)
       queryable_(rhs.queryable_),
       clear_label_cache_(rhs.clear_label_cache_),
       cache_features_(rhs.cache_features_),
+      stream_features_(rhs.stream_features_),
       group_by_(rhs.group_by_),
       styles_(rhs.styles_),
       ds_(rhs.ds_),
@@ -70,6 +72,7 @@ layer::layer(layer && rhs)
       queryable_(std::move(rhs.queryable_)),
       clear_label_cache_(std::move(rhs.clear_label_cache_)),
       cache_features_(std::move(rhs.cache_features_)),
+      stream_features_(std::move(rhs.stream_features_)),
       group_by_(std::move(rhs.group_by_)),
       styles_(std::move(rhs.styles_)),
       ds_(std::move(rhs.ds_)),
@@ -87,6 +90,7 @@ layer& layer::operator=(layer rhs)
     std::swap(this->queryable_, rhs.queryable_);
     std::swap(this->clear_label_cache_, rhs.clear_label_cache_);
     std::swap(this->cache_features_, rhs.cache_features_);
+    std::swap(this->stream_features_, rhs.stream_features_);
     std::swap(this->group_by_, rhs.group_by_);
     std::swap(this->styles_, rhs.styles_);
     std::swap(this->ds_, rhs.ds_);
@@ -105,6 +109,7 @@ bool layer::operator==(layer const& rhs) const
         (queryable_ == rhs.queryable_) &&
         (clear_label_cache_ == rhs.clear_label_cache_) &&
         (cache_features_ == rhs.cache_features_) &&
+        (stream_features_ == rhs.stream_features_) &&
         (group_by_ == rhs.group_by_) &&
         (styles_ == rhs.styles_) &&
         ((ds_ && rhs.ds_) ? *ds_ == *rhs.ds_ : ds_ == rhs.ds_) &&
@@ -260,6 +265,16 @@ bool layer::cache_features() const
     return cache_features_;
 }
 
+void layer::set_stream_features(bool _stream_features)
+{
+    stream_features_ = _stream_features;
+}
+
+bool layer::stream_features() const
+{
+    return stream_features_;
+}
+
 void layer::set_group_by(std::string const& column)
 {
     group_by_ = column;
@@ -643,6 +643,13 @@ void map_parser::parse_layer(Map & map, xml_node const& node)
             lyr.set_cache_features(* cache_features);
         }
 
+        optional<mapnik::boolean_type> stream_features =
+            node.get_opt_attr<mapnik::boolean_type>("stream-features");
+        if (stream_features)
+        {
+            lyr.set_stream_features(* stream_features);
+        }
+
         optional<std::string> group_by =
             node.get_opt_attr<std::string>("group-by");
         if (group_by)
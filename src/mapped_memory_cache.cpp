@@ -39,12 +39,82 @@ namespace mapnik
 
 template class singleton<mapped_memory_cache, CreateStatic>;
 
+mapped_memory_cache::mapped_memory_cache()
+    : cache_(),
+      lru_(),
+      max_mappings_(0),
+      max_bytes_(0),
+      hint_(ACCESS_NORMAL),
+      stats_() {}
+
 void mapped_memory_cache::clear()
 {
 #ifdef MAPNIK_THREADSAFE
     std::lock_guard<std::mutex> lock(mutex_);
 #endif
-    return cache_.clear();
+    cache_.clear();
+    lru_.clear();
+    stats_.bytes = 0;
+}
+
+void mapped_memory_cache::set_max_mappings(std::size_t max_mappings)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    max_mappings_ = max_mappings;
+    evict();
+}
+
+std::size_t mapped_memory_cache::max_mappings() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return max_mappings_;
+}
+
+void mapped_memory_cache::set_max_bytes(std::size_t max_bytes)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    max_bytes_ = max_bytes;
+    evict();
+}
+
+std::size_t mapped_memory_cache::max_bytes() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return max_bytes_;
+}
+
+void mapped_memory_cache::set_access_hint(access_hint hint)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    hint_ = hint;
+}
+
+mapped_memory_cache::access_hint mapped_memory_cache::get_access_hint() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return hint_;
+}
+
+mapped_memory_cache_stats mapped_memory_cache::stats()
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    mapped_memory_cache_stats result = stats_;
+    result.mappings = cache_.size();
+    return result;
 }
 
 bool mapped_memory_cache::insert(std::string const& uri, mapped_region_ptr mem)
@@ -52,7 +122,64 @@ bool mapped_memory_cache::insert(std::string const& uri, mapped_region_ptr mem)
 #ifdef MAPNIK_THREADSAFE
     std::lock_guard<std::mutex> lock(mutex_);
 #endif
-    return cache_.emplace(uri,mem).second;
+    if (cache_.find(uri) != cache_.end()) return false;
+    insert_impl(uri, mem);
+    return true;
+}
+
+void mapped_memory_cache::insert_impl(std::string const& uri, mapped_region_ptr const& mem)
+{
+    lru_.push_front(uri);
+    std::size_t bytes = mem ? mem->get_size() : 0;
+    cache_.emplace(uri, entry{mem, bytes, lru_.begin()});
+    stats_.bytes += bytes;
+    evict();
+}
+
+void mapped_memory_cache::evict()
+{
+    if (max_mappings_ == 0 && max_bytes_ == 0) return;
+    auto over_budget = [this]()
+    {
+        return (max_mappings_ > 0 && cache_.size() > max_mappings_) ||
+            (max_bytes_ > 0 && stats_.bytes > max_bytes_);
+    };
+    auto itr = lru_.end();
+    while (itr != lru_.begin() && over_budget())
+    {
+        --itr;
+        auto entry_itr = cache_.find(*itr);
+        // still referenced by a reader
+        if (entry_itr->second.region.use_count() > 1) continue;
+        stats_.bytes -= entry_itr->second.bytes;
+        cache_.erase(entry_itr);
+        itr = lru_.erase(itr);
+        ++stats_.evictions;
+    }
+}
+
+namespace {
+
+void apply_access_hint(boost::interprocess::mapped_region & region,
+                       mapped_memory_cache::access_hint hint)
+{
+    using region_type = boost::interprocess::mapped_region;
+    switch (hint)
+    {
+    case mapped_memory_cache::ACCESS_SEQUENTIAL:
+        region.advise(region_type::advice_sequential);
+        break;
+    case mapped_memory_cache::ACCESS_RANDOM:
+        region.advise(region_type::advice_random);
+        break;
+    case mapped_memory_cache::ACCESS_WILLNEED:
+        region.advise(region_type::advice_willneed);
+        break;
+    default:
+        break;
+    }
+}
+
 }
 
 boost::optional<mapped_region_ptr> mapped_memory_cache::find(std::string const& uri, bool update_cache)
@@ -61,14 +188,17 @@ boost::optional<mapped_region_ptr> mapped_memory_cache::find(std::string const&
     std::lock_guard<std::mutex> lock(mutex_);
 #endif
 
-    using iterator_type = std::unordered_map<std::string, mapped_region_ptr>::const_iterator;
+    using iterator_type = std::unordered_map<std::string, entry>::const_iterator;
     boost::optional<mapped_region_ptr> result;
     iterator_type itr = cache_.find(uri);
     if (itr != cache_.end())
     {
-        result.reset(itr->second);
+        ++stats_.hits;
+        lru_.splice(lru_.begin(), lru_, itr->second.lru_pos);
+        result.reset(itr->second.region);
         return result;
     }
+    ++stats_.misses;
 
     if (mapnik::util::exists(uri))
     {
@@ -76,10 +206,11 @@ boost::optional<mapped_region_ptr> mapped_memory_cache::find(std::string const&
         {
             boost::interprocess::file_mapping mapping(uri.c_str(),boost::interprocess::read_only);
             mapped_region_ptr region(std::make_shared<boost::interprocess::mapped_region>(mapping,boost::interprocess::read_only));
+            apply_access_hint(*region, hint_);
             result.reset(region);
             if (update_cache)
             {
-                cache_.emplace(uri, *result);
+                insert_impl(uri, region);
             }
             return result;
         }
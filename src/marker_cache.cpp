@@ -49,7 +49,8 @@ namespace mapnik
 {
 
 marker_cache::marker_cache()
-    : known_svg_prefix_("shape://"),
+    : max_bytes_(0),
+      known_svg_prefix_("shape://"),
       known_image_prefix_("image://")
 {
     insert_svg("ellipse",
@@ -62,36 +63,81 @@ marker_cache::marker_cache()
                "<svg width='100%' height='100%' version='1.1' xmlns='http://www.w3.org/2000/svg'>"
                "<path fill='#0000FF' stroke='black' stroke-width='.5' d='m 31.698405,7.5302648 -8.910967,-6.0263712 0.594993,4.8210971 -18.9822542,0 0,2.4105482 18.9822542,0 -0.594993,4.8210971 z'/>"
                "</svg>");
-    marker_cache_.emplace("image://square",std::make_shared<mapnik::marker const>(mapnik::marker_rgba8()));
+    insert_marker("image://square",std::make_shared<mapnik::marker const>(mapnik::marker_rgba8()));
 }
 
 marker_cache::~marker_cache() {}
 
+marker_cache::shard & marker_cache::shard_for(std::string const& key)
+{
+    return shards_[std::hash<std::string>()(key) % num_shards];
+}
+
 void marker_cache::clear()
 {
+    for (shard & s : shards_)
+    {
 #ifdef MAPNIK_THREADSAFE
-    std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<std::mutex> lock(s.mutex);
 #endif
-    auto itr = marker_cache_.begin();
-    while(itr != marker_cache_.end())
-    {
-        if (!is_uri(itr->first))
-        {
-           marker_cache_.erase(itr++);
-        }
-        else
+        auto itr = s.entries.begin();
+        while(itr != s.entries.end())
         {
-            ++itr;
+            if (!itr->second.pinned)
+            {
+                s.lru.erase(itr->second.lru_pos);
+                s.bytes -= itr->second.bytes;
+                itr = s.entries.erase(itr);
+            }
+            else
+            {
+                ++itr;
+            }
         }
     }
 }
 
-bool marker_cache::is_svg_uri(std::string const& path)
+void marker_cache::set_max_bytes(std::size_t max_bytes)
+{
+    max_bytes_ = max_bytes;
+    if (max_bytes == 0) return;
+    for (shard & s : shards_)
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(s.mutex);
+#endif
+        evict(s, max_bytes / num_shards);
+    }
+}
+
+std::size_t marker_cache::max_bytes() const
+{
+    return max_bytes_;
+}
+
+marker_cache_stats marker_cache::stats() const
+{
+    marker_cache_stats result;
+    for (shard & s : shards_)
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(s.mutex);
+#endif
+        result.hits += s.hits;
+        result.misses += s.misses;
+        result.evictions += s.evictions;
+        result.entries += s.entries.size();
+        result.bytes += s.bytes;
+    }
+    return result;
+}
+
+bool marker_cache::is_svg_uri(std::string const& path) const
 {
     return boost::algorithm::starts_with(path,known_svg_prefix_);
 }
 
-bool marker_cache::is_image_uri(std::string const& path)
+bool marker_cache::is_image_uri(std::string const& path) const
 {
     return boost::algorithm::starts_with(path,known_image_prefix_);
 }
@@ -107,14 +153,6 @@ bool marker_cache::insert_svg(std::string const& name, std::string const& svg_st
     return false;
 }
 
-bool marker_cache::insert_marker(std::string const& uri, mapnik::marker && path)
-{
-#ifdef MAPNIK_THREADSAFE
-    std::lock_guard<std::mutex> lock(mutex_);
-#endif
-    return marker_cache_.emplace(uri,std::make_shared<mapnik::marker const>(std::move(path))).second;
-}
-
 namespace detail
 {
 
@@ -138,8 +176,71 @@ struct visitor_create_marker
     }
 };
 
+struct visitor_marker_bytes
+{
+    std::size_t operator() (marker_rgba8 const& mark) const
+    {
+        return mark.get_data().size();
+    }
+
+    std::size_t operator() (marker_svg const& mark) const
+    {
+        svg_path_ptr data = mark.get_data();
+        if (!data) return 0;
+        return data->source().capacity() * sizeof(svg::svg_path_storage::value_type) +
+            data->attributes().size() * sizeof(svg::path_attributes);
+    }
+
+    std::size_t operator() (marker_null const&) const
+    {
+        return 0;
+    }
+};
+
 } // end detail ns
 
+std::shared_ptr<mapnik::marker const> marker_cache::insert_marker(std::string const& uri,
+                                                                  std::shared_ptr<mapnik::marker const> const& mark)
+{
+    shard & s = shard_for(uri);
+    bool pinned = is_uri(uri);
+    std::size_t bytes = util::apply_visitor(detail::visitor_marker_bytes(), *mark);
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(s.mutex);
+#endif
+    auto result = s.entries.emplace(uri, entry{mark, bytes, pinned, s.lru.end()});
+    if (!result.second)
+    {
+        // loaded concurrently by another thread
+        return result.first->second.marker;
+    }
+    s.bytes += bytes;
+    if (!pinned)
+    {
+        s.lru.push_front(uri);
+        result.first->second.lru_pos = s.lru.begin();
+        std::size_t max_bytes = max_bytes_;
+        if (max_bytes > 0)
+        {
+            evict(s, max_bytes / num_shards);
+        }
+    }
+    return mark;
+}
+
+void marker_cache::evict(shard & s, std::size_t max_bytes)
+{
+    // the most recently used entry is kept even if it exceeds the budget on its own
+    while (s.bytes > max_bytes && s.lru.size() > 1)
+    {
+        auto itr = s.entries.find(s.lru.back());
+        s.bytes -= itr->second.bytes;
+        s.entries.erase(itr);
+        s.lru.pop_back();
+        ++s.evictions;
+    }
+}
+
 std::shared_ptr<mapnik::marker const> marker_cache::find(std::string const& uri,
                                                          bool update_cache)
 {
@@ -148,15 +249,39 @@ std::shared_ptr<mapnik::marker const> marker_cache::find(std::string const& uri,
         return std::make_shared<mapnik::marker const>(mapnik::marker_null());
     }
 
+    {
+        shard & s = shard_for(uri);
 #ifdef MAPNIK_THREADSAFE
-    std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<std::mutex> lock(s.mutex);
 #endif
-    auto itr = marker_cache_.find(uri);
-    if (itr != marker_cache_.end())
+        auto itr = s.entries.find(uri);
+        if (itr != s.entries.end())
+        {
+            ++s.hits;
+            if (!itr->second.pinned)
+            {
+                s.lru.splice(s.lru.begin(), s.lru, itr->second.lru_pos);
+            }
+            return itr->second.marker;
+        }
+        ++s.misses;
+    }
+
+    // markers are loaded without holding any lock
+    std::shared_ptr<mapnik::marker const> mark = load(uri);
+    if (!mark)
+    {
+        return std::make_shared<mapnik::marker const>(mapnik::marker_null());
+    }
+    if (update_cache)
     {
-        return itr->second;
+        return insert_marker(uri, mark);
     }
+    return mark;
+}
 
+std::shared_ptr<mapnik::marker const> marker_cache::load(std::string const& uri) const
+{
     try
     {
         // if uri references a built-in marker
@@ -166,7 +291,7 @@ std::shared_ptr<mapnik::marker const> marker_cache::find(std::string const& uri,
             if (mark_itr == svg_cache_.end())
             {
                 MAPNIK_LOG_ERROR(marker_cache) << "Marker does not exist: " << uri;
-                return std::make_shared<mapnik::marker const>(mapnik::marker_null());
+                return nullptr;
             }
             std::string known_svg_string = mark_itr->second;
             using namespace mapnik::svg;
@@ -182,22 +307,14 @@ std::shared_ptr<mapnik::marker const> marker_cache::find(std::string const& uri,
                 {
                     MAPNIK_LOG_ERROR(marker_cache) <<  "SVG PARSING ERROR:\"" << msg << "\"";
                 }
-                return std::make_shared<mapnik::marker const>(mapnik::marker_null());
+                return nullptr;
             }
             //svg.arrange_orientations();
             double lox,loy,hix,hiy;
             svg.bounding_rect(&lox, &loy, &hix, &hiy);
             marker_path->set_bounding_box(lox,loy,hix,hiy);
             marker_path->set_dimensions(svg.width(),svg.height());
-            if (update_cache)
-            {
-                auto emplace_result = marker_cache_.emplace(uri,std::make_shared<mapnik::marker const>(mapnik::marker_svg(marker_path)));
-                return emplace_result.first->second;
-            }
-            else
-            {
-                return std::make_shared<mapnik::marker const>(mapnik::marker_svg(marker_path));
-            }
+            return std::make_shared<mapnik::marker const>(mapnik::marker_svg(marker_path));
         }
         // otherwise assume file-based
         else
@@ -205,7 +322,7 @@ std::shared_ptr<mapnik::marker const> marker_cache::find(std::string const& uri,
             if (!mapnik::util::exists(uri))
             {
                 MAPNIK_LOG_ERROR(marker_cache) << "Marker does not exist: " << uri;
-                return std::make_shared<mapnik::marker const>(mapnik::marker_null());
+                return nullptr;
             }
             if (is_svg(uri))
             {
@@ -223,22 +340,14 @@ std::shared_ptr<mapnik::marker const> marker_cache::find(std::string const& uri,
                     {
                         MAPNIK_LOG_ERROR(marker_cache) <<  "SVG PARSING ERROR:\"" << msg << "\"";
                     }
-                    return std::make_shared<mapnik::marker const>(mapnik::marker_null());
+                    return nullptr;
                 }
                 //svg.arrange_orientations();
                 double lox,loy,hix,hiy;
                 svg.bounding_rect(&lox, &loy, &hix, &hiy);
                 marker_path->set_bounding_box(lox,loy,hix,hiy);
                 marker_path->set_dimensions(svg.width(),svg.height());
-                if (update_cache)
-                {
-                    auto emplace_result = marker_cache_.emplace(uri,std::make_shared<mapnik::marker const>(mapnik::marker_svg(marker_path)));
-                    return emplace_result.first->second;
-                }
-                else
-                {
-                    return std::make_shared<mapnik::marker const>(mapnik::marker_svg(marker_path));
-                }
+                return std::make_shared<mapnik::marker const>(mapnik::marker_svg(marker_path));
             }
             else
             {
@@ -250,25 +359,14 @@ std::shared_ptr<mapnik::marker const> marker_cache::find(std::string const& uri,
                     unsigned height = reader->height();
                     BOOST_ASSERT(width > 0 && height > 0);
                     image_any im = reader->read(0,0,width,height);
-                    if (update_cache)
-                    {
-                        auto emplace_result = marker_cache_.emplace(uri,
-                                std::make_shared<mapnik::marker const>(
-                                    util::apply_visitor(detail::visitor_create_marker(), im)
-                                ));
-                        return emplace_result.first->second;
-                    }
-                    else
-                    {
-                        return std::make_shared<mapnik::marker const>(
-                            util::apply_visitor(detail::visitor_create_marker(), im)
-                        );
-                    }
+                    return std::make_shared<mapnik::marker const>(
+                        util::apply_visitor(detail::visitor_create_marker(), im)
+                    );
                 }
                 else
                 {
                     MAPNIK_LOG_ERROR(marker_cache) << "could not initialize reader for: '" << uri << "'";
-                    return std::make_shared<mapnik::marker const>(mapnik::marker_null());
+                    return nullptr;
                 }
             }
         }
@@ -277,7 +375,7 @@ std::shared_ptr<mapnik::marker const> marker_cache::find(std::string const& uri,
     {
         MAPNIK_LOG_ERROR(marker_cache) << "Exception caught while loading: '" << uri << "' (" << ex.what() << ")";
     }
-    return std::make_shared<mapnik::marker const>(mapnik::marker_null());
+    return nullptr;
 }
 
 }
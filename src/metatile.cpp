@@ -0,0 +1,159 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+// mapnik
+#include <mapnik/metatile.hpp>
+#include <mapnik/map.hpp>
+#include <mapnik/layer.hpp>
+#include <mapnik/agg_renderer.hpp>
+#include <mapnik/image_util.hpp>
+#include <mapnik/projection.hpp>
+#include <mapnik/scale_denominator.hpp>
+#include <mapnik/util/parallel_for.hpp>
+
+// stl
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <stdexcept>
+
+namespace mapnik
+{
+
+namespace {
+
+// size in pixels of `count` tiles, checked before anything is allocated
+unsigned metatile_pixels(unsigned count, unsigned tile_size)
+{
+    if (count == 0 || tile_size == 0)
+    {
+        throw std::runtime_error("metatile: cols, rows and tile size must be greater than zero");
+    }
+    std::uint64_t pixels = static_cast<std::uint64_t>(count) * tile_size;
+    if (pixels > std::numeric_limits<unsigned>::max())
+    {
+        throw std::runtime_error("metatile: cols and rows times tile size must fit in an unsigned");
+    }
+    return static_cast<unsigned>(pixels);
+}
+
+}
+
+metatile::metatile(box2d<double> const& extent,
+                   unsigned cols,
+                   unsigned rows,
+                   unsigned tile_size)
+    : req_(metatile_pixels(cols, tile_size), metatile_pixels(rows, tile_size), extent),
+      cols_(cols),
+      rows_(rows),
+      tile_size_(tile_size),
+      image_(req_.width(), req_.height()) {}
+
+void metatile::set_buffer_size(int buffer_size)
+{
+    req_.set_buffer_size(buffer_size);
+}
+
+int metatile::buffer_size() const
+{
+    return req_.buffer_size();
+}
+
+unsigned metatile::cols() const
+{
+    return cols_;
+}
+
+unsigned metatile::rows() const
+{
+    return rows_;
+}
+
+unsigned metatile::tile_size() const
+{
+    return tile_size_;
+}
+
+request const& metatile::get_request() const
+{
+    return req_;
+}
+
+void metatile::render(Map const& m, double scale_factor, attributes const& vars)
+{
+    // layers are queried with the request's size, extent and buffer rather
+    // than the map's, so the caller's map is rendered as is. The image
+    // allocated by the constructor is cleared and drawn into directly.
+    fill(image_, 0);
+    image_.painted(false);
+    agg_renderer<image_rgba8> ren(m, req_, vars, image_, scale_factor);
+    projection proj(m.srs(), true);
+    double scale = req_.extent().width() / req_.width();
+    double scale_denom = scale_denominator(scale, proj.is_geographic()) * scale_factor;
+    ren.start_map_processing(m);
+    for (layer const& lyr : m.layers())
+    {
+        if (lyr.visible(scale_denom))
+        {
+            std::set<std::string> names;
+            ren.apply_to_layer(lyr,
+                               ren,
+                               proj,
+                               scale,
+                               scale_denom,
+                               req_.width(),
+                               req_.height(),
+                               req_.extent(),
+                               req_.buffer_size(),
+                               names);
+        }
+    }
+    ren.end_map_processing(m);
+}
+
+image_rgba8 const& metatile::image() const
+{
+    return image_;
+}
+
+image_view_rgba8 metatile::tile(unsigned x, unsigned y) const
+{
+    if (x >= cols_ || y >= rows_)
+    {
+        throw std::out_of_range("metatile: tile index out of range");
+    }
+    return image_view_rgba8(x * tile_size_, y * tile_size_, tile_size_, tile_size_, image_);
+}
+
+std::vector<std::string> metatile::encode(std::string const& format, unsigned threads) const
+{
+    std::size_t num_tiles = static_cast<std::size_t>(cols_) * rows_;
+    std::vector<std::string> tiles(num_tiles);
+    util::parallel_for(num_tiles, threads, [&](std::size_t i)
+    {
+        tiles[i] = save_to_string(tile(i % cols_, i / cols_), format);
+    });
+    return tiles;
+}
+
+}
@@ -57,6 +57,15 @@ rgba_palette::rgba_palette(std::string const& pal, palette_type type)
     parse(pal, type);
 }
 
+rgba_palette::rgba_palette(std::vector<rgba> const& colors)
+    : colors_(0)
+{
+#ifdef USE_DENSE_HASH_MAP
+    color_hashmap_.set_empty_key(0);
+#endif
+    assign(std::vector<rgba>(colors));
+}
+
 rgba_palette::rgba_palette()
     : colors_(0)
 {
@@ -99,76 +108,85 @@ std::string rgba_palette::to_string() const
 // return color index in returned earlier palette
 unsigned char rgba_palette::quantize(unsigned val) const
 {
-    unsigned char index = 0;
-    if (colors_ == 1 || val == 0) return index;
-
-    rgba_hash_table::iterator it = color_hashmap_.find(val);
-    if (it != color_hashmap_.end())
+    if (colors_ == 1 || val == 0) return 0;
     {
-        index = it->second;
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(mutex_);
+#endif
+        rgba_hash_table::const_iterator it = color_hashmap_.find(val);
+        if (it != color_hashmap_.end())
+        {
+            return it->second;
+        }
     }
-    else
+    // search without holding the lock, the result is the same whichever
+    // thread gets to cache it first
+    unsigned char index = find_nearest(val);
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    // Cache found index for the color c into the hashmap.
+    color_hashmap_[val] = index;
+    return index;
+}
+
+unsigned char rgba_palette::find_nearest(unsigned val) const
+{
+    rgba c(val);
+    int dr, dg, db, da;
+    int dist, newdist;
+
+    // find closest match based on mean of r,g,b,a
+    std::vector<rgba>::const_iterator pit =
+        std::lower_bound(sorted_pal_.begin(), sorted_pal_.end(), c, rgba::mean_sort_cmp());
+    unsigned char index = std::distance(sorted_pal_.begin(),pit);
+    if (index == sorted_pal_.size()) index--;
+
+    dr = sorted_pal_[index].r - c.r;
+    dg = sorted_pal_[index].g - c.g;
+    db = sorted_pal_[index].b - c.b;
+    da = sorted_pal_[index].a - c.a;
+    dist = dr*dr + dg*dg + db*db + da*da;
+    int poz = index;
+
+    // search neighbour positions in both directions for better match
+    for (int i = poz - 1; i >= 0; i--)
     {
-        rgba c(val);
-        int dr, dg, db, da;
-        int dist, newdist;
-
-        // find closest match based on mean of r,g,b,a
-        std::vector<rgba>::const_iterator pit =
-            std::lower_bound(sorted_pal_.begin(), sorted_pal_.end(), c, rgba::mean_sort_cmp());
-        index = std::distance(sorted_pal_.begin(),pit);
-        if (index == sorted_pal_.size()) index--;
-
-        dr = sorted_pal_[index].r - c.r;
-        dg = sorted_pal_[index].g - c.g;
-        db = sorted_pal_[index].b - c.b;
-        da = sorted_pal_[index].a - c.a;
-        dist = dr*dr + dg*dg + db*db + da*da;
-        int poz = index;
-
-        // search neighbour positions in both directions for better match
-        for (int i = poz - 1; i >= 0; i--)
+        dr = sorted_pal_[i].r - c.r;
+        dg = sorted_pal_[i].g - c.g;
+        db = sorted_pal_[i].b - c.b;
+        da = sorted_pal_[i].a - c.a;
+        // stop criteria based on properties of used sorting
+        if ((dr+db+dg+da) * (dr+db+dg+da) / 4 > dist)
         {
-            dr = sorted_pal_[i].r - c.r;
-            dg = sorted_pal_[i].g - c.g;
-            db = sorted_pal_[i].b - c.b;
-            da = sorted_pal_[i].a - c.a;
-            // stop criteria based on properties of used sorting
-            if ((dr+db+dg+da) * (dr+db+dg+da) / 4 > dist)
-            {
-                break;
-            }
-            newdist = dr*dr + dg*dg + db*db + da*da;
-            if (newdist < dist)
-            {
-                index = i;
-                dist = newdist;
-            }
+            break;
         }
-
-        for (unsigned i = poz + 1; i < sorted_pal_.size(); i++)
+        newdist = dr*dr + dg*dg + db*db + da*da;
+        if (newdist < dist)
         {
-            dr = sorted_pal_[i].r - c.r;
-            dg = sorted_pal_[i].g - c.g;
-            db = sorted_pal_[i].b - c.b;
-            da = sorted_pal_[i].a - c.a;
-            // stop criteria based on properties of used sorting
-            if ((dr+db+dg+da) * (dr+db+dg+da) / 4 > dist)
-            {
-                break;
-            }
-            newdist = dr*dr + dg*dg + db*db + da*da;
-            if (newdist < dist)
-            {
-                index = i;
-                dist = newdist;
-            }
+            index = i;
+            dist = newdist;
         }
-
-        // Cache found index for the color c into the hashmap.
-        color_hashmap_[val] = index;
     }
 
+    for (unsigned i = poz + 1; i < sorted_pal_.size(); i++)
+    {
+        dr = sorted_pal_[i].r - c.r;
+        dg = sorted_pal_[i].g - c.g;
+        db = sorted_pal_[i].b - c.b;
+        da = sorted_pal_[i].a - c.a;
+        // stop criteria based on properties of used sorting
+        if ((dr+db+dg+da) * (dr+db+dg+da) / 4 > dist)
+        {
+            break;
+        }
+        newdist = dr*dr + dg*dg + db*db + da*da;
+        if (newdist < dist)
+        {
+            index = i;
+            dist = newdist;
+        }
+    }
     return index;
 }
 
@@ -188,24 +206,29 @@ void rgba_palette::parse(std::string const& pal, palette_type type)
         length = (pal[768] << 8 | pal[769]) * 3;
     }
 
-    sorted_pal_.clear();
-    rgb_pal_.clear();
-    alpha_pal_.clear();
-
+    std::vector<rgba> colors;
     if (type == PALETTE_RGBA)
     {
         for (unsigned i = 0; i < length; i += 4)
         {
-            sorted_pal_.push_back(rgba(pal[i], pal[i + 1], pal[i + 2], pal[i + 3]));
+            colors.push_back(rgba(pal[i], pal[i + 1], pal[i + 2], pal[i + 3]));
         }
     }
     else
     {
         for (unsigned i = 0; i < length; i += 3)
         {
-            sorted_pal_.push_back(rgba(pal[i], pal[i + 1], pal[i + 2], 0xFF));
+            colors.push_back(rgba(pal[i], pal[i + 1], pal[i + 2], 0xFF));
         }
     }
+    assign(std::move(colors));
+}
+
+void rgba_palette::assign(std::vector<rgba> && colors)
+{
+    sorted_pal_ = std::move(colors);
+    rgb_pal_.clear();
+    alpha_pal_.clear();
 
     // Make sure we have at least one entry in the palette.
     if (sorted_pal_.size() == 0)
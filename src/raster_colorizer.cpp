@@ -30,8 +30,11 @@
 #include <mapnik/enumeration.hpp>
 
 // stl
+#include <algorithm>
 #include <limits>
 #include <cmath>
+#include <type_traits>
+#include <vector>
 
 namespace mapnik
 {
@@ -122,6 +125,19 @@ bool raster_colorizer::add_stop(colorizer_stop const& stop)
     return true;
 }
 
+namespace {
+
+// Bands of 8 and 16 bit integers are colorized through a table holding the
+// color of every value they can take, nodata included.
+template <typename T>
+struct colorizer_lut
+{
+    static constexpr bool enabled = std::is_integral<T>::value && sizeof(T) <= 2;
+    static constexpr std::size_t size = std::size_t(1) << (enabled ? 8 * sizeof(T) : 0);
+};
+
+}
+
 template <typename T>
 void raster_colorizer::colorize(image_rgba8 & out, T const& in,
                                 boost::optional<double> const& nodata,
@@ -129,21 +145,60 @@ void raster_colorizer::colorize(image_rgba8 & out, T const& in,
 {
     using image_type = T;
     using pixel_type = typename image_type::pixel_type;
+    using lut_type = colorizer_lut<pixel_type>;
     // TODO: assuming in/out have the same width/height for now
     std::uint32_t * out_data = out.data();
     pixel_type const* in_data = in.data();
     int len = out.width() * out.height();
+    bool sorted = std::is_sorted(stops_.begin(), stops_.end(),
+                                 [](colorizer_stop const& a, colorizer_stop const& b) { return a.get_value() < b.get_value(); });
+    // filling the table only pays off when the image has a good share of
+    // its entries as pixels
+    if (lut_type::enabled && static_cast<std::size_t>(len) >= lut_type::size / 4)
+    {
+        pixel_type const lowest = std::numeric_limits<pixel_type>::lowest();
+        std::vector<std::uint32_t> lut(lut_type::size);
+        for (std::size_t i = 0; i < lut_type::size; ++i)
+        {
+            pixel_type val = static_cast<pixel_type>(lowest + static_cast<int>(i));
+            if (nodata && (std::fabs(val - *nodata) < epsilon_))
+            {
+                lut[i] = 0; // rgba(0,0,0,0)
+            }
+            else
+            {
+                lut[i] = color_of(val, sorted);
+            }
+        }
+        for (int i = 0; i < len; ++i)
+        {
+            out_data[i] = lut[static_cast<std::size_t>(in_data[i] - lowest)];
+        }
+        return;
+    }
+    // neighbouring pixels often share a value (flat areas, nodata runs)
+    pixel_type last_val = pixel_type();
+    unsigned last_color = 0;
+    bool have_last = false;
     for (int i=0; i<len; ++i)
     {
         pixel_type val = in_data[i];
+        if (have_last && val == last_val)
+        {
+            out_data[i] = last_color;
+            continue;
+        }
         if (nodata && (std::fabs(val - *nodata) < epsilon_))
         {
-            out_data[i] = 0; // rgba(0,0,0,0)
+            last_color = 0; // rgba(0,0,0,0)
         }
         else
         {
-            out_data[i] = get_color(val);
+            last_color = color_of(val, sorted);
         }
+        out_data[i] = last_color;
+        last_val = val;
+        have_last = true;
     }
 }
 
@@ -153,6 +208,11 @@ inline unsigned interpolate(unsigned start, unsigned end, float fraction)
 }
 
 unsigned raster_colorizer::get_color(float val) const
+{
+    return color_of(val, false);
+}
+
+unsigned raster_colorizer::color_of(float val, bool sorted) const
 {
     int stopCount = stops_.size();
 
@@ -164,21 +224,31 @@ unsigned raster_colorizer::get_color(float val) const
 
     //1 - Find the stop that the val is in
     int stopIdx = -1;
-    bool foundStopIdx = false;
-
-    for(int i=0; i<stopCount; ++i)
+    if (sorted)
     {
-        if (val < stops_[i].get_value())
+        // the stop before the first one with a value above val
+        auto itr = std::upper_bound(stops_.begin(), stops_.end(), val,
+                                    [](float v, colorizer_stop const& stop) { return v < stop.get_value(); });
+        stopIdx = static_cast<int>(itr - stops_.begin()) - 1;
+    }
+    else
+    {
+        bool foundStopIdx = false;
+
+        for(int i=0; i<stopCount; ++i)
         {
-            stopIdx = i-1;
-            foundStopIdx = true;
-            break;
+            if (val < stops_[i].get_value())
+            {
+                stopIdx = i-1;
+                foundStopIdx = true;
+                break;
+            }
         }
-    }
 
-    if(!foundStopIdx)
-    {
-        stopIdx = stopCount-1;
+        if(!foundStopIdx)
+        {
+            stopIdx = stopCount-1;
+        }
     }
 
     //2 - Find the next stop
@@ -40,13 +40,15 @@ renderer_common::renderer_common(renderer_common const& other)
       font_manager_(other.font_manager_),
       query_extent_(other.query_extent_),
       t_(other.t_),
-      detector_(other.detector_)
+      detector_(other.detector_),
+      owns_detector_(false) // shared with `other`
 {}
 
 renderer_common::renderer_common(Map const& map, unsigned width, unsigned height, double scale_factor,
                                  attributes const& vars,
                                  view_transform && t,
-                                 detector_ptr detector)
+                                 detector_ptr detector,
+                                 bool owns_detector)
    : width_(width),
      height_(height),
      scale_factor_(scale_factor),
@@ -56,7 +58,8 @@ renderer_common::renderer_common(Map const& map, unsigned width, unsigned height
      font_manager_(font_library_,map.get_font_file_mapping(),map.get_font_memory_cache()),
      query_extent_(),
      t_(t),
-     detector_(detector)
+     detector_(detector),
+     owns_detector_(owns_detector)
 {}
 
 renderer_common::renderer_common(Map const &m, attributes const& vars, unsigned offset_x, unsigned offset_y,
@@ -66,7 +69,8 @@ renderer_common::renderer_common(Map const &m, attributes const& vars, unsigned
                      view_transform(m.width(),m.height(),m.get_current_extent(),offset_x,offset_y),
                      std::make_shared<label_collision_detector4>(
                         box2d<double>(-m.buffer_size(), -m.buffer_size(),
-                                      m.width() + m.buffer_size() ,m.height() + m.buffer_size())))
+                                      m.width() + m.buffer_size() ,m.height() + m.buffer_size())),
+                     true)
 {}
 
 renderer_common::renderer_common(Map const &m, attributes const& vars, unsigned offset_x, unsigned offset_y,
@@ -75,7 +79,8 @@ renderer_common::renderer_common(Map const &m, attributes const& vars, unsigned
    : renderer_common(m, width, height, scale_factor,
                      vars,
                      view_transform(m.width(),m.height(),m.get_current_extent(),offset_x,offset_y),
-                     detector)
+                     detector,
+                     false)
 {}
 
 renderer_common::renderer_common(Map const &m, request const &req, attributes const& vars, unsigned offset_x, unsigned offset_y,
@@ -85,9 +90,56 @@ renderer_common::renderer_common(Map const &m, request const &req, attributes co
                      view_transform(req.width(),req.height(),req.extent(),offset_x,offset_y),
                      std::make_shared<label_collision_detector4>(
                         box2d<double>(-req.buffer_size(), -req.buffer_size(),
-                                      req.width() + req.buffer_size() ,req.height() + req.buffer_size())))
+                                      req.width() + req.buffer_size() ,req.height() + req.buffer_size())),
+                     true)
+{}
+
+renderer_common::renderer_common(Map const &m, request const &req, attributes const& vars, unsigned offset_x, unsigned offset_y,
+                                 unsigned width, unsigned height, double scale_factor,
+                                 detector_ptr detector)
+   : renderer_common(m, width, height, scale_factor,
+                     vars,
+                     view_transform(req.width(),req.height(),req.extent(),offset_x,offset_y),
+                     detector,
+                     false)
 {}
 
+void renderer_common::reset(request const& req, attributes const& vars, unsigned offset_x, unsigned offset_y)
+{
+    width_ = req.width();
+    height_ = req.height();
+    vars_ = vars;
+    query_extent_ = box2d<double>();
+    t_ = view_transform(req.width(), req.height(), req.extent(), offset_x, offset_y);
+    box2d<double> detector_extent(-req.buffer_size(), -req.buffer_size(),
+                                  req.width() + req.buffer_size(), req.height() + req.buffer_size());
+    if (detector_->store())
+    {
+        // a detector backed by a label_placement_store belongs to one
+        // render; move it to this one so that it reads and publishes labels
+        // around the new extent rather than the previous one
+        if (detector_->extent() == detector_extent)
+        {
+            detector_->reset(t_);
+        }
+        else
+        {
+            detector_ = std::make_shared<label_collision_detector4>(detector_extent, detector_->store(), t_);
+        }
+    }
+    else if (owns_detector_)
+    {
+        if (detector_->extent() == detector_extent)
+        {
+            detector_->clear();
+        }
+        else
+        {
+            detector_ = std::make_shared<label_collision_detector4>(detector_extent);
+        }
+    }
+}
+
 renderer_common::~renderer_common()
 {
     // defined in .cpp to make this destructible elsewhere without
@@ -549,6 +549,11 @@ void serialize_layer( ptree & map_node, layer const& lyr, bool explicit_defaults
         set_attr/*<bool>*/( layer_node, "cache-features", lyr.cache_features() );
     }
 
+    if ( lyr.stream_features() || explicit_defaults )
+    {
+        set_attr( layer_node, "stream-features", lyr.stream_features() );
+    }
+
     if ( lyr.group_by() != "" || explicit_defaults )
     {
         set_attr( layer_node, "group-by", lyr.group_by() );
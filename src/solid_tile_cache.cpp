@@ -0,0 +1,144 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+// mapnik
+#include <mapnik/solid_tile_cache.hpp>
+
+namespace mapnik
+{
+
+template class singleton<solid_tile_cache, CreateStatic>;
+
+solid_tile_cache::solid_tile_cache()
+    : cache_(),
+      enabled_(true),
+      max_entries_(1024),
+      max_bytes_(4 * 1024 * 1024) {}
+
+std::string solid_tile_cache::make_key(std::uint32_t color,
+                                       std::size_t width,
+                                       std::size_t height,
+                                       bool premultiplied,
+                                       std::string const& format)
+{
+    std::string key;
+    key.reserve(format.size() + 24);
+    key.append(reinterpret_cast<char const*>(&color), sizeof(color));
+    std::uint64_t size = (static_cast<std::uint64_t>(width) << 32) | static_cast<std::uint32_t>(height);
+    key.append(reinterpret_cast<char const*>(&size), sizeof(size));
+    key.push_back(premultiplied ? 1 : 0);
+    key.append(format);
+    return key;
+}
+
+boost::optional<std::string> solid_tile_cache::find(std::uint32_t color,
+                                                    std::size_t width,
+                                                    std::size_t height,
+                                                    bool premultiplied,
+                                                    std::string const& format)
+{
+    boost::optional<std::string> result;
+    std::string key = make_key(color, width, height, premultiplied, format);
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    if (!enabled_) return result;
+    std::string const* data = cache_.find(key);
+    if (data) result.reset(*data);
+    return result;
+}
+
+void solid_tile_cache::insert(std::uint32_t color,
+                              std::size_t width,
+                              std::size_t height,
+                              bool premultiplied,
+                              std::string const& format,
+                              std::string const& data)
+{
+    std::string key = make_key(color, width, height, premultiplied, format);
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    if (!enabled_) return;
+    cache_.insert(key, data, data.size());
+    cache_.evict(max_entries_, max_bytes_);
+}
+
+void solid_tile_cache::clear()
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    cache_.clear();
+}
+
+void solid_tile_cache::set_enabled(bool enabled)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    enabled_ = enabled;
+    if (!enabled) cache_.clear();
+}
+
+bool solid_tile_cache::enabled() const
+{
+    return enabled_;
+}
+
+void solid_tile_cache::set_max_entries(std::size_t max_entries)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    max_entries_ = max_entries;
+    cache_.evict(max_entries_, max_bytes_);
+}
+
+std::size_t solid_tile_cache::max_entries() const
+{
+    return max_entries_;
+}
+
+void solid_tile_cache::set_max_bytes(std::size_t max_bytes)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    max_bytes_ = max_bytes;
+    cache_.evict(max_entries_, max_bytes_);
+}
+
+std::size_t solid_tile_cache::max_bytes() const
+{
+    return max_bytes_;
+}
+
+solid_tile_cache_stats solid_tile_cache::stats()
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return cache_.stats();
+}
+
+}
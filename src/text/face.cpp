@@ -21,6 +21,7 @@
  *****************************************************************************/
 // mapnik
 #include <mapnik/text/face.hpp>
+#include <mapnik/text/glyph_cache.hpp>
 #include <mapnik/debug.hpp>
 
 #pragma GCC diagnostic push
@@ -33,11 +34,28 @@ extern "C"
 
 #pragma GCC diagnostic pop
 
+// stl
+#include <sstream>
+
 namespace mapnik
 {
 
-font_face::font_face(FT_Face face)
-    : face_(face) {}
+namespace {
+
+// faces are opened afresh for every render, so glyphs are cached by the
+// font file and face index rather than by the face's address
+std::string face_identity(FT_Face face, std::string const& file_name)
+{
+    std::ostringstream s;
+    s << file_name << '\0' << face->face_index;
+    return s.str();
+}
+
+}
+
+font_face::font_face(FT_Face face, std::string const& file_name)
+    : face_(face),
+      cache_id_(glyph_cache::instance().face_id(face_identity(face, file_name))) {}
 
 bool font_face::set_character_sizes(double size)
 {
@@ -0,0 +1,226 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+// mapnik
+#include <mapnik/text/face_pool.hpp>
+#include <mapnik/text/face.hpp>
+#include <mapnik/text/font_library.hpp>
+#include <mapnik/font_engine_freetype.hpp>
+
+// stl
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+
+namespace mapnik
+{
+
+template class singleton<face_pool, CreateStatic>;
+
+namespace {
+
+// a pooled face keeps the library it was opened on alive
+struct pooled_face
+{
+    pooled_face(std::shared_ptr<font_library> const& _library, face_ptr const& _face)
+        : library(_library), face(_face) {}
+    std::shared_ptr<font_library> library;
+    face_ptr face; // destroyed before the library
+};
+
+// counters only written by their own thread
+inline void bump(std::atomic<std::size_t> & counter, std::size_t n = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+}
+
+struct face_pool::thread_pool : private util::noncopyable
+{
+    struct entry
+    {
+        face_ptr face;
+        std::size_t font_bytes;
+        std::list<std::string>::iterator lru_pos;
+    };
+
+    thread_pool()
+        : library(),
+          faces(),
+          lru(),
+          generation(0),
+          hits(0),
+          misses(0),
+          evictions(0),
+          face_count(0),
+          font_bytes(0)
+    {
+        face_pool::instance().add_pool(this);
+    }
+
+    ~thread_pool()
+    {
+        face_pool::instance().remove_pool(this);
+    }
+
+    void evict(std::size_t max_faces)
+    {
+        while (faces.size() > max_faces)
+        {
+            auto itr = faces.find(lru.back());
+            font_bytes.store(font_bytes.load(std::memory_order_relaxed) - itr->second.font_bytes,
+                             std::memory_order_relaxed);
+            faces.erase(itr);
+            lru.pop_back();
+            bump(evictions);
+        }
+        face_count.store(faces.size(), std::memory_order_relaxed);
+    }
+
+    std::shared_ptr<font_library> library;
+    std::unordered_map<std::string, entry> faces;
+    std::list<std::string> lru; // most recently used first
+    std::size_t generation;
+    // read by stats() on other threads
+    std::atomic<std::size_t> hits;
+    std::atomic<std::size_t> misses;
+    std::atomic<std::size_t> evictions;
+    std::atomic<std::size_t> face_count;
+    std::atomic<std::size_t> font_bytes;
+};
+
+face_pool::face_pool()
+    : enabled_(true),
+      max_faces_(64),
+      generation_(0),
+      pools_(),
+      retired_() {}
+
+void face_pool::add_pool(thread_pool * pool)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    pools_.push_back(pool);
+}
+
+void face_pool::remove_pool(thread_pool * pool)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    retired_.hits += pool->hits;
+    retired_.misses += pool->misses;
+    retired_.evictions += pool->evictions;
+    pools_.erase(std::remove(pools_.begin(), pools_.end(), pool), pools_.end());
+}
+
+face_ptr face_pool::get_face(std::string const& name)
+{
+    if (!enabled_.load(std::memory_order_relaxed)) return face_ptr();
+    static thread_local thread_pool pool;
+
+    std::size_t generation = generation_.load(std::memory_order_relaxed);
+    if (pool.generation != generation)
+    {
+        pool.evict(0);
+        pool.generation = generation;
+    }
+    auto itr = pool.faces.find(name);
+    if (itr != pool.faces.end())
+    {
+        bump(pool.hits);
+        pool.lru.splice(pool.lru.begin(), pool.lru, itr->second.lru_pos);
+        return itr->second.face;
+    }
+    bump(pool.misses);
+
+    if (!pool.library)
+    {
+        pool.library = std::make_shared<font_library>();
+    }
+    static freetype_engine::font_file_mapping_type const no_mapping;
+    static freetype_engine::font_memory_cache_type const no_cache;
+    face_ptr face = freetype_engine::create_face(name, *pool.library, no_mapping, no_cache,
+                                                 freetype_engine::get_mapping(),
+                                                 freetype_engine::get_cache());
+    if (!face) return face;
+    auto holder = std::make_shared<pooled_face>(pool.library, face);
+    face_ptr pooled(holder, holder->face.get());
+
+    // faces are opened on the in memory font file, the global font cache
+    // itself is only safe to read under freetype_engine's lock
+    FT_Face ft_face = face->get_face();
+    std::size_t font_bytes = ft_face->stream ? ft_face->stream->size : 0;
+    pool.lru.push_front(name);
+    pool.faces.emplace(name, thread_pool::entry{pooled, font_bytes, pool.lru.begin()});
+    bump(pool.font_bytes, font_bytes);
+    pool.evict(std::max<std::size_t>(max_faces_.load(std::memory_order_relaxed), 1));
+    return pooled;
+}
+
+void face_pool::clear()
+{
+    ++generation_;
+}
+
+void face_pool::set_enabled(bool enabled)
+{
+    enabled_ = enabled;
+}
+
+bool face_pool::enabled() const
+{
+    return enabled_;
+}
+
+void face_pool::set_max_faces(std::size_t max_faces)
+{
+    max_faces_ = max_faces;
+}
+
+std::size_t face_pool::max_faces() const
+{
+    return max_faces_;
+}
+
+face_pool_stats face_pool::stats()
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    face_pool_stats result = retired_;
+    for (thread_pool const* pool : pools_)
+    {
+        result.hits += pool->hits.load(std::memory_order_relaxed);
+        result.misses += pool->misses.load(std::memory_order_relaxed);
+        result.evictions += pool->evictions.load(std::memory_order_relaxed);
+        result.faces += pool->face_count.load(std::memory_order_relaxed);
+        result.font_bytes += pool->font_bytes.load(std::memory_order_relaxed);
+    }
+    result.threads = pools_.size();
+    return result;
+}
+
+}
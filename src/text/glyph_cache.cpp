@@ -0,0 +1,127 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+// mapnik
+#include <mapnik/text/glyph_cache.hpp>
+
+#include <algorithm>
+
+namespace mapnik
+{
+
+template class singleton<glyph_cache, CreateStatic>;
+
+std::size_t glyph_cache_key_hash::operator()(glyph_cache_key const& key) const
+{
+    std::uint64_t h = 0xcbf29ce484222325ull;
+    for (std::uint32_t v : { key.face_id, key.glyph_index,
+                static_cast<std::uint32_t>(key.char_size), static_cast<std::uint32_t>(key.stroke),
+                static_cast<std::uint32_t>(key.xx), static_cast<std::uint32_t>(key.xy),
+                static_cast<std::uint32_t>(key.yx), static_cast<std::uint32_t>(key.yy),
+                static_cast<std::uint32_t>(key.dx), static_cast<std::uint32_t>(key.dy) })
+    {
+        h = (h ^ v) * 0x100000001b3ull;
+    }
+    return static_cast<std::size_t>(h ^ (h >> 29));
+}
+
+glyph_cache::glyph_cache()
+    : cache_(0, 16 * 1024 * 1024),
+      face_ids_(),
+      enabled_(true),
+      subpixel_steps_(64),
+      rotation_steps_(0) {}
+
+std::uint32_t glyph_cache::face_id(std::string const& identity)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return face_ids_.emplace(identity, static_cast<std::uint32_t>(face_ids_.size() + 1)).first->second;
+}
+
+glyph_bitmap_ptr glyph_cache::find(glyph_cache_key const& key)
+{
+    auto bitmap = cache_.find(key);
+    return bitmap ? *bitmap : glyph_bitmap_ptr();
+}
+
+glyph_bitmap_ptr glyph_cache::insert(glyph_cache_key const& key, glyph_bitmap && bitmap)
+{
+    auto ptr = std::make_shared<glyph_bitmap const>(std::move(bitmap));
+    if (!enabled_) return ptr;
+    return cache_.insert(key, ptr, ptr->buffer.size());
+}
+
+void glyph_cache::clear()
+{
+    cache_.clear();
+}
+
+void glyph_cache::set_enabled(bool enabled)
+{
+    enabled_ = enabled;
+    if (!enabled) clear();
+}
+
+bool glyph_cache::enabled() const
+{
+    return enabled_;
+}
+
+void glyph_cache::set_max_bytes(std::size_t max_bytes)
+{
+    cache_.set_max_bytes(max_bytes);
+}
+
+std::size_t glyph_cache::max_bytes() const
+{
+    return cache_.max_bytes();
+}
+
+void glyph_cache::set_subpixel_steps(unsigned steps)
+{
+    subpixel_steps_ = std::min(std::max(steps, 1u), 64u);
+}
+
+unsigned glyph_cache::subpixel_steps() const
+{
+    return subpixel_steps_;
+}
+
+void glyph_cache::set_rotation_steps(unsigned steps)
+{
+    rotation_steps_ = steps;
+}
+
+unsigned glyph_cache::rotation_steps() const
+{
+    return rotation_steps_;
+}
+
+glyph_cache_stats glyph_cache::stats()
+{
+    return cache_.stats();
+}
+
+}
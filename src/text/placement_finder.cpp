@@ -347,7 +347,7 @@ bool placement_finder::single_line_placement(vertex_cache &pp, text_upright_e or
                 cluster_offset.y -= rot.sin * glyph.advance();
 
                 box2d<double> bbox = get_bbox(layout, glyph, pos, rot);
-                if (collision(bbox, layouts_.text(), true)) return false;
+                if (off_extent(bbox)) return false;
                 bboxes.push_back(std::move(bbox));
                 glyphs->emplace_back(glyph, pos, rot);
             }
@@ -356,6 +356,9 @@ bool placement_finder::single_line_placement(vertex_cache &pp, text_upright_e or
         }
     }
 
+    // the detector checks all glyphs of the placement together
+    if (collision(bboxes, layouts_.text())) return false;
+
     if (upside_down_glyph_count > static_cast<unsigned>(layouts_.text().length() / 2))
     {
         if (orientation == UPRIGHT_AUTO)
@@ -422,6 +425,14 @@ double placement_finder::get_spacing(double path_length, double layout_width) co
     return path_length / num_labels;
 }
 
+bool placement_finder::off_extent(box2d<double> const& box) const
+{
+    return (text_props_->avoid_edges && !extent_.contains(box))
+        ||
+        (text_props_->minimum_padding > 0 &&
+         !extent_.contains(box + (scale_factor_ * text_props_->minimum_padding)));
+}
+
 bool placement_finder::collision(const box2d<double> &box, const value_unicode_string &repeat_key, bool line_placement) const
 {
     double margin, repeat_distance;
@@ -435,10 +446,7 @@ bool placement_finder::collision(const box2d<double> &box, const value_unicode_s
         margin = (text_props_->margin != 0 ? text_props_->margin : text_props_->minimum_distance) * scale_factor_;
         repeat_distance = text_props_->repeat_distance * scale_factor_;
     }
-    return (text_props_->avoid_edges && !extent_.contains(box))
-        ||
-        (text_props_->minimum_padding > 0 &&
-         !extent_.contains(box + (scale_factor_ * text_props_->minimum_padding)))
+    return off_extent(box)
         ||
         (!text_props_->allow_overlap &&
          ((repeat_key.length() == 0 && !detector_.has_placement(box, margin))
@@ -446,6 +454,16 @@ bool placement_finder::collision(const box2d<double> &box, const value_unicode_s
           (repeat_key.length() > 0 && !detector_.has_placement(box, margin, repeat_key, repeat_distance))));
 }
 
+bool placement_finder::collision(std::vector<box2d<double>> const& boxes, const value_unicode_string &repeat_key) const
+{
+    if (text_props_->allow_overlap) return false;
+    double margin = text_props_->margin * scale_factor_;
+    double repeat_distance = (text_props_->repeat_distance != 0 ? text_props_->repeat_distance : text_props_->minimum_distance) * scale_factor_;
+    return (repeat_key.length() == 0 && !detector_.has_placements(boxes, margin))
+        ||
+        (repeat_key.length() > 0 && !detector_.has_placements(boxes, margin, repeat_key, repeat_distance));
+}
+
 void placement_finder::set_marker(marker_info_ptr m, box2d<double> box, bool marker_unlocked, pixel_position const& marker_displacement)
 {
     marker_ = m;
@@ -26,9 +26,14 @@
 #include <mapnik/text/text_properties.hpp>
 #include <mapnik/font_engine_freetype.hpp>
 #include <mapnik/text/face.hpp>
+#include <mapnik/text/glyph_cache.hpp>
 #include <mapnik/image_util.hpp>
 #include <mapnik/image_any.hpp>
 
+// stl
+#include <algorithm>
+#include <cmath>
+
 namespace mapnik
 {
 
@@ -92,16 +97,17 @@ void text_renderer::prepare_glyphs(glyph_positions const& positions)
 }
 
 template <typename T>
-void composite_bitmap(T & pixmap, FT_Bitmap *bitmap, unsigned rgba, int x, int y, double opacity, composite_mode_e comp_op)
+void composite_bitmap(T & pixmap, unsigned char const* buffer, int width, int rows,
+                      unsigned rgba, int x, int y, double opacity, composite_mode_e comp_op)
 {
-    int x_max = x + bitmap->width;
-    int y_max = y + bitmap->rows;
+    int x_max = x + width;
+    int y_max = y + rows;
 
     for (int i = x, p = 0; i < x_max; ++i, ++p)
     {
         for (int j = y, q = 0; j < y_max; ++j, ++q)
         {
-            unsigned gray=bitmap->buffer[q*bitmap->width+p];
+            unsigned gray=buffer[q*width+p];
             if (gray)
             {
                 mapnik::composite_pixel(pixmap, comp_op, i, j, rgba, gray, opacity);
@@ -120,10 +126,190 @@ agg_text_renderer<T>::agg_text_renderer (pixmap_type & pixmap,
     : text_renderer(rasterizer, comp_op, halo_comp_op, scale_factor, stroker), pixmap_(pixmap)
 {}
 
+namespace {
+
+bool is_identity(FT_Matrix const& m)
+{
+    return m.xx == 0x10000L && m.xy == 0 && m.yx == 0 && m.yy == 0x10000L;
+}
+
+}
+
+template <typename T>
+glyph_bitmap_ptr agg_text_renderer<T>::cached_bitmap(glyph_info const& glyph,
+                                                     glyph_cache_key const& key,
+                                                     double halo_radius)
+{
+    glyph_cache & cache = glyph_cache::instance();
+    glyph_bitmap_ptr bitmap = cache.find(key);
+    if (bitmap) return bitmap;
+
+    glyph.face->set_character_sizes(glyph.format->text_size * scale_factor_);
+    FT_Matrix matrix;
+    matrix.xx = key.xx;
+    matrix.xy = key.xy;
+    matrix.yx = key.yx;
+    matrix.yy = key.yy;
+    // FreeType's stroker rounds towards zero, so outlines are kept in the
+    // positive quadrant, as they mostly are when rendered in place, for the
+    // result to only depend on the subpixel offset
+    int const margin = 4096;
+    FT_Vector pen;
+    pen.x = key.dx + margin * 64;
+    pen.y = key.dy + margin * 64;
+    FT_Face face = glyph.face->get_face();
+    FT_Set_Transform(face, &matrix, &pen);
+    if (FT_Load_Glyph(face, glyph.glyph_index, FT_LOAD_NO_HINTING)) return bitmap;
+    FT_Glyph image;
+    if (FT_Get_Glyph(face->glyph, &image)) return bitmap;
+    if (key.stroke >= 0)
+    {
+        stroker_->init(halo_radius);
+        FT_Glyph_Stroke(&image, stroker_->get(), 1);
+    }
+    if (!FT_Glyph_To_Bitmap(&image, FT_RENDER_MODE_NORMAL, 0, 1))
+    {
+        FT_BitmapGlyph bit = reinterpret_cast<FT_BitmapGlyph>(image);
+        glyph_bitmap result;
+        result.left = bit->left - margin;
+        result.top = bit->top - margin;
+        result.width = bit->bitmap.width;
+        result.rows = bit->bitmap.rows;
+        result.buffer.resize(result.width * result.rows);
+        int pitch = bit->bitmap.pitch;
+        int rows = static_cast<int>(result.rows);
+        for (int row = 0; row < rows; ++row)
+        {
+            // a negative pitch means rows are stored bottom up
+            unsigned char const* src = bit->bitmap.buffer +
+                ((pitch >= 0) ? row * pitch : (rows - 1 - row) * -pitch);
+            std::copy(src, src + result.width, result.buffer.begin() + row * result.width);
+        }
+        bitmap = cache.insert(key, std::move(result));
+    }
+    FT_Done_Glyph(image);
+    return bitmap;
+}
+
+template <typename T>
+void agg_text_renderer<T>::render_cached(glyph_positions const& pos,
+                                         FT_Vector const& start,
+                                         FT_Vector const& start_halo)
+{
+    glyph_cache & cache = glyph_cache::instance();
+    FT_Pos subpixel_steps = cache.subpixel_steps();
+    unsigned rotation_steps = cache.rotation_steps();
+    int height = pixmap_.height();
+
+    struct cached_glyph
+    {
+        glyph_info const* glyph;
+        glyph_cache_key key;
+        FT_Vector pen;
+    };
+    std::vector<cached_glyph> glyphs;
+    glyphs.reserve(pos.size());
+    for (auto const& glyph_pos : pos)
+    {
+        glyph_info const& glyph = glyph_pos.glyph;
+        cached_glyph g;
+        g.glyph = &glyph;
+        g.key.face_id = glyph.face->cache_id();
+        g.key.glyph_index = glyph.glyph_index;
+        g.key.char_size = static_cast<std::int32_t>(static_cast<FT_F26Dot6>(glyph.format->text_size * scale_factor_ * (1<<6)));
+        double cos_a = glyph_pos.rot.cos;
+        double sin_a = glyph_pos.rot.sin;
+        if (rotation_steps > 0 && sin_a != 0.0)
+        {
+            double step = 2 * M_PI / rotation_steps;
+            double angle = std::round(std::atan2(sin_a, cos_a) / step) * step;
+            cos_a = std::cos(angle);
+            sin_a = std::sin(angle);
+        }
+        g.key.xx = static_cast<FT_Fixed>( cos_a * 0x10000L);
+        g.key.xy = static_cast<FT_Fixed>(-sin_a * 0x10000L);
+        g.key.yx = static_cast<FT_Fixed>( sin_a * 0x10000L);
+        g.key.yy = static_cast<FT_Fixed>( cos_a * 0x10000L);
+        pixel_position p = glyph_pos.pos + glyph.offset.rotate(glyph_pos.rot);
+        g.pen.x = static_cast<FT_Pos>(p.x * 64);
+        g.pen.y = static_cast<FT_Pos>(p.y * 64);
+        glyphs.push_back(g);
+    }
+
+    // Rasterizes at the pen's subpixel offset, snapped to the cache's steps,
+    // and returns where the bitmap goes in the pixmap
+    auto place = [&](cached_glyph const& g, FT_Vector const& origin, std::int32_t stroke,
+                     double halo_radius, int & x, int & y)
+    {
+        glyph_cache_key key = g.key;
+        key.stroke = stroke;
+        FT_Pos whole[2];
+        std::int32_t * frac[2] = { &key.dx, &key.dy };
+        FT_Pos total[2] = { g.pen.x + origin.x, g.pen.y + origin.y };
+        for (int i = 0; i < 2; ++i)
+        {
+            FT_Pos f = total[i] & 63;
+            FT_Pos q = (f * subpixel_steps + 32) / 64;
+            whole[i] = (total[i] - f) / 64;
+            if (q == subpixel_steps)
+            {
+                whole[i] += 1;
+                q = 0;
+            }
+            *frac[i] = static_cast<std::int32_t>(q * 64 / subpixel_steps);
+        }
+        glyph_bitmap_ptr bitmap = cached_bitmap(*g.glyph, key, halo_radius);
+        if (bitmap)
+        {
+            x = bitmap->left + static_cast<int>(whole[0]);
+            y = height - (bitmap->top + static_cast<int>(whole[1]));
+        }
+        return bitmap;
+    };
+
+    for (auto const& g : glyphs)
+    {
+        detail::evaluated_format_properties const& properties = *g.glyph->format;
+        double halo_radius = properties.halo_radius * scale_factor_;
+        // make sure we've got reasonable values.
+        if (halo_radius <= 0.0 || halo_radius > 1024.0) continue;
+        bool full = rasterizer_ == HALO_RASTERIZER_FULL;
+        std::int32_t stroke = full ? static_cast<std::int32_t>(static_cast<FT_Fixed>(halo_radius * (1<<6))) : -1;
+        int x = 0, y = 0;
+        if (glyph_bitmap_ptr bitmap = place(g, start_halo, stroke, halo_radius, x, y))
+        {
+            if (full)
+            {
+                composite_bitmap(pixmap_, bitmap->buffer.data(), bitmap->width, bitmap->rows,
+                                 properties.halo_fill.rgba(), x, y,
+                                 properties.halo_opacity, halo_comp_op_);
+            }
+            else
+            {
+                render_halo(bitmap->buffer.data(), bitmap->width, bitmap->rows,
+                            properties.halo_fill.rgba(), x, y, halo_radius,
+                            properties.halo_opacity, halo_comp_op_);
+            }
+        }
+    }
+
+    // render actual text
+    for (auto const& g : glyphs)
+    {
+        detail::evaluated_format_properties const& properties = *g.glyph->format;
+        int x = 0, y = 0;
+        if (glyph_bitmap_ptr bitmap = place(g, start, -1, 0.0, x, y))
+        {
+            composite_bitmap(pixmap_, bitmap->buffer.data(), bitmap->width, bitmap->rows,
+                             properties.fill.rgba(), x, y,
+                             properties.text_opacity, comp_op_);
+        }
+    }
+}
+
 template <typename T>
 void agg_text_renderer<T>::render(glyph_positions const& pos)
 {
-    prepare_glyphs(pos);
     FT_Error  error;
     FT_Vector start;
     FT_Vector start_halo;
@@ -150,6 +336,15 @@ void agg_text_renderer<T>::render(glyph_positions const& pos)
     matrix.yy = transform_.sy  * 0x10000L;
     matrix.yx = transform_.shy * 0x10000L;
 
+    // cached bitmaps can only be moved, not transformed
+    if (glyph_cache::instance().enabled() && is_identity(matrix) && is_identity(halo_matrix))
+    {
+        render_cached(pos, start, start_halo);
+        return;
+    }
+
+    prepare_glyphs(pos);
+
     // default formatting
     double halo_radius = 0;
     color black(0,0,0);
@@ -179,7 +374,9 @@ void agg_text_renderer<T>::render(glyph_positions const& pos)
                 {
                     FT_BitmapGlyph bit = reinterpret_cast<FT_BitmapGlyph>(g);
                     composite_bitmap(pixmap_,
-                                     &bit->bitmap,
+                                     bit->bitmap.buffer,
+                                     bit->bitmap.width,
+                                     bit->bitmap.rows,
                                      halo_fill,
                                      bit->left,
                                      height - bit->top,
@@ -193,7 +390,9 @@ void agg_text_renderer<T>::render(glyph_positions const& pos)
                 if (!error)
                 {
                     FT_BitmapGlyph bit = reinterpret_cast<FT_BitmapGlyph>(g);
-                    render_halo(&bit->bitmap,
+                    render_halo(bit->bitmap.buffer,
+                                bit->bitmap.width,
+                                bit->bitmap.rows,
                                 halo_fill,
                                 bit->left,
                                 height - bit->top,
@@ -217,7 +416,9 @@ void agg_text_renderer<T>::render(glyph_positions const& pos)
         {
             FT_BitmapGlyph bit = reinterpret_cast<FT_BitmapGlyph>(glyph.image);
             composite_bitmap(pixmap_,
-                             &bit->bitmap,
+                             bit->bitmap.buffer,
+                             bit->bitmap.width,
+                             bit->bitmap.rows,
                              fill,
                              bit->left,
                              height - bit->top,
@@ -271,7 +472,9 @@ void grid_text_renderer<T>::render(glyph_positions const& pos, value_integer fea
 
 
 template <typename T>
-void agg_text_renderer<T>::render_halo(FT_Bitmap *bitmap,
+void agg_text_renderer<T>::render_halo(unsigned char const* buffer,
+                 int width,
+                 int height,
                  unsigned rgba,
                  int x1,
                  int y1,
@@ -279,8 +482,6 @@ void agg_text_renderer<T>::render_halo(FT_Bitmap *bitmap,
                  double opacity,
                  composite_mode_e comp_op)
 {
-    int width = bitmap->width;
-    int height = bitmap->rows;
     int x, y;
     if (halo_radius < 1.0)
     {
@@ -288,7 +489,7 @@ void agg_text_renderer<T>::render_halo(FT_Bitmap *bitmap,
         {
             for (y=0; y < height; y++)
             {
-                int gray = bitmap->buffer[y*bitmap->width+x];
+                int gray = buffer[y*width+x];
                 if (gray)
                 {
                     mapnik::composite_pixel(pixmap_, comp_op, x+x1-1, y+y1-1, rgba, gray*halo_radius*halo_radius, opacity);
@@ -312,7 +513,7 @@ void agg_text_renderer<T>::render_halo(FT_Bitmap *bitmap,
         {
             for (y=0; y < height; y++)
             {
-                int gray = bitmap->buffer[y*bitmap->width+x];
+                int gray = buffer[y*width+x];
                 if (gray)
                 {
                     for (int n=-halo_radius; n <=halo_radius; ++n)
@@ -0,0 +1,105 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2016 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+// mapnik
+#include <mapnik/text/shaping_cache.hpp>
+
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <unicode/unistr.h>
+#pragma GCC diagnostic pop
+
+namespace mapnik
+{
+
+template class singleton<shaping_cache, CreateStatic>;
+
+shaping_cache::shaping_cache()
+    : cache_(16384, 0),
+      enabled_(true) {}
+
+std::string shaping_cache::make_key(value_unicode_string const& text,
+                                    unsigned start,
+                                    unsigned end,
+                                    std::vector<std::uint32_t> const& face_ids,
+                                    std::string const& features)
+{
+    // the whole text is part of the key since scripts and shaping
+    // context are taken from around the line
+    std::string key;
+    std::uint32_t sizes[4] = { start, end,
+                               static_cast<std::uint32_t>(face_ids.size()),
+                               static_cast<std::uint32_t>(features.size()) };
+    key.reserve(sizeof(sizes) + face_ids.size() * sizeof(std::uint32_t) +
+                features.size() + text.length() * sizeof(UChar));
+    key.append(reinterpret_cast<char const*>(sizes), sizeof(sizes));
+    key.append(reinterpret_cast<char const*>(face_ids.data()), face_ids.size() * sizeof(std::uint32_t));
+    key.append(features);
+    key.append(reinterpret_cast<char const*>(text.getBuffer()), text.length() * sizeof(UChar));
+    return key;
+}
+
+shaped_line_ptr shaping_cache::find(std::string const& key)
+{
+    auto line = cache_.find(key);
+    return line ? *line : shaped_line_ptr();
+}
+
+void shaping_cache::insert(std::string const& key, shaped_line && line)
+{
+    if (!enabled_) return;
+    cache_.insert(key, std::make_shared<shaped_line const>(std::move(line)));
+}
+
+void shaping_cache::clear()
+{
+    cache_.clear();
+}
+
+void shaping_cache::set_enabled(bool enabled)
+{
+    enabled_ = enabled;
+    if (!enabled) clear();
+}
+
+bool shaping_cache::enabled() const
+{
+    return enabled_;
+}
+
+void shaping_cache::set_max_entries(std::size_t max_entries)
+{
+    cache_.set_max_entries(max_entries);
+}
+
+std::size_t shaping_cache::max_entries() const
+{
+    return cache_.max_entries();
+}
+
+shaping_cache_stats shaping_cache::stats()
+{
+    return cache_.stats();
+}
+
+}
@@ -0,0 +1,105 @@
+#ifndef TEST_MAP_FIXTURE_HPP
+#define TEST_MAP_FIXTURE_HPP
+
+#include <mapnik/map.hpp>
+#include <mapnik/layer.hpp>
+#include <mapnik/rule.hpp>
+#include <mapnik/feature_type_style.hpp>
+#include <mapnik/symbolizer.hpp>
+#include <mapnik/memory_datasource.hpp>
+#include <mapnik/feature.hpp>
+#include <mapnik/feature_factory.hpp>
+#include <mapnik/params.hpp>
+#include <mapnik/expression.hpp>
+#include <mapnik/unicode.hpp>
+#include <mapnik/geometry.hpp>
+#include <mapnik/text/placements/dummy.hpp>
+#include <mapnik/text/formatting/text.hpp>
+
+#include <initializer_list>
+#include <memory>
+#include <string>
+
+// Small maps for renderer tests: one feature per layer, served by a
+// memory datasource and drawn by a style of the layer's name.
+namespace testing {
+
+// closes the ring
+inline mapnik::geometry::polygon<double> make_polygon(std::initializer_list<mapnik::geometry::point<double>> points)
+{
+    mapnik::geometry::polygon<double> poly;
+    for (auto const& pt : points)
+    {
+        poly.exterior_ring.push_back(pt);
+    }
+    poly.exterior_ring.push_back(*points.begin());
+    return poly;
+}
+
+inline mapnik::geometry::polygon<double> make_polygon(mapnik::box2d<double> const& box)
+{
+    return make_polygon({ { box.minx(), box.miny() }, { box.maxx(), box.miny() },
+                          { box.maxx(), box.maxy() }, { box.minx(), box.maxy() } });
+}
+
+// a feature with an optional "name" attribute
+inline mapnik::feature_ptr make_feature(mapnik::geometry::geometry<double> geom,
+                                        std::string const& name = std::string())
+{
+    mapnik::context_ptr ctx = std::make_shared<mapnik::context_type>();
+    if (!name.empty()) ctx->push("name");
+    mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx, 1));
+    if (!name.empty())
+    {
+        mapnik::transcoder tr("utf-8");
+        feature->put("name", tr.transcode(name.c_str()));
+    }
+    feature->set_geometry(std::move(geom));
+    return feature;
+}
+
+inline mapnik::feature_type_style polygon_style(mapnik::color const& fill)
+{
+    mapnik::feature_type_style style;
+    mapnik::rule r;
+    mapnik::polygon_symbolizer poly_sym;
+    mapnik::put(poly_sym, mapnik::keys::fill, fill);
+    r.append(std::move(poly_sym));
+    style.add_rule(std::move(r));
+    return style;
+}
+
+// labels features with their "name" attribute
+inline mapnik::feature_type_style label_style(std::string const& face_name, double size)
+{
+    mapnik::feature_type_style style;
+    mapnik::rule r;
+    mapnik::text_symbolizer text_sym;
+    mapnik::text_placements_ptr placements = std::make_shared<mapnik::text_placements_dummy>();
+    placements->defaults.format_defaults.face_name = face_name;
+    placements->defaults.format_defaults.text_size = size;
+    placements->defaults.format_defaults.fill = mapnik::color(0, 0, 0);
+    placements->defaults.set_format_tree(std::make_shared<mapnik::formatting::text_node>(mapnik::parse_expression("[name]")));
+    mapnik::put<mapnik::text_placements_ptr>(text_sym, mapnik::keys::text_placements_, placements);
+    r.append(std::move(text_sym));
+    style.add_rule(std::move(r));
+    return style;
+}
+
+inline void add_layer(mapnik::Map & m, std::string const& name,
+                      mapnik::feature_type_style style, mapnik::feature_ptr const& feature)
+{
+    m.insert_style(name, std::move(style));
+    mapnik::parameters params;
+    params["type"] = "memory";
+    auto ds = std::make_shared<mapnik::memory_datasource>(params);
+    ds->push(feature);
+    mapnik::layer lyr(name);
+    lyr.set_datasource(ds);
+    lyr.add_style(name);
+    m.add_layer(lyr);
+}
+
+} // namespace testing
+
+#endif // TEST_MAP_FIXTURE_HPP
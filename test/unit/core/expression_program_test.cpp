@@ -0,0 +1,122 @@
+#include "catch.hpp"
+
+#include <mapnik/expression.hpp>
+#include <mapnik/expression_evaluator.hpp>
+#include <mapnik/expression_program.hpp>
+#include <mapnik/wkt/wkt_factory.hpp>
+#include <mapnik/feature.hpp>
+#include <mapnik/feature_factory.hpp>
+#include <mapnik/unicode.hpp>
+
+#include <vector>
+
+namespace {
+
+mapnik::value evaluate_tree(mapnik::feature_impl const& feature,
+                            mapnik::attributes const& vars,
+                            mapnik::expr_node const& expr)
+{
+    return mapnik::util::apply_visitor(
+        mapnik::evaluate<mapnik::feature_impl, mapnik::value_type, mapnik::attributes>(feature, vars), expr);
+}
+
+} // namespace
+
+TEST_CASE("expression_program")
+{
+    mapnik::transcoder tr("utf8");
+    auto ctx = std::make_shared<mapnik::context_type>();
+    mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx, 1));
+    mapnik::geometry::geometry<double> geom;
+    REQUIRE(mapnik::from_wkt("POINT(100 200)", geom));
+    feature->set_geometry(std::move(geom));
+    feature->put_new("foo", tr.transcode("bar"));
+    feature->put_new("name", tr.transcode("Québec"));
+    feature->put_new("double", mapnik::value_double(1.23456));
+    feature->put_new("int", mapnik::value_integer(123));
+    feature->put_new("bool", mapnik::value_bool(true));
+    feature->put_new("null", mapnik::value_null());
+
+    mapnik::attributes vars;
+    vars["zoom"] = mapnik::value_integer(14);
+    vars["title"] = tr.transcode("map");
+
+    SECTION("matches the visitor evaluator")
+    {
+        std::vector<std::string> expressions = {
+            "[foo] = 'bar'",
+            "[foo] != 'bar'",
+            "[int] > 100 and [int] < 200",
+            "[int] < 100 or [double] > 1",
+            "not [bool]",
+            "not ([int] = 123 and [foo] = 'baz')",
+            "-[int] + 3 * [double] - 1",
+            "[int] % 7",
+            "[int] / 2",
+            "[int] >= 123 and [int] <= 123",
+            "[missing] = null",
+            "[missing] + 1",
+            "[null] = null",
+            "@zoom >= 12 and @zoom < 16",
+            "@title + [foo]",
+            "@undefined = null",
+            "[mapnik::geometry_type] = point",
+            "[name].match('Qu.*')",
+            "[name].replace('é', 'e')",
+            "abs(-[int]) + min([int], 5) + pow(2, 3)",
+            "([foo] = 'bar' and [int] = 123) or ([foo] = 'x' and [int] = 1)",
+            "true",
+            "[int]",
+            "'literal'"
+        };
+        for (auto const& str : expressions)
+        {
+            INFO(str);
+            auto expr = mapnik::parse_expression(str);
+            mapnik::expression_program prog(*expr);
+            mapnik::expression_program::binding b;
+            mapnik::value expected = evaluate_tree(*feature, vars, *expr);
+            mapnik::value result = prog.evaluate(*feature, vars, b);
+            CHECK(result.which() == expected.which());
+            CHECK(result == expected);
+            // second evaluation reuses the binding
+            CHECK(prog.evaluate(*feature, vars, b) == expected);
+        }
+    }
+
+    SECTION("attribute names are collected once")
+    {
+        auto expr = mapnik::parse_expression("[a] = 1 or [b] = 2 or [a] = 3");
+        mapnik::expression_program prog(*expr);
+        REQUIRE(prog.attribute_names().size() == 2);
+        CHECK(prog.attribute_names()[0] == "a");
+        CHECK(prog.attribute_names()[1] == "b");
+    }
+
+    SECTION("rebinds when the context changes")
+    {
+        auto expr = mapnik::parse_expression("[extra] = 42");
+        mapnik::expression_program prog(*expr);
+        mapnik::expression_program::binding b;
+        CHECK(!prog.evaluate(*feature, vars, b).to_bool());
+        // grows the shared context
+        feature->put_new("extra", mapnik::value_integer(42));
+        CHECK(prog.evaluate(*feature, vars, b).to_bool());
+
+        auto other_ctx = std::make_shared<mapnik::context_type>();
+        other_ctx->push("padding");
+        other_ctx->push("extra");
+        mapnik::feature_ptr other(mapnik::feature_factory::create(other_ctx, 2));
+        other->put("extra", mapnik::value_integer(41));
+        CHECK(!prog.evaluate(*other, vars, b).to_bool());
+        other->put("extra", mapnik::value_integer(42));
+        CHECK(prog.evaluate(*other, vars, b).to_bool());
+
+        // the binding keeps its context alive, so a new context cannot
+        // reuse the address and pick up stale attribute slots
+        std::weak_ptr<mapnik::context_type> bound = other_ctx;
+        other.reset();
+        other_ctx.reset();
+        CHECK(!bound.expired());
+    }
+}
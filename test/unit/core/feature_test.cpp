@@ -0,0 +1,67 @@
+#include "catch.hpp"
+
+#include <mapnik/feature.hpp>
+#include <mapnik/feature_factory.hpp>
+#include <mapnik/feature_kv_iterator.hpp>
+
+#include <string>
+#include <vector>
+
+TEST_CASE("feature")
+{
+    SECTION("context keeps keys sorted")
+    {
+        auto ctx = std::make_shared<mapnik::context_type>();
+        CHECK(ctx->push("zeta") == 0);
+        CHECK(ctx->push("alpha") == 1);
+        CHECK(ctx->push("mu") == 2);
+        // pushing an existing key does not remap it
+        ctx->push("alpha");
+        REQUIRE(ctx->find("alpha") != ctx->end());
+        CHECK(ctx->find("alpha")->second == 1);
+        CHECK(ctx->find("beta") == ctx->end());
+
+        mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx, 1));
+        feature->put("zeta", mapnik::value_integer(26));
+        feature->put("alpha", mapnik::value_integer(1));
+        feature->put("mu", mapnik::value_integer(12));
+
+        std::vector<std::string> keys;
+        for (auto const& kv : *feature)
+        {
+            keys.push_back(std::get<0>(kv));
+        }
+        CHECK(keys == std::vector<std::string>({"alpha", "mu", "zeta"}));
+        CHECK(feature->get("mu") == mapnik::value_integer(12));
+    }
+
+    SECTION("resolved attributes")
+    {
+        auto ctx = std::make_shared<mapnik::context_type>();
+        ctx->push("name");
+        ctx->push("class");
+        mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx, 1));
+        feature->put("class", mapnik::value_integer(3));
+
+        mapnik::resolved_attribute attr(ctx, "class");
+        CHECK(attr.resolved_for(*ctx));
+        CHECK(feature->get(attr) == mapnik::value_integer(3));
+
+        mapnik::resolved_attribute missing(ctx, "extra");
+        CHECK(feature->get(missing).is<mapnik::value_null>());
+        // keys added to the context after resolution are still found
+        feature->put_new("extra", mapnik::value_integer(7));
+        CHECK(feature->get(missing) == mapnik::value_integer(7));
+
+        // features with another context fall back to the key
+        auto other_ctx = std::make_shared<mapnik::context_type>();
+        other_ctx->push("class");
+        mapnik::feature_ptr other(mapnik::feature_factory::create(other_ctx, 2));
+        other->put("class", mapnik::value_integer(5));
+        CHECK(!attr.resolved_for(*other_ctx));
+        CHECK(other->get(attr) == mapnik::value_integer(5));
+        attr.resolve(other_ctx);
+        CHECK(other->get(attr) == mapnik::value_integer(5));
+        CHECK(feature->get(attr) == mapnik::value_integer(3));
+    }
+}
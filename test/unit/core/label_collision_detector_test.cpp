@@ -0,0 +1,240 @@
+#include "catch.hpp"
+
+#include <mapnik/label_collision_detector.hpp>
+#include <mapnik/label_placement_store.hpp>
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/view_transform.hpp>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+// labels checked one by one, as the quad tree based detector did
+struct reference_detector
+{
+    struct label
+    {
+        mapnik::box2d<double> box;
+        mapnik::value_unicode_string text;
+    };
+
+    explicit reference_detector(mapnik::box2d<double> const& extent)
+        : extent_(extent) {}
+
+    void insert(mapnik::box2d<double> const& box, mapnik::value_unicode_string const& text)
+    {
+        if (extent_.intersects(box)) labels_.push_back({box, text});
+    }
+
+    bool has_placement(mapnik::box2d<double> const& box, double margin,
+                       mapnik::value_unicode_string const& text, double repeat_distance) const
+    {
+        mapnik::box2d<double> margin_box = margin > 0
+            ? mapnik::box2d<double>(box.minx() - margin, box.miny() - margin, box.maxx() + margin, box.maxy() + margin)
+            : box;
+        bool repeat = repeat_distance > margin;
+        mapnik::box2d<double> repeat_box(box.minx() - repeat_distance, box.miny() - repeat_distance,
+                                         box.maxx() + repeat_distance, box.maxy() + repeat_distance);
+        if (!extent_.intersects(repeat ? repeat_box : margin_box)) return true;
+        for (auto const& lbl : labels_)
+        {
+            if (lbl.box.intersects(margin_box) || (repeat && lbl.text == text && lbl.box.intersects(repeat_box)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    mapnik::box2d<double> extent_;
+    std::vector<label> labels_;
+};
+
+} // namespace
+
+TEST_CASE("label_collision_detector")
+{
+    mapnik::box2d<double> extent(-64, -64, 1088, 1088);
+    mapnik::label_collision_detector4 detector(extent);
+    reference_detector reference(extent);
+    std::vector<mapnik::value_unicode_string> texts = { "", "Main Street", "Elm Street", "River" };
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> pos(-300, 1300);
+    std::uniform_real_distribution<double> size(1, 40);
+    std::uniform_int_distribution<std::size_t> pick(0, texts.size() - 1);
+    auto random_box = [&]() {
+        double x = pos(gen);
+        double y = pos(gen);
+        // an occasional label much larger than a grid cell
+        double scale = (gen() % 50 == 0) ? 40 : 1;
+        return mapnik::box2d<double>(x, y, x + size(gen) * scale, y + size(gen));
+    };
+
+    for (int round = 0; round < 2; ++round)
+    {
+        for (int i = 0; i < 400; ++i)
+        {
+            auto const& text = texts[pick(gen)];
+            auto box = random_box();
+            detector.insert(box, text);
+            reference.insert(box, text);
+        }
+
+        std::size_t mismatches = 0;
+        for (int i = 0; i < 2000; ++i)
+        {
+            auto const& text = texts[pick(gen)];
+            mapnik::value_unicode_string unknown("Nowhere Lane");
+            std::vector<mapnik::box2d<double>> boxes;
+            for (int j = 0; j < 6; ++j) boxes.push_back(random_box());
+            double margin = (i % 3 == 0) ? 0 : 4;
+            double repeat_distance = (i % 2 == 0) ? 0 : 60;
+
+            bool expected = true;
+            for (auto const& box : boxes)
+            {
+                bool free = reference.has_placement(box, margin, text, repeat_distance);
+                if (detector.has_placement(box, margin, text, repeat_distance) != free) ++mismatches;
+                if (detector.has_placement(box, margin, unknown, repeat_distance) !=
+                    reference.has_placement(box, margin, unknown, repeat_distance)) ++mismatches;
+                expected = expected && free;
+            }
+            if (detector.has_placements(boxes, margin, text, repeat_distance) != expected) ++mismatches;
+            if (repeat_distance <= margin && detector.has_placements(boxes, margin) != expected) ++mismatches;
+        }
+        CHECK(mismatches == 0);
+
+        std::size_t count = 0;
+        for (auto const& lbl : detector)
+        {
+            CHECK(lbl.box == reference.labels_[count].box);
+            CHECK(lbl.text == reference.labels_[count].text);
+            ++count;
+        }
+        CHECK(count == reference.labels_.size());
+
+        detector.clear();
+        reference.labels_.clear();
+        CHECK(detector.begin() == detector.end());
+    }
+
+    SECTION("carried labels let the same placement through")
+    {
+        mapnik::box2d<double> box(10, 10, 50, 20);
+        detector.insert_carried(box, "Main Street");
+        CHECK(detector.has_placement(box, 0, "Main Street", 100));
+        CHECK(detector.has_placements({box}, 0, "Main Street", 100));
+        CHECK(!detector.has_placement(mapnik::box2d<double>(12, 10, 52, 20), 0, "Main Street", 100));
+        CHECK(detector.has_placements({box, mapnik::box2d<double>(200, 200, 220, 210)}, 0, "Main Street", 100));
+        CHECK(!detector.has_placements({box, mapnik::box2d<double>(12, 10, 52, 20)}, 0, "Main Street", 100));
+    }
+
+    SECTION("keeps the quad tree detector's label interface")
+    {
+        mapnik::label_collision_detector4::label lbl(mapnik::box2d<double>(1, 2, 3, 4), "River");
+        CHECK(lbl.text == "River");
+        CHECK(!lbl.carried);
+        detector.insert(lbl.box, lbl.text);
+        std::size_t count = 0;
+        for (mapnik::label_collision_detector4::query_iterator itr = detector.begin(); itr != detector.end(); ++itr)
+        {
+            CHECK(itr->get().box == lbl.box);
+            CHECK(itr->get().text == lbl.text);
+            ++count;
+        }
+        CHECK(count == 1);
+    }
+}
+
+TEST_CASE("label_placement_store")
+{
+    SECTION("finds and deduplicates labels")
+    {
+        mapnik::label_placement_store store(100);
+        CHECK(store.insert(mapnik::box2d<double>(10, 10, 30, 20), "Main Street"));
+        CHECK(store.insert(mapnik::box2d<double>(-5000, 50, 5000, 60), "Long Road"));
+        CHECK(!store.insert(mapnik::box2d<double>(10, 10, 30, 20.00000001), "Main Street"));
+        CHECK(store.insert(mapnik::box2d<double>(10, 10, 30, 20), "Elm Street"));
+        CHECK(store.size() == 3);
+        auto found = store.query(mapnik::box2d<double>(25, 15, 200, 200));
+        REQUIRE(found.size() == 3);
+        CHECK(found[0].text == "Main Street");
+        CHECK(found[1].text == "Long Road");
+        CHECK(found[2].text == "Elm Street");
+        CHECK(store.query(mapnik::box2d<double>(6000, 0, 6100, 100)).empty());
+        store.clear();
+        CHECK(store.size() == 0);
+    }
+
+    SECTION("drops the oldest labels beyond max_labels")
+    {
+        mapnik::label_placement_store store(100, 8);
+        CHECK(store.max_labels() == 8);
+        for (int i = 0; i < 9; ++i)
+        {
+            CHECK(store.insert(mapnik::box2d<double>(i * 10, 0, i * 10 + 5, 5), "Street"));
+        }
+        // down to three quarters of the limit
+        CHECK(store.size() == 6);
+        CHECK(store.evicted() == 3);
+        CHECK(store.query(mapnik::box2d<double>(0, 0, 25, 5)).empty());
+        auto found = store.query(mapnik::box2d<double>(0, 0, 1000, 5));
+        REQUIRE(found.size() == 6);
+        CHECK(found.front().box == mapnik::box2d<double>(30, 0, 35, 5));
+        CHECK(found.back().box == mapnik::box2d<double>(80, 0, 85, 5));
+        // an evicted label can be stored again
+        CHECK(store.insert(mapnik::box2d<double>(0, 0, 5, 5), "Street"));
+    }
+
+    SECTION("tiles share labels across their edges")
+    {
+        // two 256px tiles side by side, 10 map units to the pixel
+        auto store = std::make_shared<mapnik::label_placement_store>(2560);
+        mapnik::box2d<double> extent(-64, -64, 320, 320);
+        mapnik::view_transform left_tr(256, 256, mapnik::box2d<double>(0, 0, 2560, 2560));
+        mapnik::view_transform right_tr(256, 256, mapnik::box2d<double>(2560, 0, 5120, 2560));
+
+        mapnik::label_collision_detector4 left(extent, store, left_tr);
+        mapnik::box2d<double> straddling(230, 100, 290, 112);
+        mapnik::box2d<double> inside(20, 20, 60, 30);
+        REQUIRE(left.has_placement(straddling, 0, "Main Street", 50));
+        left.insert(straddling, "Main Street");
+        left.insert(inside, "Main Street");
+        CHECK(store->size() == 2);
+
+        mapnik::label_collision_detector4 right(extent, store, right_tr);
+        // only the label reaching into the right tile is carried over
+        CHECK(std::distance(right.begin(), right.end()) == 1);
+        mapnik::box2d<double> moved(straddling);
+        moved.move(-256, 0);
+        CHECK(right.has_placement(moved, 0, "Main Street", 50));
+        CHECK(!right.has_placement(mapnik::box2d<double>(-20, 104, 40, 116), 0, "Other Street", 0));
+        CHECK(!right.has_placement(mapnik::box2d<double>(60, 100, 120, 112), 0, "Main Street", 50));
+        right.insert(moved, "Main Street");
+        CHECK(store->size() == 2);
+
+        // labels of the store survive clearing the detector
+        right.clear();
+        CHECK(!right.has_placement(mapnik::box2d<double>(-20, 104, 40, 116)));
+
+        // reset moves the detector to another tile: it is seeded from the
+        // store around that tile and publishes at its map coordinates
+        mapnik::label_collision_detector4 moving(extent, store, left_tr);
+        moving.reset(right_tr);
+        CHECK(std::distance(moving.begin(), moving.end()) == 1);
+        mapnik::box2d<double> right_inside(100, 20, 140, 30);
+        moving.insert(right_inside, "Elm Street");
+        CHECK(store->size() == 3);
+        auto stored = store->query(right_tr.backward(right_inside));
+        REQUIRE(stored.size() == 1);
+        CHECK(stored.front().text == "Elm Street");
+        CHECK(store->query(left_tr.backward(right_inside)).empty());
+
+        // without a store nothing is carried over
+        mapnik::label_collision_detector4 plain(extent);
+        CHECK(plain.has_placement(mapnik::box2d<double>(-20, 104, 40, 116)));
+    }
+}
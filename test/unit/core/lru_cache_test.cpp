@@ -0,0 +1,101 @@
+#include "catch.hpp"
+
+#include <mapnik/util/lru_cache.hpp>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("lru_cache")
+{
+    SECTION("drops the least recently used entries")
+    {
+        mapnik::util::lru_cache<std::string, int> cache;
+        cache.insert("a", 1, 10);
+        cache.insert("b", 2, 10);
+        cache.insert("c", 3, 10);
+        REQUIRE(cache.find("a"));
+        CHECK(*cache.find("a") == 1);
+        cache.evict(2, 0);
+        CHECK(!cache.find("b"));
+        CHECK(cache.find("a"));
+        CHECK(cache.find("c"));
+        cache.evict(0, 10);
+        CHECK(cache.stats().entries == 1);
+        CHECK(cache.stats().bytes == 10);
+        CHECK(cache.stats().evictions == 2);
+    }
+
+    SECTION("keeps the value inserted first")
+    {
+        mapnik::util::lru_cache<std::string, int> cache;
+        CHECK(cache.insert("a", 1) == 1);
+        CHECK(cache.insert("a", 2) == 1);
+        CHECK(cache.stats().entries == 1);
+    }
+
+    SECTION("clear keeps the counters")
+    {
+        mapnik::util::lru_cache<int, int> cache;
+        cache.insert(1, 1, 4);
+        cache.find(1);
+        cache.find(2);
+        cache.clear();
+        mapnik::util::lru_cache_stats stats = cache.stats();
+        CHECK(stats.entries == 0);
+        CHECK(stats.bytes == 0);
+        CHECK(stats.hits == 1);
+        CHECK(stats.misses == 1);
+    }
+}
+
+TEST_CASE("sharded_lru_cache")
+{
+    SECTION("splits its limits between the shards")
+    {
+        mapnik::util::sharded_lru_cache<int, int, std::hash<int>, 4> cache(8, 0);
+        for (int i = 0; i < 100; ++i)
+        {
+            cache.insert(i, i);
+        }
+        mapnik::util::lru_cache_stats stats = cache.stats();
+        CHECK(stats.entries <= 8);
+        CHECK(stats.evictions == 100 - stats.entries);
+        cache.set_max_entries(0);
+        cache.set_max_bytes(16);
+        for (int i = 0; i < 100; ++i)
+        {
+            cache.insert(i, i, 4);
+        }
+        CHECK(cache.stats().bytes <= 16);
+        cache.clear();
+        CHECK(cache.stats().entries == 0);
+    }
+
+    SECTION("hands out one value per key across threads")
+    {
+        using value_type = std::shared_ptr<int const>;
+        mapnik::util::sharded_lru_cache<int, value_type> cache(0, 0);
+        std::vector<std::vector<value_type>> values(4);
+        std::vector<std::thread> threads;
+        for (std::size_t t = 0; t < values.size(); ++t)
+        {
+            threads.emplace_back([&cache, &values, t]() {
+                    for (int i = 0; i < 200; ++i)
+                    {
+                        values[t].push_back(cache.insert(i, std::make_shared<int const>(i)));
+                    }
+                });
+        }
+        for (auto & t : threads) t.join();
+        for (int i = 0; i < 200; ++i)
+        {
+            CHECK(values[1][i] == values[0][i]);
+            CHECK(values[3][i] == values[2][i]);
+            CHECK(values[2][i] == values[0][i]);
+            REQUIRE(cache.find(i));
+            CHECK(*cache.find(i) == values[0][i]);
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#include "catch.hpp"
+
+#include <mapnik/mapped_memory_cache.hpp>
+#include <mapnik/util/fs.hpp>
+
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#pragma GCC diagnostic pop
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> write_files(std::size_t count)
+{
+    std::vector<std::string> filenames;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        std::string filename = "./mapped-memory-cache-test-" + std::to_string(i) + ".bin";
+        std::ofstream file(filename, std::ios::binary);
+        file << std::string(1024, static_cast<char>('a' + i));
+        filenames.push_back(filename);
+    }
+    return filenames;
+}
+
+}
+
+TEST_CASE("mapped_memory_cache")
+{
+    mapnik::mapped_memory_cache & cache = mapnik::mapped_memory_cache::instance();
+    cache.clear();
+    std::vector<std::string> filenames = write_files(4);
+
+    SECTION("counts hits and misses")
+    {
+        mapnik::mapped_memory_cache_stats before = cache.stats();
+        auto region = cache.find(filenames[0], true);
+        REQUIRE(region);
+        CHECK((*region)->get_size() == 1024);
+        auto cached = cache.find(filenames[0], true);
+        REQUIRE(cached);
+        CHECK(*cached == *region);
+        mapnik::mapped_memory_cache_stats after = cache.stats();
+        CHECK(after.misses == before.misses + 1);
+        CHECK(after.hits == before.hits + 1);
+        CHECK(after.mappings == 1);
+        CHECK(after.bytes == 1024);
+    }
+
+    SECTION("evicts unused mappings over budget")
+    {
+        cache.set_max_mappings(2);
+        CHECK(cache.max_mappings() == 2);
+        {
+            // still referenced, so it survives eviction
+            auto in_use = cache.find(filenames[0], true);
+            REQUIRE(in_use);
+            for (std::size_t i = 1; i < filenames.size(); ++i)
+            {
+                REQUIRE(cache.find(filenames[i], true));
+            }
+            mapnik::mapped_memory_cache_stats stats = cache.stats();
+            CHECK(stats.mappings == 2);
+            CHECK(stats.bytes == 2048);
+            auto again = cache.find(filenames[0], false);
+            REQUIRE(again);
+            CHECK(*again == *in_use);
+        }
+        cache.set_max_bytes(1024);
+        CHECK(cache.stats().mappings == 1);
+        cache.set_max_mappings(0);
+        cache.set_max_bytes(0);
+    }
+
+    cache.clear();
+    for (auto const& filename : filenames)
+    {
+        mapnik::util::remove(filename);
+    }
+}
+
+#endif
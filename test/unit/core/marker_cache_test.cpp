@@ -0,0 +1,73 @@
+#include "catch.hpp"
+
+#include <mapnik/marker.hpp>
+#include <mapnik/marker_cache.hpp>
+#include <mapnik/util/fs.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> write_svg_files(std::size_t count)
+{
+    std::vector<std::string> filenames;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        std::string filename = "./marker-cache-test-" + std::to_string(i) + ".svg";
+        std::ofstream file(filename);
+        file << "<svg width='10' height='10' version='1.1' xmlns='http://www.w3.org/2000/svg'>"
+             << "<rect width='" << (i + 1) << "' height='5' fill='red'/></svg>";
+        filenames.push_back(filename);
+    }
+    return filenames;
+}
+
+}
+
+TEST_CASE("marker_cache")
+{
+    mapnik::marker_cache & cache = mapnik::marker_cache::instance();
+    cache.clear();
+    std::vector<std::string> filenames = write_svg_files(48);
+
+    SECTION("counts hits and misses")
+    {
+        mapnik::marker_cache_stats before = cache.stats();
+        auto mark = cache.find(filenames[0], true);
+        REQUIRE(mark->is<mapnik::marker_svg>());
+        CHECK(cache.find(filenames[0], true) == mark);
+        mapnik::marker_cache_stats after = cache.stats();
+        CHECK(after.misses == before.misses + 1);
+        CHECK(after.hits == before.hits + 1);
+        CHECK(after.entries == before.entries + 1);
+        CHECK(after.bytes > before.bytes);
+    }
+
+    SECTION("evicts least recently used markers over budget")
+    {
+        auto builtin = cache.find("shape://ellipse", true);
+        REQUIRE(builtin->is<mapnik::marker_svg>());
+        mapnik::marker_cache_stats before = cache.stats();
+        cache.set_max_bytes(1);
+        CHECK(cache.max_bytes() == 1);
+        for (auto const& filename : filenames)
+        {
+            CHECK(cache.find(filename, true)->is<mapnik::marker_svg>());
+        }
+        mapnik::marker_cache_stats after = cache.stats();
+        // each shard keeps its most recently used marker only
+        CHECK(after.entries <= before.entries + mapnik::marker_cache::num_shards);
+        CHECK(after.evictions >= before.evictions + filenames.size() - mapnik::marker_cache::num_shards);
+        // built-in markers are never evicted
+        CHECK(cache.find("shape://ellipse", true) == builtin);
+        cache.set_max_bytes(0);
+    }
+
+    cache.clear();
+    for (auto const& filename : filenames)
+    {
+        mapnik::util::remove(filename);
+    }
+}
@@ -0,0 +1,131 @@
+#include "catch.hpp"
+
+#include <mapnik/raster_colorizer.hpp>
+#include <mapnik/feature.hpp>
+#include <mapnik/feature_factory.hpp>
+#include <mapnik/image.hpp>
+
+#include <boost/optional.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace {
+
+mapnik::raster_colorizer make_colorizer(bool sorted)
+{
+    mapnik::raster_colorizer colorizer(mapnik::COLORIZER_DISCRETE, mapnik::color(10, 20, 30, 40));
+    mapnik::colorizer_stops stops;
+    stops.emplace_back(-100, mapnik::COLORIZER_LINEAR, mapnik::color(255, 0, 0));
+    stops.emplace_back(0, mapnik::COLORIZER_EXACT, mapnik::color(0, 255, 0));
+    stops.emplace_back(7, mapnik::COLORIZER_INHERIT, mapnik::color(0, 0, 255, 128));
+    stops.emplace_back(7, mapnik::COLORIZER_LINEAR, mapnik::color(0, 255, 255));
+    stops.emplace_back(200, mapnik::COLORIZER_LINEAR, mapnik::color(255, 255, 0));
+    stops.emplace_back(1000, mapnik::COLORIZER_DISCRETE, mapnik::color(255, 0, 255));
+    if (!sorted)
+    {
+        std::swap(stops[1], stops[4]);
+    }
+    colorizer.set_stops(stops);
+    return colorizer;
+}
+
+// pixel by pixel through get_color
+template <typename T>
+void check_colorize(mapnik::raster_colorizer const& colorizer, T const& in,
+                    boost::optional<double> const& nodata)
+{
+    auto ctx = std::make_shared<mapnik::context_type>();
+    mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx, 1));
+    mapnik::image_rgba8 out(in.width(), in.height());
+    colorizer.colorize(out, in, nodata, *feature);
+    std::size_t mismatches = 0;
+    for (std::size_t y = 0; y < in.height(); ++y)
+    {
+        for (std::size_t x = 0; x < in.width(); ++x)
+        {
+            auto val = in(x, y);
+            std::uint32_t expected = (nodata && std::fabs(val - *nodata) < colorizer.get_epsilon())
+                ? 0 : colorizer.get_color(val);
+            if (out(x, y) != expected) ++mismatches;
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+} // namespace
+
+TEST_CASE("raster_colorizer")
+{
+    SECTION("gray8 through the lookup table")
+    {
+        mapnik::image_gray8 in(16, 16);
+        for (std::size_t i = 0; i < 256; ++i) in(i % 16, i / 16) = static_cast<std::uint8_t>(i);
+        for (bool sorted : { true, false })
+        {
+            INFO("sorted stops " << sorted);
+            mapnik::raster_colorizer colorizer = make_colorizer(sorted);
+            check_colorize(colorizer, in, boost::optional<double>());
+            check_colorize(colorizer, in, boost::optional<double>(7));
+        }
+    }
+
+    SECTION("gray16s through the lookup table")
+    {
+        mapnik::image_gray16s in(256, 256);
+        std::int16_t val = std::numeric_limits<std::int16_t>::lowest();
+        for (std::size_t y = 0; y < 256; ++y)
+        {
+            for (std::size_t x = 0; x < 256; ++x)
+            {
+                in(x, y) = val++;
+            }
+        }
+        // too small for the table
+        mapnik::image_gray16s small(4, 4);
+        for (std::size_t i = 0; i < 16; ++i) small(i % 4, i / 4) = static_cast<std::int16_t>(i * 67 - 500);
+        for (bool sorted : { true, false })
+        {
+            INFO("sorted stops " << sorted);
+            mapnik::raster_colorizer colorizer = make_colorizer(sorted);
+            check_colorize(colorizer, in, boost::optional<double>(-32768));
+            check_colorize(colorizer, small, boost::optional<double>(-433));
+        }
+    }
+
+    SECTION("gray32f")
+    {
+        mapnik::image_gray32f in(64, 64);
+        for (std::size_t y = 0; y < 64; ++y)
+        {
+            for (std::size_t x = 0; x < 64; ++x)
+            {
+                // runs of equal values, stop values and values in between
+                in(x, y) = (x < 8) ? -9999.0f : static_cast<float>(y) * 20.0f - 150.0f + static_cast<float>(x / 4) * 0.25f;
+            }
+        }
+        in(10, 0) = std::numeric_limits<float>::quiet_NaN();
+        in(11, 0) = 0.0f;
+        in(12, 0) = 7.0f;
+        in(13, 0) = 1000.0f;
+        for (bool sorted : { true, false })
+        {
+            INFO("sorted stops " << sorted);
+            mapnik::raster_colorizer colorizer = make_colorizer(sorted);
+            check_colorize(colorizer, in, boost::optional<double>(-9999));
+            check_colorize(colorizer, in, boost::optional<double>());
+        }
+    }
+
+    SECTION("get_color")
+    {
+        mapnik::raster_colorizer colorizer = make_colorizer(true);
+        // before the first stop the default mode and color apply
+        CHECK(colorizer.get_color(-500) == mapnik::color(10, 20, 30, 40).rgba());
+        CHECK(colorizer.get_color(0) == mapnik::color(0, 255, 0).rgba());
+        CHECK(colorizer.get_color(3) == mapnik::color(10, 20, 30, 40).rgba());
+        CHECK(colorizer.get_color(7) == mapnik::color(0, 255, 255).rgba());
+        CHECK(colorizer.get_color(2000) == mapnik::color(255, 0, 255).rgba());
+    }
+}
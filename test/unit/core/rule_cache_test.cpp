@@ -0,0 +1,76 @@
+#include "catch.hpp"
+
+#include <mapnik/rule.hpp>
+#include <mapnik/rule_cache.hpp>
+#include <mapnik/expression.hpp>
+#include <mapnik/unicode.hpp>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<std::size_t> candidate_indices(mapnik::rule_cache const& rc, mapnik::value const& val)
+{
+    std::vector<std::size_t> indices;
+    for (auto const& candidate : rc.get_filter_candidates(val))
+    {
+        indices.push_back(candidate.index);
+    }
+    return indices;
+}
+
+}
+
+TEST_CASE("rule_cache")
+{
+    mapnik::transcoder tr("utf8");
+    std::vector<std::string> filters = {
+        "[highway] = 'motorway'",
+        "[highway] = 'primary'",
+        "[area] > 100",
+        "'primary' = [highway]",
+        "[highway] = 'residential'",
+        "[landuse] = 'forest'"
+    };
+    std::vector<mapnik::rule> rules;
+    rules.reserve(filters.size());
+    for (auto const& filter : filters)
+    {
+        rules.emplace_back();
+        rules.back().set_filter(mapnik::parse_expression(filter));
+    }
+
+    SECTION("indexes the most common equality attribute")
+    {
+        mapnik::rule_cache rc;
+        for (auto const& r : rules) rc.add_rule(r);
+        rc.build_filter_index();
+        REQUIRE(rc.has_filter_index());
+        CHECK(rc.filter_index_attribute() == "highway");
+
+        // indexed rules are interleaved with the others in original order
+        CHECK(candidate_indices(rc, tr.transcode("primary")) == std::vector<std::size_t>({1, 2, 3, 5}));
+        CHECK(candidate_indices(rc, tr.transcode("motorway")) == std::vector<std::size_t>({0, 2, 5}));
+        CHECK(candidate_indices(rc, tr.transcode("track")) == std::vector<std::size_t>({2, 5}));
+        CHECK(candidate_indices(rc, mapnik::value_integer(1)) == std::vector<std::size_t>({2, 5}));
+        CHECK(candidate_indices(rc, mapnik::value_null()) == std::vector<std::size_t>({2, 5}));
+
+        for (auto const& candidate : rc.get_filter_candidates(tr.transcode("primary")))
+        {
+            CHECK(candidate.rule_ == rc.get_if_rules()[candidate.index]);
+            CHECK(candidate.matched == (candidate.index == 1 || candidate.index == 3));
+        }
+    }
+
+    SECTION("few equality rules are not indexed")
+    {
+        mapnik::rule_cache rc;
+        rc.add_rule(rules[0]);
+        rc.add_rule(rules[1]);
+        rc.add_rule(rules[2]);
+        rc.build_filter_index();
+        CHECK(!rc.has_filter_index());
+        CHECK(rc.get_filter_candidates(tr.transcode("primary")).empty());
+    }
+}
@@ -0,0 +1,84 @@
+#include "catch.hpp"
+
+#include <mapnik/solid_tile_cache.hpp>
+#include <mapnik/color.hpp>
+#include <mapnik/image.hpp>
+#include <mapnik/image_any.hpp>
+#include <mapnik/image_util.hpp>
+
+#include <string>
+
+TEST_CASE("solid_tile_cache")
+{
+    mapnik::solid_tile_cache & cache = mapnik::solid_tile_cache::instance();
+    std::size_t max_entries = cache.max_entries();
+    std::size_t max_bytes = cache.max_bytes();
+    cache.clear();
+    // hit and miss counters are not reset by clear()
+    mapnik::solid_tile_cache_stats before = cache.stats();
+
+    SECTION("keys on color, size, premultiplication and format")
+    {
+        cache.insert(0xff0000ff, 256, 256, false, "png", "red");
+        CHECK(cache.find(0xff0000ff, 256, 256, false, "png").get() == "red");
+        CHECK(!cache.find(0xff00ff00, 256, 256, false, "png"));
+        CHECK(!cache.find(0xff0000ff, 512, 256, false, "png"));
+        CHECK(!cache.find(0xff0000ff, 256, 256, true, "png"));
+        CHECK(!cache.find(0xff0000ff, 256, 256, false, "png8"));
+        auto stats = cache.stats();
+        CHECK(stats.hits == before.hits + 1);
+        CHECK(stats.misses == before.misses + 4);
+        CHECK(stats.entries == 1);
+        CHECK(stats.bytes == 3);
+    }
+
+    SECTION("evicts least recently used entries")
+    {
+        cache.set_max_entries(2);
+        cache.insert(1, 1, 1, false, "png", "a");
+        cache.insert(2, 1, 1, false, "png", "b");
+        CHECK(cache.find(1, 1, 1, false, "png"));
+        cache.insert(3, 1, 1, false, "png", "c");
+        CHECK(cache.find(1, 1, 1, false, "png"));
+        CHECK(!cache.find(2, 1, 1, false, "png"));
+        CHECK(cache.stats().evictions == before.evictions + 1);
+
+        cache.set_max_entries(0);
+        cache.set_max_bytes(1);
+        CHECK(cache.stats().entries == 1);
+        cache.insert(4, 1, 1, false, "png", "too large");
+        CHECK(!cache.find(4, 1, 1, false, "png"));
+    }
+
+    SECTION("can be disabled")
+    {
+        cache.set_enabled(false);
+        cache.insert(1, 1, 1, false, "png", "a");
+        CHECK(!cache.find(1, 1, 1, false, "png"));
+        cache.set_enabled(true);
+        CHECK(cache.enabled());
+    }
+
+#if defined(HAVE_PNG)
+    SECTION("save_to_string reuses encoded solid images")
+    {
+        mapnik::image_rgba8 im(64, 64);
+        mapnik::fill(im, mapnik::color(0, 0, 255).rgba());
+        std::string first = mapnik::save_to_string(im, "png");
+        CHECK(cache.stats().misses == before.misses + 1);
+        mapnik::image_any any(mapnik::image_rgba8(64, 64));
+        mapnik::fill(any, mapnik::color(0, 0, 255).rgba());
+        CHECK(mapnik::save_to_string(any, "png") == first);
+        CHECK(cache.stats().hits == before.hits + 1);
+
+        // images that are not solid bypass the cache
+        im(3, 3) = 0;
+        CHECK(mapnik::save_to_string(im, "png") != first);
+        CHECK(cache.stats().entries == 1);
+    }
+#endif
+
+    cache.set_max_entries(max_entries);
+    cache.set_max_bytes(max_bytes);
+    cache.clear();
+}
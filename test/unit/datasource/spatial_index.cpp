@@ -23,8 +23,30 @@
 #include "catch.hpp"
 
 #include <mapnik/quad_tree.hpp>
+#include <mapnik/packed_rtree.hpp>
 #include <mapnik/util/spatial_index.hpp>
 
+namespace {
+
+// istringstream counting the bytes read through it
+struct counting_istream : std::istringstream
+{
+    counting_istream(std::string const& str)
+        : std::istringstream(str, std::ios::binary),
+          bytes_read(0) {}
+
+    counting_istream & read(char * s, std::streamsize n)
+    {
+        bytes_read += static_cast<std::size_t>(n);
+        std::istringstream::read(s, n);
+        return *this;
+    }
+
+    std::size_t bytes_read;
+};
+
+}
+
 TEST_CASE("spatial_index")
 {
     SECTION("mapnik::quad_tree<T>")
@@ -84,4 +106,182 @@ TEST_CASE("spatial_index")
         REQUIRE(results[3] == 2);
         REQUIRE(results.size() == 4);
     }
+
+    SECTION("mapnik::quad_tree<T> can be cleared and refilled")
+    {
+        using value_type = std::int32_t;
+        mapnik::box2d<double> extent(0,0,100,100);
+        mapnik::quad_tree<value_type> tree(extent);
+        for (int pass = 0; pass < 3; ++pass)
+        {
+            for (int i = 0; i < 50; ++i)
+            {
+                double x = (i * 37 + pass) % 97;
+                double y = (i * 61) % 89;
+                tree.insert(i, mapnik::box2d<double>(x, y, x + 2, y + 2));
+            }
+            REQUIRE(tree.count_items() == 50);
+            REQUIRE(tree.extent() == extent);
+            int found = 0;
+            for (auto itr = tree.query_in_box(mapnik::box2d<double>(0, 0, 50, 50)); itr != tree.query_end(); ++itr)
+            {
+                ++found;
+            }
+            REQUIRE(found > 0);
+            tree.clear();
+            REQUIRE(tree.count() == 1);
+            REQUIRE(tree.count_items() == 0);
+        }
+    }
+
+    SECTION("mapnik::util::spatial_index_view")
+    {
+        using value_type = std::int32_t;
+        using mapnik::filter_in_box;
+        mapnik::box2d<double> extent(0,0,100,100);
+        mapnik::quad_tree<value_type> tree(extent);
+        for (int i = 0; i < 200; ++i)
+        {
+            double x = (i * 37) % 97;
+            double y = (i * 61) % 89;
+            tree.insert(i, mapnik::box2d<double>(x, y, x + 2, y + 2));
+        }
+        tree.trim();
+        std::ostringstream out(std::ios::binary);
+        tree.write(out);
+        std::string const buffer = out.str();
+
+        mapnik::util::spatial_index_view<value_type, filter_in_box> view(buffer.data(), buffer.size());
+        REQUIRE(view.bounding_box() == extent);
+
+        for (auto const& box : { extent,
+                                 mapnik::box2d<double>(10, 10, 30, 30),
+                                 mapnik::box2d<double>(60, 0, 100, 20),
+                                 mapnik::box2d<double>(200, 200, 300, 300) })
+        {
+            filter_in_box filter(box);
+            std::vector<value_type> expected;
+            std::istringstream in(buffer, std::ios::binary);
+            mapnik::util::spatial_index<value_type, filter_in_box, std::istringstream>::query(filter, in, expected);
+
+            std::vector<value_type> results;
+            view.query(filter, results);
+            CHECK(results == expected);
+
+            std::vector<value_type> first;
+            view.query_first_n(filter, first, 5);
+            CHECK(first.size() == std::min<std::size_t>(5, expected.size()));
+            CHECK(std::equal(first.begin(), first.end(), expected.begin()));
+        }
+
+        view.cache_nodes();
+        REQUIRE(view.nodes_cached());
+        for (auto const& box : { extent, mapnik::box2d<double>(10, 10, 30, 30) })
+        {
+            filter_in_box filter(box);
+            std::vector<value_type> expected;
+            std::istringstream in(buffer, std::ios::binary);
+            mapnik::util::spatial_index<value_type, filter_in_box, std::istringstream>::query(filter, in, expected);
+            std::vector<value_type> results;
+            view.query(filter, results);
+            CHECK(results == expected);
+        }
+
+        // truncated index
+        mapnik::util::spatial_index_view<value_type, filter_in_box> truncated(buffer.data(), buffer.size() / 2);
+        std::vector<value_type> results;
+        filter_in_box filter(extent);
+        CHECK_THROWS(truncated.query(filter, results));
+        CHECK_THROWS((mapnik::util::spatial_index_view<value_type, filter_in_box>(buffer.data(), 8)));
+    }
+
+    SECTION("mapnik::packed_rtree<T>")
+    {
+        using value_type = std::int32_t;
+        using mapnik::filter_in_box;
+        mapnik::box2d<double> extent(0,0,100,100);
+        mapnik::packed_rtree<value_type> rtree(8);
+        std::vector<mapnik::box2d<double>> boxes;
+        for (int i = 0; i < 500; ++i)
+        {
+            double x = (i * 37) % 97;
+            double y = (i * 61) % 89;
+            boxes.emplace_back(x, y, x + 3, y + 3);
+            rtree.insert(i, boxes.back());
+        }
+        REQUIRE(rtree.count_items() == 500);
+        // 500 leaves, 63 + 8 + 1 nodes
+        REQUIRE(rtree.count() == 572);
+
+        std::ostringstream rtree_out(std::ios::binary);
+        rtree.write(rtree_out);
+        std::string const rtree_buffer = rtree_out.str();
+        REQUIRE(rtree_buffer.substr(0, 12) == "mapnik-rtree");
+        // node size and item count are little endian
+        CHECK(rtree_buffer.substr(16, 8) == std::string("\x08\0\0\0\xf4\x01\0\0", 8));
+
+        std::istringstream check_in(rtree_buffer, std::ios::binary);
+        REQUIRE(mapnik::util::check_spatial_index(check_in));
+
+        mapnik::util::spatial_index_view<value_type, filter_in_box> view(rtree_buffer.data(), rtree_buffer.size());
+        CHECK(view.bounding_box() == rtree.extent());
+        std::istringstream rtree_in(rtree_buffer, std::ios::binary);
+        CHECK((mapnik::util::spatial_index<value_type, filter_in_box, std::istringstream>::bounding_box(rtree_in) == rtree.extent()));
+
+        for (auto const& box : { extent,
+                                 mapnik::box2d<double>(10, 10, 30, 30),
+                                 mapnik::box2d<double>(60, 0, 100, 20),
+                                 mapnik::box2d<double>(200, 200, 300, 300) })
+        {
+            filter_in_box filter(box);
+            // leaves are tested individually, so results are exact
+            std::vector<value_type> expected;
+            for (std::size_t i = 0; i < boxes.size(); ++i)
+            {
+                if (filter.pass(boxes[i])) expected.push_back(static_cast<value_type>(i));
+            }
+
+            std::vector<value_type> results;
+            view.query(filter, results);
+            std::sort(results.begin(), results.end());
+            CHECK(results == expected);
+
+            std::vector<value_type> stream_results;
+            std::istringstream rin(rtree_buffer, std::ios::binary);
+            mapnik::util::spatial_index<value_type, filter_in_box, std::istringstream>::query(filter, rin, stream_results);
+            std::sort(stream_results.begin(), stream_results.end());
+            CHECK(stream_results == expected);
+
+            std::vector<value_type> first;
+            view.query_first_n(filter, first, 5);
+            CHECK(first.size() == std::min<std::size_t>(5, expected.size()));
+            std::vector<value_type> stream_first;
+            std::istringstream first_in(rtree_buffer, std::ios::binary);
+            mapnik::util::spatial_index<value_type, filter_in_box, std::istringstream>::query_first_n(filter, first_in, stream_first, 5);
+            CHECK(stream_first == first);
+        }
+
+        // a stream query reads the header and the nodes it visits, not the whole index
+        counting_istream counted(rtree_buffer);
+        std::vector<value_type> small_results;
+        mapnik::util::spatial_index<value_type, filter_in_box, counting_istream>::query(
+            filter_in_box(mapnik::box2d<double>(10, 10, 12, 12)), counted, small_results);
+        CHECK(!small_results.empty());
+        CHECK(counted.bytes_read < rtree_buffer.size() / 4);
+
+        CHECK_THROWS((mapnik::util::spatial_index_view<value_type, filter_in_box>(rtree_buffer.data(), rtree_buffer.size() - 1)));
+    }
+
+    SECTION("empty mapnik::packed_rtree<T>")
+    {
+        using value_type = std::int32_t;
+        mapnik::packed_rtree<value_type> rtree;
+        std::ostringstream out(std::ios::binary);
+        rtree.write(out);
+        std::string const buffer = out.str();
+        mapnik::util::spatial_index_view<value_type, mapnik::filter_in_box> view(buffer.data(), buffer.size());
+        std::vector<value_type> results;
+        view.query(mapnik::filter_in_box(mapnik::box2d<double>(0, 0, 1, 1)), results);
+        CHECK(results.empty());
+    }
 }
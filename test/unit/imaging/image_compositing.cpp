@@ -0,0 +1,87 @@
+#include "catch.hpp"
+
+// mapnik
+#include <mapnik/image.hpp>
+#include <mapnik/image_compositing.hpp>
+
+#include "agg_color_rgba.h"
+#include "agg_pixfmt_rgba.h"
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+mapnik::image_rgba8 random_image(std::size_t width, std::size_t height, std::mt19937 & gen)
+{
+    mapnik::image_rgba8 im(width, height, true, true);
+    std::uniform_int_distribution<unsigned> dist(0, 255);
+    for (std::size_t y = 0; y < height; ++y)
+    {
+        for (std::size_t x = 0; x < width; ++x)
+        {
+            unsigned a = dist(gen);
+            // favour the fully transparent and opaque fast paths of the blenders
+            if (a < 32) a = 0;
+            else if (a > 224) a = 255;
+            unsigned r = a ? dist(gen) % (a + 1) : 0;
+            unsigned g = a ? dist(gen) % (a + 1) : 0;
+            unsigned b = a ? dist(gen) % (a + 1) : 0;
+            im(x, y) = r | (g << 8) | (b << 16) | (a << 24);
+        }
+    }
+    return im;
+}
+
+// pixel by pixel through the AGG blenders
+void reference_composite(mapnik::image_rgba8 & dst, mapnik::image_rgba8 const& src,
+                         mapnik::composite_mode_e mode, float opacity, int dx, int dy)
+{
+    using blender_type = agg::comp_op_table_rgba<agg::rgba8, agg::order_rgba>;
+    unsigned cover = static_cast<unsigned>(255 * opacity);
+    for (int y = 0; y < static_cast<int>(src.height()); ++y)
+    {
+        for (int x = 0; x < static_cast<int>(src.width()); ++x)
+        {
+            int tx = x + dx;
+            int ty = y + dy;
+            if (tx < 0 || ty < 0 || tx >= static_cast<int>(dst.width()) || ty >= static_cast<int>(dst.height())) continue;
+            std::uint8_t const* s = reinterpret_cast<std::uint8_t const*>(&src(x, y));
+            std::uint8_t * d = reinterpret_cast<std::uint8_t*>(&dst(tx, ty));
+            blender_type::g_comp_op_func[mode](d, s[0], s[1], s[2], s[3], cover);
+        }
+    }
+}
+
+} // namespace
+
+TEST_CASE("image compositing")
+{
+    std::mt19937 gen(42);
+    mapnik::image_rgba8 const src = random_image(37, 13, gen);
+    mapnik::image_rgba8 const background = random_image(41, 17, gen);
+
+    SECTION("rgba8 matches the AGG blenders")
+    {
+        std::vector<mapnik::composite_mode_e> modes = {
+            mapnik::src_over, mapnik::dst_in, mapnik::dst_out, mapnik::plus,
+            mapnik::multiply, mapnik::screen, mapnik::overlay, mapnik::darken
+        };
+        std::vector<std::pair<int, int>> offsets = { {0, 0}, {3, 2}, {-5, -1}, {10, -7}, {40, 0} };
+        for (auto mode : modes)
+        {
+            for (float opacity : { 1.0f, 0.5f, 0.0f })
+            {
+                for (auto const& offset : offsets)
+                {
+                    INFO("mode " << mode << " opacity " << opacity << " offset " << offset.first << "," << offset.second);
+                    mapnik::image_rgba8 dst(background);
+                    mapnik::image_rgba8 expected(background);
+                    mapnik::composite(dst, src, mode, opacity, offset.first, offset.second);
+                    reference_composite(expected, src, mode, opacity, offset.first, offset.second);
+                    CHECK(std::equal(dst.begin(), dst.end(), expected.begin()));
+                }
+            }
+        }
+    }
+}
@@ -11,6 +11,75 @@
 // stl
 #include <sstream>
 #include <array>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+mapnik::image_rgba8 random_image(std::size_t width, std::size_t height, std::mt19937 & gen)
+{
+    mapnik::image_rgba8 im(width, height);
+    std::uniform_int_distribution<std::uint32_t> dist;
+    for (std::size_t y = 0; y < height; ++y)
+    {
+        for (std::size_t x = 0; x < width; ++x)
+        {
+            // mostly opaque, so that demultiplying keeps the colours
+            im(x, y) = dist(gen) | 0xf0000000;
+        }
+    }
+    mapnik::set_premultiplied_alpha(im, true);
+    return im;
+}
+
+// a pixel at a time, with the edge handling of the filters
+mapnik::image_rgba8 reference_3x3(mapnik::image_rgba8 const& src, std::array<float, 9> const& k, bool sobel)
+{
+    std::ptrdiff_t w = src.width();
+    std::ptrdiff_t h = src.height();
+    mapnik::image_rgba8 dst(src.width(), src.height());
+    auto sample = [&](std::ptrdiff_t x, std::ptrdiff_t y, int c) -> float
+    {
+        x = std::min(std::max<std::ptrdiff_t>(x, 0), w - 1);
+        // rows are mirrored at the top and bottom
+        if (y < 0) y = h > 1 ? 1 : 0;
+        if (y >= h) y = h > 1 ? h - 2 : 0;
+        return (src(x, y) >> (c * 8)) & 0xff;
+    };
+    for (std::ptrdiff_t y = 0; y < h; ++y)
+    {
+        for (std::ptrdiff_t x = 0; x < w; ++x)
+        {
+            std::uint32_t pixel = src(x, y) & 0xff000000;
+            for (int c = 0; c < 3; ++c)
+            {
+                float p[9];
+                for (int i = 0; i < 9; ++i)
+                {
+                    p[i] = sample(x + i % 3 - 1, y + i / 3 - 1, c);
+                }
+                float out = 0;
+                if (sobel)
+                {
+                    float gx = (p[2] + 2 * p[5] + p[8]) - (p[0] + 2 * p[3] + p[6]);
+                    float gy = (p[0] + 2 * p[1] + p[2]) - (p[6] + 2 * p[7] + p[8]);
+                    out = std::sqrt(gx * gx + gy * gy);
+                }
+                else
+                {
+                    for (int i = 0; i < 9; ++i) out += k[i] * p[i];
+                }
+                out = std::min(std::max(out, 0.0f), 255.0f);
+                pixel |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(out)) << (c * 8);
+            }
+            dst(x, y) = pixel;
+        }
+    }
+    return dst;
+}
+
+}
 
 TEST_CASE("image filter") {
 
@@ -521,4 +590,62 @@ SECTION("test color-blind-tritanope") {
 
 } // END SECTION
 
+SECTION("test 3x3 filters match a per pixel reference") {
+
+    CHECK(mapnik::filter::get_filter_threads() == 1);
+    // split the 1100x1000 images across threads as well
+    mapnik::filter::set_filter_threads(4);
+    std::mt19937 gen(7);
+    std::vector<std::pair<std::string, std::array<float, 9>>> filters = {
+        { "blur", {{ 0.1111f, 0.1111f, 0.1111f, 0.1111f, 0.1111f, 0.1111f, 0.1111f, 0.1111f, 0.1111f }} },
+        { "emboss", {{ -2, -1, 0, -1, 1, 1, 0, 1, 2 }} },
+        { "sharpen", {{ 0, -1, 0, -1, 5, -1, 0, -1, 0 }} },
+        { "edge-detect", {{ 0, 1, 0, 1, -4, 1, 0, 1, 0 }} },
+        { "sobel", {{}} }
+    };
+    for (auto const& size : { std::make_pair(37, 29), std::make_pair(2, 5), std::make_pair(1, 3), std::make_pair(1100, 1000) })
+    {
+        mapnik::image_rgba8 im = random_image(size.first, size.second, gen);
+        for (auto const& filter : filters)
+        {
+            INFO(filter.first << " " << size.first << "x" << size.second);
+            mapnik::image_rgba8 expected(im);
+            mapnik::demultiply_alpha(expected);
+            expected = reference_3x3(expected, filter.second, filter.first == "sobel");
+            mapnik::image_rgba8 const& src = im;
+            mapnik::image_rgba8 out = mapnik::filter::filter_image(src, filter.first);
+            CHECK(std::equal(out.begin(), out.end(), expected.begin()));
+        }
+    }
+
+    mapnik::filter::set_filter_threads(1);
+
+} // END SECTION
+
+SECTION("test agg stack blur matches agg") {
+
+    // split the 1100x1000 images across threads as well
+    mapnik::filter::set_filter_threads(4);
+    std::mt19937 gen(11);
+    for (auto const& size : { std::make_pair(37, 29), std::make_pair(1, 40), std::make_pair(300, 1), std::make_pair(1100, 1000) })
+    {
+        for (auto const& radius : { std::make_pair(1u, 1u), std::make_pair(5u, 0u), std::make_pair(0u, 12u), std::make_pair(40u, 300u) })
+        {
+            INFO(size.first << "x" << size.second << " radius " << radius.first << "," << radius.second);
+            mapnik::image_rgba8 im = random_image(size.first, size.second, gen);
+            mapnik::image_rgba8 expected(im);
+            agg::rendering_buffer buf(expected.bytes(), expected.width(), expected.height(), expected.row_size());
+            agg::pixfmt_rgba32_pre pixf(buf);
+            agg::stack_blur_rgba32(pixf, radius.first, radius.second);
+
+            mapnik::filter::agg_stack_blur op(radius.first, radius.second);
+            mapnik::filter::apply_filter(im, op, 1.0);
+            CHECK(std::equal(im.begin(), im.end(), expected.begin()));
+        }
+    }
+
+    mapnik::filter::set_filter_threads(1);
+
+} // END SECTION
+
 } // END TEST CASE
@@ -6,6 +6,10 @@
 #include <mapnik/image_reader.hpp>
 #include <mapnik/image_util.hpp>
 #include <mapnik/image_util_jpeg.hpp>
+#if defined(HAVE_PNG)
+#include <mapnik/image_util_png.hpp>
+#include <mapnik/png_io.hpp>
+#endif
 #include <mapnik/util/fs.hpp>
 #if defined(HAVE_CAIRO)
 #include <mapnik/cairo/cairo_context.hpp>
@@ -146,6 +150,53 @@ SECTION("writers options")
     int q1 = mapnik::detail::parse_jpeg_quality("jpeg:quality=50");
     REQUIRE(q0 == q1);
 #endif
+#if defined(HAVE_PNG)
+    mapnik::image_rgba8 im(16,16);
+    REQUIRE_THROWS(mapnik::save_to_string(im, "png:fast=1"));
+    REQUIRE_THROWS(mapnik::save_to_string(im, "png:quick"));
+    REQUIRE_NOTHROW(mapnik::save_to_string(im, "png8:m=o:fast"));
+
+    mapnik::png_options fast;
+    mapnik::handle_png_options("png:fast", fast);
+    CHECK(!fast.paletted);
+    CHECK(fast.compression == Z_BEST_SPEED);
+    CHECK(fast.strategy == Z_RLE);
+    CHECK(fast.filters == PNG_FILTER_SUB);
+    mapnik::png_options balanced;
+    mapnik::handle_png_options("png:balanced", balanced);
+    CHECK(balanced.compression == 3);
+    CHECK(balanced.strategy == Z_DEFAULT_STRATEGY);
+    CHECK(balanced.filters == PNG_FILTER_SUB);
+    mapnik::png_options small;
+    mapnik::handle_png_options("png:small", small);
+    CHECK(small.compression == Z_BEST_COMPRESSION);
+    CHECK(small.strategy == Z_DEFAULT_STRATEGY);
+    CHECK(small.filters == PNG_ALL_FILTERS);
+    // paletted output keeps the none filter
+    mapnik::png_options small8;
+    mapnik::handle_png_options("png8:small", small8);
+    CHECK(small8.paletted);
+    CHECK(small8.compression == Z_BEST_COMPRESSION);
+    CHECK(small8.filters == PNG_FILTER_NONE);
+    // explicit options win over the preset whatever their position
+    mapnik::png_options overridden;
+    mapnik::handle_png_options("png:z=6:fast:f=none", overridden);
+    CHECK(overridden.compression == 6);
+    CHECK(overridden.strategy == Z_RLE);
+    CHECK(overridden.filters == PNG_FILTER_NONE);
+
+    mapnik::image_rgba8 gradient(256,256);
+    for (unsigned y = 0; y < gradient.height(); ++y)
+    {
+        for (unsigned x = 0; x < gradient.width(); ++x)
+        {
+            gradient(x,y) = mapnik::color(x, y, (x * y) >> 8, 255).rgba();
+        }
+    }
+    std::string fast_png = mapnik::save_to_string(gradient, "png:fast");
+    std::string small_png = mapnik::save_to_string(gradient, "png:small");
+    CHECK(fast_png.size() >= small_png.size());
+#endif
 } // END SECTION
 
 
@@ -162,6 +213,10 @@ SECTION("image_util : save_to_file/save_to_stream/save_to_string")
     supported_types.push_back(std::make_tuple("png","png32"));
     supported_types.push_back(std::make_tuple("png","png8"));
     supported_types.push_back(std::make_tuple("png","png256"));
+    supported_types.push_back(std::make_tuple("png","png:fast"));
+    supported_types.push_back(std::make_tuple("png","png:balanced"));
+    supported_types.push_back(std::make_tuple("png","png8:small"));
+    supported_types.push_back(std::make_tuple("png","png:fast:z=6:f=none"));
 #endif
 #if defined(HAVE_JPEG)
     supported_types.push_back(std::make_tuple("jpeg","jpeg"));
@@ -210,6 +265,47 @@ SECTION("image_util : save_to_file/save_to_stream/save_to_string")
     }
 }
 
+SECTION("multi threaded encoders match the single threaded ones")
+{
+    // large enough to be split into several chunks
+    mapnik::image_rgba8 im(1024, 1024);
+    for (unsigned y = 0; y < im.height(); ++y)
+    {
+        for (unsigned x = 0; x < im.width(); ++x)
+        {
+            im(x, y) = mapnik::color(x % 256, y % 256, (x * y) % 256, 255 - (x + y) % 128).rgba();
+        }
+    }
+    std::vector<std::string> formats;
+#if defined(HAVE_PNG)
+    formats.push_back("png32");
+    formats.push_back("png32:t=0:f=all");
+    formats.push_back("png8");
+    formats.push_back("png8:c=16");
+#endif
+#if defined(HAVE_TIFF)
+    formats.push_back("tiff");
+    formats.push_back("tiff:method=tiled:tile_width=256:tile_height=256");
+#endif
+    for (auto const& format : formats)
+    {
+        INFO(format);
+        std::string single = mapnik::save_to_string(im, format);
+        std::string multi = mapnik::save_to_string(im, format + ":threads=4");
+        std::unique_ptr<mapnik::image_reader> reader1(mapnik::get_image_reader(single.data(), single.size()));
+        std::unique_ptr<mapnik::image_reader> reader2(mapnik::get_image_reader(multi.data(), multi.size()));
+        REQUIRE(reader1);
+        REQUIRE(reader2);
+        CHECK(reader2->width() == im.width());
+        CHECK(reader2->height() == im.height());
+        auto im1 = reader1->read(0, 0, im.width(), im.height());
+        auto im2 = reader2->read(0, 0, im.width(), im.height());
+        REQUIRE(im1.size() == im2.size());
+        CHECK(0 == std::memcmp(im1.bytes(), im2.bytes(), im1.size()));
+    }
+    REQUIRE_THROWS(mapnik::save_to_string(im, "png:threads=-1"));
+} // END SECTION
+
 SECTION("Quantising small (less than 3 pixel images preserve original colours")
 {
 #if defined(HAVE_PNG)
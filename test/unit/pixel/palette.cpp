@@ -2,6 +2,7 @@
 #include "catch.hpp"
 
 #include <mapnik/palette.hpp>
+#include <mapnik/hextree.hpp>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -87,4 +88,63 @@ SECTION("rgba palette - act pal_256")
 
 } // END SECTION
 
+SECTION("rgba palette - from colors")
+{
+    std::vector<mapnik::rgba> colors = { {255,255,255,255}, {0,0,0,255}, {255,0,0,255}, {0,0,0,0} };
+    mapnik::rgba_palette rgba_pal(colors);
+    CHECK(rgba_pal.valid());
+    CHECK(rgba_pal.palette().size() == 4);
+    std::string str;
+    for (auto const& c : colors)
+    {
+        str.push_back(c.r);
+        str.push_back(c.g);
+        str.push_back(c.b);
+        str.push_back(c.a);
+    }
+    mapnik::rgba_palette parsed(str);
+    CHECK(rgba_pal.to_string() == parsed.to_string());
+    for (unsigned val : { 0x00000000u, 0xff0000feu, 0xfffefefeu, 0xff010101u, 0x80808080u })
+    {
+        CHECK(rgba_pal.quantize(val) == parsed.quantize(val));
+    }
+} // END SECTION
+
+SECTION("quantize cache")
+{
+    // web safe colors plus a few translucent ones
+    std::vector<mapnik::rgba> colors;
+    for (unsigned r = 0; r < 256; r += 51)
+        for (unsigned g = 0; g < 256; g += 51)
+            for (unsigned b = 0; b < 256; b += 51)
+                colors.emplace_back(r, g, b, 255);
+    for (unsigned a = 0; a < 255; a += 32)
+    {
+        colors.emplace_back(a / 2, a / 2, a / 2, a);
+    }
+    mapnik::rgba_palette rgba_pal(colors);
+    mapnik::rgba_palette reference(colors);
+    mapnik::quantize_cache<mapnik::rgba_palette> cache(rgba_pal);
+
+    mapnik::hextree<mapnik::rgba> tree(64);
+    std::vector<unsigned> pixels;
+    unsigned val = 12345;
+    for (unsigned i = 0; i < 20000; ++i)
+    {
+        // a few thousand distinct colors, with runs and colliding slots
+        if (i % 3 != 0) val = val * 1103515245u + 12345u;
+        pixels.push_back(i % 7 == 0 ? 0 : (val | 0xff000000) & 0xfff0f0f0);
+        tree.insert(mapnik::rgba(pixels.back()));
+    }
+    std::vector<mapnik::rgba> tree_palette;
+    tree.create_palette(tree_palette);
+    mapnik::quantize_cache<mapnik::hextree<mapnik::rgba>> tree_cache(tree);
+
+    for (unsigned pixel : pixels)
+    {
+        CHECK(cache.quantize(pixel) == reference.quantize(pixel));
+        CHECK(tree_cache.quantize(pixel) == tree.quantize(pixel));
+    }
+} // END SECTION
+
 } // END TEST CASE
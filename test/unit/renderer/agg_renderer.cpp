@@ -0,0 +1,188 @@
+#include "catch.hpp"
+#include "map_fixture.hpp"
+
+#include <mapnik/agg_renderer.hpp>
+#include <mapnik/request.hpp>
+#include <mapnik/image_util.hpp>
+#include <mapnik/image_filter.hpp>
+#include <mapnik/image_filter_types.hpp>
+#include <mapnik/image_compositing.hpp>
+#include <mapnik/label_collision_detector.hpp>
+#include <mapnik/view_transform.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+mapnik::Map make_map()
+{
+    mapnik::Map m(256, 256);
+    m.set_background(mapnik::color(255, 255, 255, 128));
+    mapnik::feature_type_style style = testing::polygon_style(mapnik::color(0, 100, 200));
+    // style level compositing renders through the internal buffer
+    style.set_opacity(0.5);
+    testing::add_layer(m, "layer", std::move(style),
+                       testing::make_feature(testing::make_polygon({ { 10, 10 }, { 150, 40 }, { 60, 190 } })));
+    return m;
+}
+
+struct filtered_layer
+{
+    mapnik::box2d<double> box;
+    std::string filters;
+    mapnik::composite_mode_e comp_op;
+};
+
+void add_layer(mapnik::Map & m, std::string const& name, mapnik::box2d<double> const& box,
+               std::string const& filters, mapnik::composite_mode_e comp_op, bool plain)
+{
+    mapnik::feature_type_style style = testing::polygon_style(mapnik::color(200, 60, 20));
+    if (!plain)
+    {
+        REQUIRE(mapnik::filter::parse_image_filters(filters, style.image_filters()));
+        style.set_comp_op(comp_op);
+    }
+    testing::add_layer(m, name, std::move(style), testing::make_feature(testing::make_polygon(box)));
+}
+
+// every layer rendered on its own, then filtered and composited over the
+// whole image
+mapnik::image_rgba8 composite_layers(std::vector<filtered_layer> const& layers)
+{
+    mapnik::image_rgba8 result(200, 200, true, true);
+    mapnik::color background(240, 240, 200, 200);
+    background.premultiply();
+    mapnik::fill(result, background);
+    for (auto const& layer : layers)
+    {
+        mapnik::Map m(200, 200);
+        add_layer(m, "plain", layer.box, layer.filters, layer.comp_op, true);
+        m.zoom_to_box(mapnik::box2d<double>(0, 0, 200, 200));
+        mapnik::image_rgba8 im(200, 200);
+        mapnik::agg_renderer<mapnik::image_rgba8> ren(m, im);
+        ren.apply();
+        mapnik::premultiply_alpha(im);
+        mapnik::filter::filter_image(im, layer.filters);
+        mapnik::premultiply_alpha(im);
+        mapnik::composite(result, im, layer.comp_op);
+    }
+    mapnik::demultiply_alpha(result);
+    return result;
+}
+
+mapnik::image_rgba8 render(mapnik::Map const& m, mapnik::request const& req)
+{
+    mapnik::image_rgba8 im(req.width(), req.height());
+    mapnik::agg_renderer<mapnik::image_rgba8> ren(m, req, mapnik::attributes(), im);
+    ren.apply();
+    return im;
+}
+
+}
+
+TEST_CASE("agg_renderer") {
+
+SECTION("a reset renderer matches a fresh one") {
+
+    // apply() renders the map's current extent, so the map is zoomed to
+    // every request; each extent comes with a point inside the polygon
+    mapnik::Map m = make_map();
+    m.resize(128, 128);
+    struct view
+    {
+        mapnik::box2d<double> extent;
+        double x;
+        double y;
+    };
+    std::vector<view> views = {
+        { mapnik::box2d<double>(0, 0, 200, 200), 73, 80 },
+        { mapnik::box2d<double>(0, 0, 100, 100), 73, 80 },
+        { mapnik::box2d<double>(100, 0, 200, 100), 110, 50 },
+        { mapnik::box2d<double>(0, 0, 200, 200), 73, 80 }
+    };
+    m.zoom_to_box(views.front().extent);
+    mapnik::request first(128, 128, m.get_current_extent());
+    mapnik::image_rgba8 im(128, 128);
+    mapnik::agg_renderer<mapnik::image_rgba8> ren(m, first, mapnik::attributes(), im);
+    ren.apply();
+    CHECK(std::equal(im.begin(), im.end(), render(m, first).begin()));
+
+    for (auto const& v : views)
+    {
+        INFO(v.extent);
+        m.zoom_to_box(v.extent);
+        mapnik::request req(128, 128, m.get_current_extent());
+        req.set_buffer_size(16);
+        ren.reset(req);
+        ren.apply();
+        mapnik::image_rgba8 expected = render(m, req);
+        CHECK(std::equal(im.begin(), im.end(), expected.begin()));
+        CHECK(im.painted() == expected.painted());
+        // the polygon is drawn over the white background
+        mapnik::view_transform tr(128, 128, v.extent);
+        double x = v.x;
+        double y = v.y;
+        tr.forward(&x, &y);
+        mapnik::color c = mapnik::get_pixel<mapnik::color>(im, static_cast<std::size_t>(x), static_cast<std::size_t>(y));
+        CHECK(c.red() < 200);
+        CHECK(c.blue() > c.red());
+    }
+
+    mapnik::request too_large(256, 128, views.front().extent);
+    CHECK_THROWS_AS(ren.reset(too_large), std::runtime_error);
+}
+
+SECTION("reset leaves a detector passed in by the caller alone") {
+
+    mapnik::Map m = make_map();
+    mapnik::request req(128, 128, mapnik::box2d<double>(0, 0, 200, 200));
+    auto detector = std::make_shared<mapnik::label_collision_detector4>(mapnik::box2d<double>(0, 0, 128, 128));
+    mapnik::box2d<double> label(10, 10, 20, 20);
+    detector->insert(label);
+    mapnik::image_rgba8 im(128, 128);
+    mapnik::agg_renderer<mapnik::image_rgba8> ren(m, req, mapnik::attributes(), im, detector);
+    mapnik::request other(128, 128, mapnik::box2d<double>(0, 0, 100, 100));
+    other.set_buffer_size(16);
+    ren.reset(other);
+    CHECK(!detector->has_placement(label));
+}
+
+SECTION("styles are filtered and composited where they painted") {
+
+    std::vector<std::vector<filtered_layer>> cases = {
+        { { mapnik::box2d<double>(10, 150, 30, 170), "agg-stack-blur(6,6)", mapnik::src_over },
+          { mapnik::box2d<double>(120, 20, 160, 60), "emboss,agg-stack-blur(2,9)", mapnik::multiply } },
+        { { mapnik::box2d<double>(0, 0, 20, 20), "blur,sharpen", mapnik::screen },
+          { mapnik::box2d<double>(50, 50, 52, 52), "sobel", mapnik::src_over } },
+        // comp-ops and filters that change pixels outside of what was painted
+        { { mapnik::box2d<double>(80, 80, 100, 100), "agg-stack-blur(3,3)", mapnik::dst_in } },
+        { { mapnik::box2d<double>(80, 80, 100, 100), "x-gradient", mapnik::src_over } }
+    };
+    for (auto const& layers : cases)
+    {
+        INFO(layers.front().filters);
+        mapnik::Map m(200, 200);
+        m.set_background(mapnik::color(240, 240, 200, 200));
+        for (std::size_t i = 0; i < layers.size(); ++i)
+        {
+            add_layer(m, "layer-" + std::to_string(i), layers[i].box, layers[i].filters, layers[i].comp_op, false);
+        }
+        m.zoom_to_box(mapnik::box2d<double>(0, 0, 200, 200));
+        mapnik::image_rgba8 im(200, 200);
+        mapnik::agg_renderer<mapnik::image_rgba8> ren(m, im);
+        ren.apply();
+        mapnik::image_rgba8 expected = composite_layers(layers);
+        CHECK(std::equal(im.begin(), im.end(), expected.begin()));
+
+        // the style buffer is cleared between renders
+        mapnik::request req(200, 200, m.get_current_extent());
+        ren.reset(req);
+        ren.apply();
+        CHECK(std::equal(im.begin(), im.end(), expected.begin()));
+    }
+}
+
+}
@@ -0,0 +1,95 @@
+#include "catch.hpp"
+#include "map_fixture.hpp"
+
+#include <mapnik/band_renderer.hpp>
+#include <mapnik/agg_renderer.hpp>
+#include <mapnik/image_util.hpp>
+#include <mapnik/image_reader.hpp>
+
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+mapnik::Map make_map()
+{
+    mapnik::Map m(100, 203);
+    m.set_background(mapnik::color(255, 255, 255));
+    // a triangle crossing every band
+    testing::add_layer(m, "layer", testing::polygon_style(mapnik::color(0, 100, 200)),
+                       testing::make_feature(testing::make_polygon({ { 10, 10 }, { 90, 30 }, { 40, 190 } })));
+    m.zoom_to_box(mapnik::box2d<double>(0, 0, 100, 203));
+    return m;
+}
+
+}
+
+TEST_CASE("band renderer") {
+
+SECTION("bands stitch into the full rendering") {
+
+    mapnik::Map m = make_map();
+    mapnik::image_rgba8 full(m.width(), m.height());
+    mapnik::agg_renderer<mapnik::image_rgba8> ren(m, full);
+    ren.apply();
+
+    mapnik::image_rgba8 stitched(m.width(), m.height());
+    unsigned bands = 0;
+    unsigned rows = 0;
+    mapnik::render_bands(m, 48, [&](mapnik::image_rgba8 const& band, unsigned y)
+    {
+        CHECK(y == rows);
+        CHECK(band.width() == m.width());
+        for (unsigned j = 0; j < band.height(); ++j)
+        {
+            for (unsigned i = 0; i < band.width(); ++i)
+            {
+                stitched(i, y + j) = band(i, j);
+            }
+        }
+        rows += band.height();
+        ++bands;
+    });
+    // the 11 row remainder is folded into the last band
+    CHECK(bands == 4);
+    CHECK(rows == m.height());
+    // polygons are clipped to each band, which can move antialiased edges by
+    // a rounding step
+    CHECK(mapnik::compare(full, stitched, 1) == 0);
+}
+
+SECTION("bands must be at least 16 rows") {
+
+    mapnik::Map m = make_map();
+    CHECK_THROWS_AS(mapnik::render_bands(m, 8, [](mapnik::image_rgba8 const&, unsigned) {}),
+                    std::runtime_error);
+}
+
+#if defined(HAVE_PNG)
+SECTION("bands stream into a png") {
+
+    mapnik::Map m = make_map();
+    mapnik::image_rgba8 full(m.width(), m.height());
+    mapnik::agg_renderer<mapnik::image_rgba8> ren(m, full);
+    ren.apply();
+
+    std::ostringstream ss;
+    mapnik::render_to_stream(m, ss, "png32", 64);
+    std::string data = ss.str();
+    std::unique_ptr<mapnik::image_reader> reader(mapnik::get_image_reader(data.data(), data.size()));
+    REQUIRE(reader);
+    CHECK(reader->width() == m.width());
+    CHECK(reader->height() == m.height());
+    mapnik::image_any decoded = reader->read(0, 0, reader->width(), reader->height());
+    REQUIRE(decoded.is<mapnik::image_rgba8>());
+    mapnik::image_rgba8 const& im = mapnik::util::get<mapnik::image_rgba8>(decoded);
+    CHECK(mapnik::compare(full, im, 1) == 0);
+
+    std::ostringstream paletted;
+    CHECK_THROWS(mapnik::render_to_stream(m, paletted, "png8", 64));
+}
+#endif
+
+}
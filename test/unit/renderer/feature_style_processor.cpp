@@ -0,0 +1,134 @@
+#include "catch.hpp"
+#include "map_fixture.hpp"
+
+#include <mapnik/memory_datasource.hpp>
+#include <mapnik/feature.hpp>
+#include <mapnik/feature_factory.hpp>
+#include <mapnik/map.hpp>
+#include <mapnik/params.hpp>
+#include <mapnik/layer.hpp>
+#include <mapnik/rule.hpp>
+#include <mapnik/feature_type_style.hpp>
+#include <mapnik/agg_renderer.hpp>
+#include <mapnik/image_util.hpp>
+#include <mapnik/symbolizer.hpp>
+#include <mapnik/expression.hpp>
+
+namespace {
+
+mapnik::Map make_map(std::size_t num_layers)
+{
+    mapnik::Map m(256, 256);
+    for (std::size_t i = 0; i < num_layers; ++i)
+    {
+        double offset = static_cast<double>(i) * 10.0;
+        testing::add_layer(m, "layer-" + std::to_string(i),
+                           testing::polygon_style(mapnik::color(i * 20 % 256, 100, 200, 128)),
+                           testing::make_feature(testing::make_polygon(
+                               mapnik::box2d<double>(offset, offset, offset + 100, offset + 100))));
+    }
+    m.zoom_to_box(mapnik::box2d<double>(-10, -10, 250, 250));
+    return m;
+}
+
+mapnik::Map make_multi_style_map(bool stream_features)
+{
+    mapnik::Map m(256, 256);
+    mapnik::context_ptr ctx = std::make_shared<mapnik::context_type>();
+    ctx->push("class");
+
+    mapnik::parameters params;
+    params["type"] = "memory";
+    auto ds = std::make_shared<mapnik::memory_datasource>(params);
+    for (int i = 0; i < 20; ++i)
+    {
+        mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx, i));
+        feature->put("class", static_cast<mapnik::value_integer>(i % 3));
+        mapnik::geometry::line_string<double> line;
+        line.emplace_back(0, i * 10.0);
+        line.emplace_back(250, 250 - i * 10.0);
+        feature->set_geometry(std::move(line));
+        ds->push(feature);
+    }
+
+    mapnik::layer lyr("layer");
+    lyr.set_datasource(ds);
+    lyr.set_stream_features(stream_features);
+    for (int i = 0; i < 3; ++i)
+    {
+        std::string name = "style-" + std::to_string(i);
+        mapnik::feature_type_style style;
+        {
+            mapnik::rule r;
+            r.set_filter(mapnik::parse_expression("[class] = " + std::to_string(i)));
+            mapnik::line_symbolizer line_sym;
+            mapnik::put(line_sym, mapnik::keys::stroke, mapnik::color(i * 100, 0, 0));
+            mapnik::put(line_sym, mapnik::keys::stroke_width, 4.0 - i);
+            r.append(std::move(line_sym));
+            style.add_rule(std::move(r));
+        }
+        {
+            mapnik::rule r;
+            r.set_else(true);
+            mapnik::line_symbolizer line_sym;
+            mapnik::put(line_sym, mapnik::keys::stroke, mapnik::color(0, 0, i * 100, 64));
+            r.append(std::move(line_sym));
+            style.add_rule(std::move(r));
+        }
+        m.insert_style(name, std::move(style));
+        lyr.add_style(name);
+    }
+    m.add_layer(lyr);
+    m.zoom_to_box(mapnik::box2d<double>(-10, -10, 260, 260));
+    return m;
+}
+
+}
+
+TEST_CASE("feature_style_processor") {
+
+SECTION("concurrent layer preparation matches serial rendering") {
+
+    mapnik::Map m = make_map(12);
+
+    mapnik::image_rgba8 serial(m.width(), m.height());
+    {
+        mapnik::agg_renderer<mapnik::image_rgba8> ren(m, serial);
+        REQUIRE(ren.query_concurrency() == 1);
+        ren.apply();
+    }
+    REQUIRE(serial.painted());
+
+    for (unsigned threads : {2u, 4u, 32u})
+    {
+        mapnik::image_rgba8 concurrent(m.width(), m.height());
+        mapnik::agg_renderer<mapnik::image_rgba8> ren(m, concurrent);
+        ren.set_query_concurrency(threads);
+        ren.apply();
+        CHECK(concurrent.painted());
+        CHECK(mapnik::compare(serial, concurrent) == 0);
+    }
+}
+
+SECTION("streamed multi-style layer matches per style queries") {
+
+    mapnik::Map m = make_multi_style_map(false);
+    mapnik::image_rgba8 expected(m.width(), m.height());
+    {
+        mapnik::agg_renderer<mapnik::image_rgba8> ren(m, expected);
+        ren.apply();
+    }
+    REQUIRE(expected.painted());
+
+    mapnik::Map m_stream = make_multi_style_map(true);
+    REQUIRE(m_stream.layers()[0].stream_features());
+    mapnik::image_rgba8 streamed(m_stream.width(), m_stream.height());
+    {
+        mapnik::agg_renderer<mapnik::image_rgba8> ren(m_stream, streamed);
+        ren.apply();
+    }
+    CHECK(streamed.painted());
+    CHECK(mapnik::compare(expected, streamed) == 0);
+}
+
+}
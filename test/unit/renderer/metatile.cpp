@@ -0,0 +1,91 @@
+#include "catch.hpp"
+#include "map_fixture.hpp"
+
+#include <mapnik/metatile.hpp>
+#include <mapnik/agg_renderer.hpp>
+#include <mapnik/image_util.hpp>
+#include <mapnik/image_view_any.hpp>
+
+#include <stdexcept>
+
+namespace {
+
+mapnik::Map make_map()
+{
+    mapnik::Map m(256, 256);
+    // covers the lower left tile and half of its neighbours
+    testing::add_layer(m, "layer", testing::polygon_style(mapnik::color(0, 100, 200)),
+                       testing::make_feature(testing::make_polygon(mapnik::box2d<double>(0, 0, 150, 150))));
+    return m;
+}
+
+}
+
+TEST_CASE("metatile") {
+
+SECTION("tiles are views into one rendering") {
+
+    mapnik::Map m = make_map();
+    mapnik::metatile meta(mapnik::box2d<double>(0, 0, 200, 200), 2, 2, 64);
+    meta.set_buffer_size(32);
+    CHECK(meta.get_request().width() == 128);
+    CHECK(meta.get_request().height() == 128);
+    meta.render(m);
+    REQUIRE(meta.image().painted());
+
+    mapnik::image_view_rgba8 lower_left = meta.tile(0, 1);
+    CHECK(lower_left.x() == 0);
+    CHECK(lower_left.y() == 64);
+    CHECK(lower_left.width() == 64);
+    CHECK(lower_left.height() == 64);
+    CHECK(mapnik::is_solid(mapnik::image_view_any(lower_left)));
+    CHECK(lower_left(5, 0) == meta.image()(5, 64));
+    CHECK(lower_left(10, 10) != 0);
+    // the upper right corner is outside the polygon
+    mapnik::image_view_rgba8 upper_right = meta.tile(1, 0);
+    CHECK(upper_right(60, 5) == 0);
+    CHECK(upper_right(5, 60) != 0);
+
+    // a single tile rendered on its own matches its metatile slice
+    mapnik::Map single = make_map();
+    single.resize(64, 64);
+    single.zoom_to_box(mapnik::box2d<double>(0, 0, 100, 100));
+    mapnik::image_rgba8 image(64, 64);
+    mapnik::agg_renderer<mapnik::image_rgba8> ren(single, image);
+    ren.apply();
+    CHECK(image(10, 10) == lower_left(10, 10));
+
+    CHECK_THROWS_AS(meta.tile(2, 0), std::out_of_range);
+    // the caller's map is left as it was
+    CHECK(m.width() == 256);
+    CHECK(m.height() == 256);
+}
+
+SECTION("invalid sizes throw before allocating") {
+
+    mapnik::box2d<double> extent(0, 0, 100, 100);
+    CHECK_THROWS(mapnik::metatile(extent, 0, 2, 256));
+    CHECK_THROWS(mapnik::metatile(extent, 2, 2, 0));
+    // 65536 * 65536 does not fit in an unsigned
+    CHECK_THROWS(mapnik::metatile(extent, 65536, 1, 65536));
+}
+
+#if defined(HAVE_PNG)
+SECTION("tiles are encoded concurrently") {
+
+    mapnik::Map m = make_map();
+    mapnik::metatile meta(mapnik::box2d<double>(0, 0, 200, 200), 4, 4, 32);
+    meta.render(m);
+    std::vector<std::string> serial = meta.encode("png8");
+    REQUIRE(serial.size() == 16);
+    std::vector<std::string> concurrent = meta.encode("png8", 4);
+    REQUIRE(concurrent.size() == 16);
+    for (std::size_t i = 0; i < serial.size(); ++i)
+    {
+        CHECK(!serial[i].empty());
+        CHECK(serial[i] == concurrent[i]);
+    }
+}
+#endif
+
+}
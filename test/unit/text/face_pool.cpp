@@ -0,0 +1,145 @@
+#include "catch.hpp"
+#include "map_fixture.hpp"
+
+#include <mapnik/agg_renderer.hpp>
+#include <mapnik/request.hpp>
+#include <mapnik/font_engine_freetype.hpp>
+#include <mapnik/text/face.hpp>
+#include <mapnik/text/face_pool.hpp>
+#include <mapnik/text/font_library.hpp>
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+mapnik::Map make_label_map()
+{
+    mapnik::Map m(200, 200);
+    testing::add_layer(m, "layer", testing::label_style("DejaVu Sans Book", 14.0),
+                       testing::make_feature(mapnik::geometry::point<double>(100, 100), "Main Street"));
+    m.zoom_to_box(mapnik::box2d<double>(0, 0, 200, 200));
+    return m;
+}
+
+} // namespace
+
+TEST_CASE("face_pool")
+{
+    REQUIRE(mapnik::freetype_engine::register_font("fonts/dejavu-fonts-ttf-2.37/ttf/DejaVuSans.ttf"));
+    REQUIRE(mapnik::freetype_engine::register_font("fonts/dejavu-fonts-ttf-2.37/ttf/DejaVuSans-Bold.ttf"));
+    mapnik::face_pool & pool = mapnik::face_pool::instance();
+    std::size_t max_faces = pool.max_faces();
+    pool.clear();
+
+    mapnik::font_library library;
+    mapnik::freetype_engine::font_file_mapping_type font_file_mapping;
+    mapnik::freetype_engine::font_memory_cache_type font_memory_cache;
+
+    SECTION("faces outlive their face_manager")
+    {
+        mapnik::face_ptr face;
+        {
+            mapnik::face_manager fm(library, font_file_mapping, font_memory_cache);
+            face = fm.get_face("DejaVu Sans Book");
+            REQUIRE(face);
+        }
+        mapnik::face_pool_stats stats = pool.stats();
+        mapnik::face_manager fm(library, font_file_mapping, font_memory_cache);
+        CHECK(fm.get_face("DejaVu Sans Book") == face);
+        CHECK(pool.stats().hits == stats.hits + 1);
+        CHECK(stats.faces >= 1);
+        CHECK(stats.font_bytes > 0);
+        CHECK(!fm.get_face("No Such Font"));
+    }
+
+    SECTION("every thread opens its own faces")
+    {
+        mapnik::face_ptr face = pool.get_face("DejaVu Sans Book");
+        REQUIRE(face);
+        mapnik::face_ptr other;
+        std::thread t([&]() {
+                other = pool.get_face("DejaVu Sans Book");
+                CHECK(pool.get_face("DejaVu Sans Book") == other);
+            });
+        t.join();
+        REQUIRE(other);
+        CHECK(other != face);
+        // still usable after its thread is gone
+        CHECK(other->family_name() == "DejaVu Sans");
+        CHECK(other->set_character_sizes(12));
+    }
+
+    SECTION("a face_manager used on another thread takes that thread's faces")
+    {
+        mapnik::face_manager fm(library, font_file_mapping, font_memory_cache);
+        mapnik::face_ptr face = fm.get_face("DejaVu Sans Book");
+        REQUIRE(face);
+        mapnik::face_ptr other;
+        mapnik::face_ptr pooled;
+        std::thread t([&]() {
+                other = fm.get_face("DejaVu Sans Book");
+                pooled = pool.get_face("DejaVu Sans Book");
+            });
+        t.join();
+        REQUIRE(other);
+        CHECK(other != face);
+        CHECK(other == pooled);
+        CHECK(fm.get_face("DejaVu Sans Book") == face);
+    }
+
+    SECTION("a renderer can be reused on another thread")
+    {
+        mapnik::Map m = make_label_map();
+        mapnik::request req(200, 200, m.get_current_extent());
+        mapnik::image_rgba8 expected(200, 200);
+        {
+            mapnik::agg_renderer<mapnik::image_rgba8> ren(m, req, mapnik::attributes(), expected);
+            ren.apply();
+        }
+        REQUIRE(expected.painted());
+
+        mapnik::image_rgba8 im(200, 200);
+        mapnik::agg_renderer<mapnik::image_rgba8> ren(m, req, mapnik::attributes(), im);
+        ren.apply();
+        mapnik::face_pool_stats stats = pool.stats();
+        std::thread t([&]() {
+                ren.reset(req);
+                ren.apply();
+            });
+        t.join();
+        // the other thread opened the face again instead of sharing this one's
+        CHECK(pool.stats().misses > stats.misses);
+        CHECK(std::equal(im.begin(), im.end(), expected.begin()));
+        ren.reset(req);
+        ren.apply();
+        CHECK(std::equal(im.begin(), im.end(), expected.begin()));
+    }
+
+    SECTION("evicts least recently used faces")
+    {
+        pool.set_max_faces(1);
+        mapnik::face_ptr book = pool.get_face("DejaVu Sans Book");
+        mapnik::face_ptr bold = pool.get_face("DejaVu Sans Bold");
+        REQUIRE(book);
+        REQUIRE(bold);
+        CHECK(pool.get_face("DejaVu Sans Bold") == bold);
+        CHECK(pool.get_face("DejaVu Sans Book") != book);
+        CHECK(pool.stats().evictions > 0);
+    }
+
+    SECTION("can be cleared and disabled")
+    {
+        mapnik::face_ptr face = pool.get_face("DejaVu Sans Book");
+        pool.clear();
+        CHECK(pool.get_face("DejaVu Sans Book") != face);
+        pool.set_enabled(false);
+        CHECK(!pool.get_face("DejaVu Sans Book"));
+        mapnik::face_manager fm(library, font_file_mapping, font_memory_cache);
+        CHECK(fm.get_face("DejaVu Sans Book"));
+        pool.set_enabled(true);
+    }
+
+    pool.set_max_faces(max_faces);
+    pool.clear();
+}
@@ -0,0 +1,139 @@
+#include "catch.hpp"
+
+#include <mapnik/image.hpp>
+#include <mapnik/image_util.hpp>
+#include <mapnik/font_engine_freetype.hpp>
+#include <mapnik/text/face.hpp>
+#include <mapnik/text/font_library.hpp>
+#include <mapnik/text/glyph_cache.hpp>
+#include <mapnik/text/glyph_positions.hpp>
+#include <mapnik/text/renderer.hpp>
+#include <mapnik/text/text_properties.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+mapnik::image_rgba8 render(mapnik::glyph_positions const& positions,
+                           mapnik::halo_rasterizer_e rasterizer,
+                           mapnik::stroker_ptr const& stroker)
+{
+    mapnik::image_rgba8 im(256, 256);
+    mapnik::agg_text_renderer<mapnik::image_rgba8> ren(im, rasterizer, mapnik::src_over,
+                                                       mapnik::src_over, 1.0, stroker);
+    ren.render(positions);
+    return im;
+}
+
+} // namespace
+
+TEST_CASE("glyph_cache")
+{
+    mapnik::glyph_cache & cache = mapnik::glyph_cache::instance();
+    std::size_t max_bytes = cache.max_bytes();
+    unsigned subpixel_steps = cache.subpixel_steps();
+    unsigned rotation_steps = cache.rotation_steps();
+    cache.clear();
+
+    mapnik::font_library library;
+    FT_Face ft_face;
+    std::string const file_name("fonts/dejavu-fonts-ttf-2.37/ttf/DejaVuSans.ttf");
+    REQUIRE(FT_New_Face(library.get(), file_name.c_str(), 0, &ft_face) == 0);
+    auto face = std::make_shared<mapnik::font_face>(ft_face, file_name);
+    FT_Stroker s;
+    REQUIRE(FT_Stroker_New(library.get(), &s) == 0);
+    auto stroker = std::make_shared<mapnik::stroker>(s);
+
+    mapnik::evaluated_format_properties_ptr format = std::make_unique<mapnik::detail::evaluated_format_properties>();
+    format->text_size = 13.0;
+    format->text_opacity = 1.0;
+    format->halo_opacity = 0.8;
+    format->fill = mapnik::color(20, 40, 60);
+    format->halo_fill = mapnik::color(255, 255, 255, 200);
+    format->halo_radius = 1.7;
+
+    // a straight label and a rotated one, with repeated glyphs at all sorts
+    // of subpixel positions
+    std::string text = "Mississippi Street, Tallahassee";
+    std::vector<mapnik::glyph_info> glyphs;
+    glyphs.reserve(text.size());
+    for (std::size_t i = 0; i < text.size(); ++i)
+    {
+        glyphs.emplace_back(FT_Get_Char_Index(ft_face, text[i]), i, format);
+        glyphs.back().face = face;
+    }
+    mapnik::glyph_positions positions;
+    positions.set_base_point(mapnik::pixel_position(10.3, 60.45));
+    double x = 0;
+    for (auto const& glyph : glyphs)
+    {
+        positions.emplace_back(glyph, mapnik::pixel_position(x, 0), mapnik::rotation());
+        positions.emplace_back(glyph, mapnik::pixel_position(x * 0.9, -40 - x * 0.4), mapnik::rotation(0.4));
+        x += 7.37;
+    }
+
+    SECTION("renders like FreeType by default")
+    {
+        CHECK(subpixel_steps == 64);
+        CHECK(rotation_steps == 0);
+        for (auto rasterizer : { mapnik::HALO_RASTERIZER_FULL, mapnik::HALO_RASTERIZER_FAST })
+        {
+            INFO("rasterizer " << rasterizer);
+            cache.set_enabled(false);
+            mapnik::image_rgba8 expected = render(positions, rasterizer, stroker);
+            cache.set_enabled(true);
+            mapnik::image_rgba8 first = render(positions, rasterizer, stroker);
+            mapnik::glyph_cache_stats stats = cache.stats();
+            mapnik::image_rgba8 second = render(positions, rasterizer, stroker);
+            CHECK(cache.stats().hits > stats.hits);
+            CHECK(cache.stats().misses == stats.misses);
+            CHECK(mapnik::compare(expected, first) == 0);
+            CHECK(mapnik::compare(expected, second) == 0);
+        }
+    }
+
+    SECTION("opt-in snapping moves glyphs by fractions of a pixel")
+    {
+        cache.set_subpixel_steps(4);
+        cache.set_rotation_steps(360);
+        cache.set_enabled(false);
+        mapnik::image_rgba8 expected = render(positions, mapnik::HALO_RASTERIZER_FULL, stroker);
+        cache.set_enabled(true);
+        mapnik::image_rgba8 im = render(positions, mapnik::HALO_RASTERIZER_FULL, stroker);
+        CHECK(mapnik::compare(expected, im) > 0);
+        CHECK(mapnik::compare(expected, im, 128) == 0);
+        // repeated letters share bitmaps
+        CHECK(cache.stats().hits > 0);
+    }
+
+    SECTION("faces are identified by their font file")
+    {
+        FT_Face same_face;
+        REQUIRE(FT_New_Face(library.get(), file_name.c_str(), 0, &same_face) == 0);
+        mapnik::font_face same(same_face, file_name);
+        CHECK(same.cache_id() == face->cache_id());
+        // another file with identical metadata must not share bitmaps
+        FT_Face other_face;
+        REQUIRE(FT_New_Face(library.get(), file_name.c_str(), 0, &other_face) == 0);
+        mapnik::font_face other(other_face, "fonts/other/DejaVuSans.ttf");
+        CHECK(other.cache_id() != face->cache_id());
+    }
+
+    SECTION("stays within its byte budget")
+    {
+        cache.set_subpixel_steps(64);
+        cache.set_max_bytes(16 * 1024);
+        render(positions, mapnik::HALO_RASTERIZER_FULL, stroker);
+        mapnik::glyph_cache_stats stats = cache.stats();
+        CHECK(stats.bytes <= 16 * 1024);
+        CHECK(stats.evictions > 0);
+    }
+
+    cache.set_enabled(true);
+    cache.set_max_bytes(max_bytes);
+    cache.set_subpixel_steps(subpixel_steps);
+    cache.set_rotation_steps(rotation_steps);
+    cache.clear();
+}
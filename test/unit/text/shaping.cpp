@@ -3,6 +3,12 @@
 #include <mapnik/text/icu_shaper.hpp>
 #include <mapnik/text/harfbuzz_shaper.hpp>
 #include <mapnik/text/font_library.hpp>
+#include <mapnik/text/shaping_cache.hpp>
+#include <mapnik/unicode.hpp>
+
+#include <map>
+#include <tuple>
+#include <vector>
 
 TEST_CASE("shapers compile") {
 
@@ -22,4 +28,73 @@ TEST_CASE("shapers compile") {
                                 width_map,
                                 fm,
                                 scale_factor);
-}
\ No newline at end of file
+}
+
+TEST_CASE("shaping cache") {
+
+    REQUIRE(mapnik::freetype_engine::register_font("fonts/dejavu-fonts-ttf-2.37/ttf/DejaVuSans.ttf"));
+    mapnik::font_library fl;
+    mapnik::freetype_engine::font_file_mapping_type font_file_mapping;
+    mapnik::freetype_engine::font_memory_cache_type font_memory_cache;
+    mapnik::face_manager fm(fl,font_file_mapping,font_memory_cache);
+    mapnik::shaping_cache & cache = mapnik::shaping_cache::instance();
+    cache.clear();
+
+    mapnik::evaluated_format_properties_ptr format = std::make_unique<mapnik::detail::evaluated_format_properties>();
+    format->face_name = "DejaVu Sans Book";
+    format->text_size = 12.0;
+    format->character_spacing = 1.0;
+    format->line_spacing = 0.0;
+    mapnik::transcoder tr("utf-8");
+    mapnik::value_unicode_string text = tr.transcode("Rue de l'\xc3\x89glise, \xd7\xa9\xd7\x9c\xd7\x95\xd7\x9d 12");
+
+    struct shaped_result
+    {
+        std::vector<std::tuple<unsigned, unsigned, double, double, double, double>> glyphs;
+        std::map<unsigned,double> width_map;
+        double width;
+        double max_char_height;
+        double line_height;
+    };
+    auto shape = [&](unsigned start, unsigned end, double scale_factor)
+    {
+        mapnik::text_itemizer itemizer;
+        itemizer.add_text(text, format);
+        mapnik::text_line line(start, end);
+        shaped_result result;
+        mapnik::harfbuzz_shaper::shape_text(line, itemizer, result.width_map, fm, scale_factor);
+        for (auto const& g : line)
+        {
+            result.glyphs.emplace_back(g.glyph_index, g.char_index, g.advance(), g.height(), g.offset.x, g.offset.y);
+        }
+        result.width = line.width();
+        result.max_char_height = line.max_char_height();
+        result.line_height = line.line_height();
+        return result;
+    };
+
+    unsigned length = text.length();
+    for (auto range : { std::make_pair(0u, length), std::make_pair(4u, length - 3) })
+    {
+        for (double scale_factor : { 1.0, 2.0 })
+        {
+            cache.set_enabled(false);
+            shaped_result expected = shape(range.first, range.second, scale_factor);
+            cache.set_enabled(true);
+            mapnik::shaping_cache_stats before = cache.stats();
+            // the first round may be served by the other scale factor
+            for (int round = 0; round < 2; ++round)
+            {
+                shaped_result result = shape(range.first, range.second, scale_factor);
+                CHECK(!result.glyphs.empty());
+                CHECK(result.glyphs == expected.glyphs);
+                CHECK(result.width_map == expected.width_map);
+                CHECK(result.width == expected.width);
+                CHECK(result.max_char_height == expected.max_char_height);
+                CHECK(result.line_height == expected.line_height);
+            }
+            CHECK(cache.stats().hits > before.hits);
+        }
+    }
+    cache.clear();
+}
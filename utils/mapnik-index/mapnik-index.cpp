@@ -27,6 +27,7 @@
 
 #include <mapnik/util/fs.hpp>
 #include <mapnik/quad_tree.hpp>
+#include <mapnik/packed_rtree.hpp>
 
 #include "process_csv_file.hpp"
 #include "process_geojson_file_x3.hpp"
@@ -39,6 +40,7 @@
 
 const int DEFAULT_DEPTH = 8;
 const double DEFAULT_RATIO = 0.55;
+const unsigned int DEFAULT_NODE_SIZE = 16;
 
 namespace mapnik { namespace detail {
 
@@ -64,6 +66,8 @@ int main (int argc, char** argv)
     bool validate_features = false;
     unsigned int depth = DEFAULT_DEPTH;
     double ratio = DEFAULT_RATIO;
+    bool packed = false;
+    unsigned int node_size = DEFAULT_NODE_SIZE;
     std::vector<std::string> files;
     char separator = 0;
     char quote = 0;
@@ -77,6 +81,8 @@ int main (int argc, char** argv)
             ("verbose,v","verbose output")
             ("depth,d", po::value<unsigned int>(), "max tree depth\n(default 8)")
             ("ratio,r",po::value<double>(),"split ratio (default 0.55)")
+            ("rtree","write a packed Hilbert R-tree instead of a quadtree")
+            ("node-size", po::value<unsigned int>(), "packed R-tree node size\n(default 16)")
             ("separator,s", po::value<char>(), "CSV columns separator")
             ("quote,q", po::value<char>(), "CSV columns quote")
             ("manual-headers,H", po::value<std::string>(), "CSV manual headers string")
@@ -120,6 +126,14 @@ int main (int argc, char** argv)
         {
             ratio = vm["ratio"].as<double>();
         }
+        if (vm.count("rtree"))
+        {
+            packed = true;
+        }
+        if (vm.count("node-size"))
+        {
+            node_size = vm["node-size"].as<unsigned int>();
+        }
         if (vm.count("separator"))
         {
             separator = vm["separator"].as<char>();
@@ -164,8 +178,15 @@ int main (int argc, char** argv)
         return EXIT_FAILURE;
     }
 
-    std::clog << "max tree depth:" << depth << std::endl;
-    std::clog << "split ratio:" << ratio << std::endl;
+    if (packed)
+    {
+        std::clog << "packed R-tree node size:" << node_size << std::endl;
+    }
+    else
+    {
+        std::clog << "max tree depth:" << depth << std::endl;
+        std::clog << "split ratio:" << ratio << std::endl;
+    }
 
     using box_type = mapnik::box2d<float>;
     using item_type = std::pair<box_type, std::pair<std::size_t, std::size_t>>;
@@ -208,13 +229,6 @@ int main (int argc, char** argv)
         {
             std::clog << extent << std::endl;
             mapnik::box2d<double> extent_d(extent.minx(), extent.miny(), extent.maxx(), extent.maxy());
-            mapnik::quad_tree<std::pair<std::size_t, std::size_t>> tree(extent_d, depth, ratio);
-            for (auto const& item : boxes)
-            {
-                auto ext_f = std::get<0>(item);
-                tree.insert(std::get<1>(item), mapnik::box2d<double>(ext_f.minx(), ext_f.miny(), ext_f.maxx(), ext_f.maxy()));
-            }
-
             std::fstream file((filename + ".index").c_str(),
                               std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
             if (!file)
@@ -222,8 +236,29 @@ int main (int argc, char** argv)
                 std::clog << "cannot open index file for writing file \""
                           << (filename + ".index") << "\"" << std::endl;
             }
+            else if (packed)
+            {
+                mapnik::packed_rtree<std::pair<std::size_t, std::size_t>> rtree(node_size);
+                for (auto const& item : boxes)
+                {
+                    auto ext_f = std::get<0>(item);
+                    rtree.insert(std::get<1>(item), mapnik::box2d<double>(ext_f.minx(), ext_f.miny(), ext_f.maxx(), ext_f.maxy()));
+                }
+                std::clog <<  "number nodes=" << rtree.count() << std::endl;
+                std::clog <<  "number element=" << rtree.count_items() << std::endl;
+                file.exceptions(std::ios::failbit | std::ios::badbit);
+                rtree.write(file);
+                file.flush();
+                file.close();
+            }
             else
             {
+                mapnik::quad_tree<std::pair<std::size_t, std::size_t>> tree(extent_d, depth, ratio);
+                for (auto const& item : boxes)
+                {
+                    auto ext_f = std::get<0>(item);
+                    tree.insert(std::get<1>(item), mapnik::box2d<double>(ext_f.minx(), ext_f.miny(), ext_f.maxx(), ext_f.maxy()));
+                }
                 tree.trim();
                 std::clog <<  "number nodes=" << tree.count() << std::endl;
                 std::clog <<  "number element=" << tree.count_items() << std::endl;
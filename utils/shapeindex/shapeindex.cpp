@@ -21,10 +21,13 @@
  *****************************************************************************/
 
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <string>
 #include <mapnik/util/fs.hpp>
+#include <mapnik/make_unique.hpp>
 #include <mapnik/quad_tree.hpp>
+#include <mapnik/packed_rtree.hpp>
 #include <mapnik/geometry/envelope.hpp>
 #include "shapefile.hpp"
 #include "shape_io.hpp"
@@ -37,6 +40,7 @@
 
 const int DEFAULT_DEPTH = 8;
 const double DEFAULT_RATIO=0.55;
+const unsigned int DEFAULT_NODE_SIZE = 16;
 
 int main (int argc,char** argv)
 {
@@ -47,6 +51,8 @@ int main (int argc,char** argv)
     bool index_parts = false;
     unsigned int depth = DEFAULT_DEPTH;
     double ratio = DEFAULT_RATIO;
+    bool packed = false;
+    unsigned int node_size = DEFAULT_NODE_SIZE;
     std::vector<std::string> shape_files;
 
     try
@@ -59,6 +65,8 @@ int main (int argc,char** argv)
             ("verbose,v","verbose output")
             ("depth,d", po::value<unsigned int>(), "max tree depth\n(default 8)")
             ("ratio,r",po::value<double>(),"split ratio (default 0.55)")
+            ("rtree","write a packed Hilbert R-tree instead of a quadtree (default: no)")
+            ("node-size", po::value<unsigned int>(), "packed R-tree node size\n(default 16)")
             ("shape_files",po::value<std::vector<std::string> >(),"shape files to index: file1 file2 ...fileN")
             ;
 
@@ -95,6 +103,14 @@ int main (int argc,char** argv)
         {
             ratio = vm["ratio"].as<double>();
         }
+        if (vm.count("rtree"))
+        {
+            packed = true;
+        }
+        if (vm.count("node-size"))
+        {
+            node_size = vm["node-size"].as<unsigned int>();
+        }
 
         if (vm.count("shape_files"))
         {
@@ -107,8 +123,15 @@ int main (int argc,char** argv)
         return EXIT_FAILURE;
     }
 
-    std::clog << "max tree depth:" << depth << std::endl;
-    std::clog << "split ratio:" << ratio << std::endl;
+    if (packed)
+    {
+        std::clog << "packed R-tree node size:" << node_size << std::endl;
+    }
+    else
+    {
+        std::clog << "max tree depth:" << depth << std::endl;
+        std::clog << "split ratio:" << ratio << std::endl;
+    }
 
     if (shape_files.size() == 0)
     {
@@ -170,7 +193,16 @@ int main (int argc,char** argv)
         }
         int pos = 50;
         shx.seek(pos * 2);
-        mapnik::quad_tree<mapnik::detail::node> tree(extent, depth, ratio);
+        // only the structure of the format being written is built
+        std::unique_ptr<mapnik::quad_tree<mapnik::detail::node>> tree;
+        std::unique_ptr<mapnik::packed_rtree<mapnik::detail::node>> rtree;
+        if (packed) rtree = std::make_unique<mapnik::packed_rtree<mapnik::detail::node>>(node_size);
+        else tree = std::make_unique<mapnik::quad_tree<mapnik::detail::node>>(extent, depth, ratio);
+        auto insert = [&](mapnik::detail::node const& item, box2d<double> const& box)
+        {
+            if (packed) rtree->insert(item, box);
+            else tree->insert(item, box);
+        };
         int count = 0;
 
         if (shape_type != shape_io::shape_null)
@@ -233,7 +265,7 @@ int main (int argc,char** argv)
                             {
                                 std::clog << "record number " << record_number << " box=" << item_ext << std::endl;
                             }
-                            tree.insert(mapnik::detail::node(offset * 2, start, end),item_ext);
+                            insert(mapnik::detail::node(offset * 2, start, end),item_ext);
                             ++count;
                         }
                     }
@@ -250,7 +282,7 @@ int main (int argc,char** argv)
                     {
                         std::clog << "record number " << record_number << " box=" << item_ext << std::endl;
                     }
-                    tree.insert(mapnik::detail::node(offset * 2,-1,0),item_ext);
+                    insert(mapnik::detail::node(offset * 2,-1,0),item_ext);
                     ++count;
                 }
             }
@@ -265,12 +297,20 @@ int main (int argc,char** argv)
                 std::clog << "cannot open index file for writing file \""
                           << (shapename+".index") << "\"" << std::endl;
             }
+            else if (packed)
+            {
+                std::clog << " number nodes=" << rtree->count() << std::endl;
+                file.exceptions(std::ios::failbit | std::ios::badbit);
+                rtree->write(file);
+                file.flush();
+                file.close();
+            }
             else
             {
-                tree.trim();
-                std::clog << " number nodes=" << tree.count() << std::endl;
+                tree->trim();
+                std::clog << " number nodes=" << tree->count() << std::endl;
                 file.exceptions(std::ios::failbit | std::ios::badbit);
-                tree.write(file);
+                tree->write(file);
                 file.flush();
                 file.close();
             }